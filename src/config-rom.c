@@ -0,0 +1,3516 @@
+// config-rom.c - Decoder of content of configuration rom
+//
+// Copyright 2023 Takashi Sakamoto <o-takashi@sakamocchi.jp>
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <endian.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "config-rom.h"
+
+#define CONST_ARRAY_SIZE(entries) (sizeof(entries) / sizeof(entries[0]))
+
+#define LINE_WIDTH                100
+
+//////////////////////////////////////////////////////////////
+// Helpers to detect layout of blocks according to IEEE 1212.
+//////////////////////////////////////////////////////////////
+
+enum ieee1212_block_type {
+    IEEE1212_BUS_INFO_BLOCK = 0,
+    IEEE1212_ROOT_DIRECTORY_BLOCK,
+    IEEE1212_LEAF_BLOCK,
+    IEEE1212_DIRECTORY_BLOCK,
+    ORPHAN_BLOCK,
+};
+
+struct ieee1212_block {
+    size_t offset;
+    size_t length;
+    enum ieee1212_block_type block_type;
+    const uint8_t *content;
+    union {
+        struct {
+            uint8_t key_id;
+            const struct ieee1212_block *parent;
+        } leaf;
+        struct {
+            uint8_t key_id;
+            const struct ieee1212_block *parent;
+        } directory;
+    } data;
+};
+
+// Any block starts at quadlet boundary, thus the number of blocks is up to the number of quadlets in
+// the region. The blocks are allocated from the arena and indexed by the offset so that neither
+// allocation nor sorting is required during detection.
+#define MAX_BLOCK_COUNT (CONFIG_ROM_SIZE / 4)
+
+struct block_store {
+    struct ieee1212_block entries[MAX_BLOCK_COUNT];
+    struct ieee1212_block *index[MAX_BLOCK_COUNT];
+    size_t count;
+};
+
+static void init_block_store(struct block_store *store)
+{
+    memset(store->index, 0, sizeof(store->index));
+    store->count = 0;
+}
+
+static struct ieee1212_block *find_block_by_offset(const struct block_store *store, size_t offset)
+{
+    if (offset % 4 > 0 || offset / 4 >= MAX_BLOCK_COUNT)
+        return NULL;
+
+    return store->index[offset / 4];
+}
+
+static int allocate_block(struct block_store *store, size_t offset, size_t length,
+                          enum ieee1212_block_type block_type, const uint8_t *data,
+                          struct ieee1212_block **block)
+{
+    struct ieee1212_block *entry;
+
+    if (offset % 4 > 0 || offset / 4 >= MAX_BLOCK_COUNT)
+        return -EINVAL;
+    if (store->index[offset / 4] != NULL || store->count >= MAX_BLOCK_COUNT)
+        return -ENOSPC;
+
+    entry = store->entries + store->count++;
+    entry->offset = offset;
+    entry->length = length;
+    entry->block_type = block_type;
+    entry->content = data + offset;
+
+    store->index[offset / 4] = entry;
+    *block = entry;
+
+    return 0;
+}
+
+static struct ieee1212_block *next_block(const struct block_store *store,
+                                         const struct ieee1212_block *entry)
+{
+    size_t index = entry != NULL ? entry->offset / 4 + 1 : 0;
+
+    for (; index < MAX_BLOCK_COUNT; ++index) {
+        if (store->index[index] != NULL)
+            return store->index[index];
+    }
+
+    return NULL;
+}
+
+#define BLOCK_STORE_FOREACH(entry, store)                                                          \
+    for (entry = next_block(store, NULL); entry != NULL; entry = next_block(store, entry))
+
+#define IEEE1212_BUS_INFO_BLOCK_LENGTH_MASK  0xff000000
+#define IEEE1212_BUS_INFO_BLOCK_LENGTH_SHIFT 24
+#define IEEE1212_BUS_INFO_CRC_LENGTH_MASK    0x00ff0000
+#define IEEE1212_BUS_INFO_CRC_LENGTH_SHIFT   16
+#define IEEE1212_BUS_INFO_CRC_MASK           0x0000ffff
+#define IEEE1212_BUS_INFO_CRC_SHIFT          0
+
+static int detect_ieee1212_bus_info_block_length(const uint8_t *data, ssize_t length, size_t offset,
+                                                 size_t *block_length)
+{
+    uint32_t quadlet = ((uint32_t *)data)[0];
+
+    *block_length = 4;
+    *block_length += 4 * ((quadlet & IEEE1212_BUS_INFO_BLOCK_LENGTH_MASK) >>
+                          IEEE1212_BUS_INFO_BLOCK_LENGTH_SHIFT);
+
+    if (offset + *block_length > length)
+        return -EINVAL;
+
+    return 0;
+}
+
+static int detect_ieee1212_bus_info_block(const uint8_t *data, ssize_t length, size_t offset,
+                                          size_t block_length, struct block_store *store)
+{
+    struct ieee1212_block *entry;
+
+    return allocate_block(store, offset, block_length, IEEE1212_BUS_INFO_BLOCK, data, &entry);
+}
+
+#define IEEE1212_BLOCK_LENGTH_MASK  0xffff0000
+#define IEEE1212_BLOCK_LENGTH_SHIFT 16
+#define IEEE1212_BLOCK_CRC_MASK     0x0000ffff
+#define IEEE1212_BLOCK_CRC_SHIFT    0
+
+static int detect_ieee1212_block_length(const uint8_t *data, ssize_t length, size_t offset,
+                                        size_t *block_length)
+{
+    uint32_t quadlet;
+
+    // The header quadlet itself can be out of the content.
+    if (offset + 4 > length)
+        return -EINVAL;
+    quadlet = ((uint32_t *)(data + offset))[0];
+
+    *block_length = 4;
+    *block_length += 4 * ((quadlet & IEEE1212_BLOCK_LENGTH_MASK) >> IEEE1212_BLOCK_LENGTH_SHIFT);
+
+    // Like the block overlapping the next one, the block longer than the rest of content is
+    // truncated so that the other blocks are still decoded.
+    if (offset + *block_length > length)
+        *block_length = length - offset;
+
+    return 0;
+}
+
+static int detect_ieee1212_leaf_block(const uint8_t *data, ssize_t length, size_t block_offset,
+                                      size_t block_length, uint8_t key_id,
+                                      const struct ieee1212_block *parent,
+                                      struct block_store *store)
+{
+    struct ieee1212_block *entry;
+    int err;
+
+    if (find_block_by_offset(store, block_offset) != NULL)
+        return 0;
+
+    err = allocate_block(store, block_offset, block_length, IEEE1212_LEAF_BLOCK, data, &entry);
+    if (err < 0)
+        return err;
+
+    entry->data.leaf.key_id = key_id;
+    entry->data.leaf.parent = parent;
+
+    return 0;
+}
+
+#define DIRECTORY_ENTRY_KEY_TYPE_MASK  0xc0000000
+#define DIRECTORY_ENTRY_KEY_TYPE_SHIFT 30
+#define DIRECTORY_ENTRY_KEY_ID_MASK    0x3f000000
+#define DIRECTORY_ENTRY_KEY_ID_SHIFT   24
+#define DIRECTORY_ENTRY_VALUE_MASK     0x00ffffff
+#define DIRECTORY_ENTRY_VALUE_SHIFT    0
+
+#define KEY_TYPE_IMMEDIATE             0
+#define KEY_TYPE_CSR_OFFSET            1
+#define KEY_TYPE_LEAF                  2
+#define KEY_TYPE_DIRECTORY             3
+
+static void decode_directory_entry(uint32_t quadlet, uint8_t *key_type, uint8_t *key_id,
+                                   uint32_t *value)
+{
+    *key_type = (quadlet & DIRECTORY_ENTRY_KEY_TYPE_MASK) >> DIRECTORY_ENTRY_KEY_TYPE_SHIFT;
+    *key_id = (quadlet & DIRECTORY_ENTRY_KEY_ID_MASK) >> DIRECTORY_ENTRY_KEY_ID_SHIFT;
+    *value = (quadlet & DIRECTORY_ENTRY_VALUE_MASK) >> DIRECTORY_ENTRY_VALUE_SHIFT;
+}
+
+static int detect_ieee1212_directory_block(const uint8_t *data, ssize_t length, size_t offset,
+                                           size_t block_length, uint8_t key_id,
+                                           const struct ieee1212_block *parent,
+                                           struct block_store *store);
+
+static int detect_ieee1212_directory_entries(const uint8_t *data, ssize_t length,
+                                             size_t directory_offset, size_t directory_length,
+                                             const struct ieee1212_block *parent,
+                                             struct block_store *store)
+{
+    size_t quadlet_count;
+    int err;
+    int i;
+
+    directory_offset += 4;
+    quadlet_count = (directory_length - 4) / 4;
+
+    for (i = 0; i < quadlet_count; ++i) {
+        size_t entry_offset = directory_offset + i * 4;
+        uint32_t quadlet = *((uint32_t *)(data + entry_offset));
+        uint8_t key_type;
+        uint8_t key_id;
+        uint32_t value;
+
+        decode_directory_entry(quadlet, &key_type, &key_id, &value);
+
+        switch (key_type) {
+        case KEY_TYPE_LEAF:
+        case KEY_TYPE_DIRECTORY: {
+            int (*detect_block)(const uint8_t *data, ssize_t length, size_t block_offset,
+                                size_t block_length, uint8_t key_id,
+                                const struct ieee1212_block *parent,
+                                struct block_store *store);
+            size_t block_offset;
+            size_t block_length;
+
+            // The entry pointing out of the content is skipped so that the rest is still decoded.
+            // It is typically a quadlet of the blocks swallowed by a truncated directory.
+            block_offset = entry_offset + 4 * value;
+            if (block_offset >= length)
+                continue;
+
+            err = detect_ieee1212_block_length(data, length, block_offset, &block_length);
+            if (err < 0)
+                continue;
+
+            if (key_type == KEY_TYPE_LEAF)
+                detect_block = detect_ieee1212_leaf_block;
+            else
+                detect_block = detect_ieee1212_directory_block;
+
+            err = detect_block(data, length, block_offset, block_length, key_id, parent, store);
+            if (err < 0)
+                return err;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+static int detect_ieee1212_directory_block(const uint8_t *data, ssize_t length, size_t block_offset,
+                                           size_t block_length, uint8_t key_id,
+                                           const struct ieee1212_block *parent,
+                                           struct block_store *store)
+{
+    struct ieee1212_block *entry;
+    int err;
+
+    if (find_block_by_offset(store, block_offset) != NULL)
+        return 0;
+
+    err = allocate_block(store, block_offset, block_length, IEEE1212_DIRECTORY_BLOCK, data,
+                         &entry);
+    if (err < 0)
+        return err;
+
+    entry->data.directory.key_id = key_id;
+    entry->data.directory.parent = parent;
+
+    return detect_ieee1212_directory_entries(data, length, block_offset, block_length, entry,
+                                             store);
+}
+
+static int detect_ieee1212_root_directory_block(const uint8_t *data, ssize_t length,
+                                                size_t block_offset, size_t block_length,
+                                                struct block_store *store)
+{
+    struct ieee1212_block *entry;
+    int err;
+
+    err = allocate_block(store, block_offset, block_length, IEEE1212_ROOT_DIRECTORY_BLOCK, data,
+                         &entry);
+    if (err < 0)
+        return err;
+
+    return detect_ieee1212_directory_entries(data, length, block_offset, block_length, entry,
+                                             store);
+}
+
+static int detect_ieee1212_blocks(const uint8_t *data, ssize_t length, struct block_store *store)
+{
+    size_t offset = 0;
+    size_t block_length;
+    int err;
+
+    err = detect_ieee1212_bus_info_block_length(data, length, offset, &block_length);
+    if (err < 0)
+        return err;
+
+    err = detect_ieee1212_bus_info_block(data, length, offset, block_length, store);
+    if (err < 0)
+        return err;
+
+    offset += block_length;
+    err = detect_ieee1212_block_length(data, length, offset, &block_length);
+    if (err < 0)
+        return err;
+
+    return detect_ieee1212_root_directory_block(data, length, offset, block_length, store);
+}
+
+static void normalize_blocks(struct block_store *store, size_t length)
+{
+    struct ieee1212_block *entry;
+
+    entry = next_block(store, NULL);
+    while (entry != NULL) {
+        struct ieee1212_block *peek = next_block(store, entry);
+        size_t next_offset;
+
+        if (peek != NULL)
+            next_offset = peek->offset;
+        else
+            next_offset = length;
+
+        if (entry->offset + entry->length > next_offset)
+            entry->length = next_offset - entry->offset;
+
+        entry = peek;
+    }
+}
+
+static int fulfill_orphan_blocks(const uint8_t *data, ssize_t length, struct block_store *store)
+{
+    struct ieee1212_block *entry;
+    int err;
+
+    entry = next_block(store, NULL);
+    while (entry != NULL) {
+        struct ieee1212_block *peek = next_block(store, entry);
+        size_t next_offset;
+
+        if (peek != NULL)
+            next_offset = peek->offset;
+        else
+            next_offset = length;
+
+        if (entry->offset + entry->length >= next_offset) {
+            entry = peek;
+        } else {
+            size_t orphan_offset = entry->offset + entry->length;
+            struct ieee1212_block *orphan;
+
+            err = allocate_block(store, orphan_offset, next_offset - orphan_offset, ORPHAN_BLOCK,
+                                 data, &orphan);
+            if (err < 0)
+                return err;
+
+            entry = orphan;
+        }
+    }
+
+    return 0;
+}
+
+static bool bus_info_block_is_big_endian(const uint8_t *data, ssize_t length, size_t offset)
+{
+    const uint32_t quadlet = ((uint32_t *)data)[offset + 1];
+
+    // The bus_name field of IEEE 1394 is "1394" in ASCII.
+    return quadlet != 0x31333934 && be32toh(quadlet) == 0x31333934;
+}
+
+static int print_blocks(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                        FILE *output);
+static int emit_blocks_json(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                            FILE *output);
+static int emit_blocks_binary(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                              FILE *output);
+static int emit_file_header_json(const char *path, FILE *output);
+static int emit_file_header_binary(const char *path, FILE *output);
+static int verify_blocks(const char *path, ssize_t data_length, struct block_store *store,
+                         FILE *output);
+static int emit_changed_blocks(const char *baseline_dir, const uint8_t *data, ssize_t length,
+                               struct block_store *store, const struct config_rom_format *format,
+                               FILE *output);
+static void init_key_formatters(void);
+
+static int print_file_header(const char *path, FILE *output)
+{
+    fprintf(output, "==> %s <==\n", path);
+
+    return 0;
+}
+
+struct config_rom_format {
+    const char *name;
+    int (*emit_file_header)(const char *path, FILE *output);
+    int (*emit_blocks)(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                       FILE *output);
+};
+
+static const struct config_rom_format output_formats[] = {
+    {
+        "text",
+        print_file_header,
+        print_blocks,
+    },
+    {
+        "json",
+        emit_file_header_json,
+        emit_blocks_json,
+    },
+    {
+        "binary",
+        emit_file_header_binary,
+        emit_blocks_binary,
+    },
+};
+
+// The content is used as is unless it should be swapped, in the case the swapped content is
+// written to the given buffer.
+static int detect_config_rom(const uint8_t **data, ssize_t length, uint8_t *buf,
+                             struct block_store *store)
+{
+    size_t offset = 0;
+    bool is_big_endian;
+    int err;
+
+    // The content is untrusted. It should have the first quadlet of bus information block and
+    // root directory at least, and the trailing bytes not aligned to quadlet are ignored.
+    if (length < 8 || length > CONFIG_ROM_SIZE)
+        return -EINVAL;
+    length -= length % 4;
+
+    is_big_endian = bus_info_block_is_big_endian(*data, length, offset);
+    if (is_big_endian) {
+        uint32_t *quadlet = (uint32_t *)buf;
+        int i;
+
+        memcpy(buf, *data, length);
+        for (i = 0; i < length / 4; ++i)
+            quadlet[i] = be32toh(quadlet[i]);
+        *data = buf;
+    }
+
+    init_block_store(store);
+
+    err = detect_ieee1212_blocks(*data, length, store);
+    if (err < 0)
+        return err;
+    normalize_blocks(store, length);
+
+    return fulfill_orphan_blocks(*data, length, store);
+}
+
+void config_rom_init(void)
+{
+    init_key_formatters();
+}
+
+const struct config_rom_format *config_rom_find_format(const char *name)
+{
+    int i;
+
+    for (i = 0; i < CONST_ARRAY_SIZE(output_formats); ++i) {
+        if (!strcmp(name, output_formats[i].name))
+            return &output_formats[i];
+    }
+
+    return NULL;
+}
+
+int config_rom_emit_file_header(const struct config_rom_format *format, const char *path,
+                                FILE *output)
+{
+    return format->emit_file_header(path, output);
+}
+
+int config_rom_decode(const uint8_t *data, ssize_t length, const struct config_rom_format *format,
+                      FILE *output)
+{
+    uint8_t buf[CONFIG_ROM_SIZE];
+    struct block_store store;
+    int err;
+
+    err = detect_config_rom(&data, length, buf, &store);
+    if (err < 0)
+        return err;
+
+    return format->emit_blocks(data, length, &store, output);
+}
+
+int config_rom_decode_changes(const char *baseline_dir, const uint8_t *data, ssize_t length,
+                              const struct config_rom_format *format, FILE *output)
+{
+    uint8_t buf[CONFIG_ROM_SIZE];
+    struct block_store store;
+    int err;
+
+    err = detect_config_rom(&data, length, buf, &store);
+    if (err < 0)
+        return err;
+
+    return emit_changed_blocks(baseline_dir, data, length, &store, format, output);
+}
+
+int config_rom_verify(const char *path, const uint8_t *data, ssize_t length, FILE *output)
+{
+    uint8_t buf[CONFIG_ROM_SIZE];
+    struct block_store store;
+    int err;
+
+    err = detect_config_rom(&data, length, buf, &store);
+    if (err < 0)
+        return err;
+
+    return verify_blocks(path, length, &store, output);
+}
+
+////////////////////////////////////////
+// Helpers to format content of blocks.
+////////////////////////////////////////
+
+#define IEEE1212_REGISTER_SPACE_ADDRESS 0xfffff0000000
+#define IEEE1212_CONFIG_ROM_OFFSET      0x400
+
+#define KEY_ID_CSR_DESCRIPTOR           0x01
+#define KEY_ID_CSR_BUS_DEP_INFO         0x02
+#define KEY_ID_CSR_VENDOR_INFO          0x03
+#define KEY_ID_CSR_HARDWARE_VERSION     0x04
+#define KEY_ID_CSR_MODULE_INFO          0x07
+#define KEY_ID_CSR_NODE_CAPS            0x0c
+#define KEY_ID_CSR_EUI_64               0x0d
+#define KEY_ID_CSR_UNIT                 0x11
+#define KEY_ID_CSR_SPECIFIER_ID         0x12
+#define KEY_ID_CSR_VERSION              0x13
+#define KEY_ID_CSR_DEP_INFO             0x14
+#define KEY_ID_CSR_UNIT_LOCATION        0x15
+#define KEY_ID_CSR_MODEL                0x17
+#define KEY_ID_CSR_INSTANCE             0x18
+#define KEY_ID_CSR_KEYWORD              0x19
+#define KEY_ID_CSR_FEATURE              0x1au
+#define KEY_ID_CSR_MODIFIABLE_DESC      0x1f
+#define KEY_ID_CSR_DIRECTORY_ID         0x20
+
+#define INVALID_KEY_ID                  0xff // 6 bits are allowed for valid key id.
+#define INVALID_KEY_VALUE               0xffffffff // 24 bits are allowed for valid value.
+
+#define UNSPECIFIED_ENTRY_NAME          "(unspecified)"
+
+struct spec_identifier {
+    uint32_t specifier_id;
+    uint32_t version;
+};
+
+// The text of blocks is formatted line by line at the end of one buffer which grows as needed.
+// Each line is formatted in place within LINE_WIDTH bytes, then terminated by a newline when the
+// next line is started.
+struct text_buffer {
+    char *data;
+    size_t length; // The bytes of terminated lines.
+    size_t size;
+    bool in_line;
+    int err;
+    // The lines are formatted here and dropped once the buffer could not grow.
+    char scratch[LINE_WIDTH];
+};
+
+#define TEXT_BUFFER_INITIAL_SIZE  4096
+
+static void terminate_line(struct text_buffer *text)
+{
+    if (!text->in_line)
+        return;
+
+    text->length += strnlen(text->data + text->length, LINE_WIDTH - 1);
+    text->data[text->length++] = '\n';
+    text->in_line = false;
+}
+
+// Return the line to be formatted, which has LINE_WIDTH bytes and is empty.
+static char *append_line(struct text_buffer *text)
+{
+    terminate_line(text);
+
+    if (text->err == 0 && text->size - text->length < LINE_WIDTH) {
+        size_t size = text->size > 0 ? text->size * 2 : TEXT_BUFFER_INITIAL_SIZE;
+        char *data = realloc(text->data, size);
+
+        if (data == NULL) {
+            text->err = -ENOMEM;
+        } else {
+            text->data = data;
+            text->size = size;
+        }
+    }
+
+    if (text->err < 0) {
+        text->scratch[0] = '\0';
+        return text->scratch;
+    }
+
+    text->in_line = true;
+    text->data[text->length] = '\0';
+    return text->data + text->length;
+}
+
+struct key_formatter {
+    uint8_t key_type;
+    uint8_t key_id;
+    const char *key_id_name;
+    union {
+        size_t (*immediate)(char *buf, size_t length, uint32_t value);
+        void (*leaf)(struct text_buffer *text, size_t offset, const uint32_t *quadlets,
+                     size_t quadlet_count, const char *spec_name);
+        void (*directory)(struct text_buffer *text, size_t offset, const uint32_t *quadlets,
+                          size_t quadlet_count, const struct spec_identifier *identifier);
+    } format_content;
+};
+
+static void detect_key_formatter(const struct key_formatter **formatter, const char **spec_name,
+                                 const struct spec_identifier *identifier, uint32_t key_type,
+                                 uint32_t key_id);
+
+static void detect_block_spec_identifier(const struct ieee1212_block *block,
+                                         struct spec_identifier *identifier)
+{
+    const struct ieee1212_block *base;
+    const uint32_t *quadlet;
+    size_t quadlet_count;
+    int i;
+
+    identifier->specifier_id = INVALID_KEY_VALUE;
+    identifier->version = INVALID_KEY_VALUE;
+
+    switch (block->block_type) {
+    case IEEE1212_ROOT_DIRECTORY_BLOCK:
+        quadlet = (const uint32_t *)block->content;
+        quadlet_count = block->length / 4;
+
+        for (i = 1; i < quadlet_count; ++i) {
+            uint8_t key_type;
+            uint8_t key_id;
+            uint32_t value;
+
+            decode_directory_entry(quadlet[i], &key_type, &key_id, &value);
+
+            if (key_type == KEY_TYPE_IMMEDIATE && key_id == KEY_ID_CSR_VENDOR_INFO)
+                identifier->specifier_id = value;
+        }
+        return;
+    case IEEE1212_LEAF_BLOCK:
+        base = block->data.leaf.parent;
+        break;
+    case IEEE1212_DIRECTORY_BLOCK:
+        switch (block->data.directory.key_id) {
+        case KEY_ID_CSR_VENDOR_INFO:
+        case KEY_ID_CSR_MODULE_INFO:
+        case KEY_ID_CSR_DESCRIPTOR:
+        case KEY_ID_CSR_BUS_DEP_INFO:
+        case KEY_ID_CSR_DEP_INFO:
+        case KEY_ID_CSR_INSTANCE:
+            base = block->data.directory.parent;
+            break;
+        case KEY_ID_CSR_UNIT:
+        case KEY_ID_CSR_FEATURE:
+            base = block;
+            break;
+        default:
+            base = NULL;
+            break;
+        }
+        break;
+    default:
+        return;
+    }
+
+    while (base != NULL) {
+        quadlet = (const uint32_t *)base->content;
+        quadlet_count = base->length / 4;
+
+        for (i = 1; i < quadlet_count; ++i) {
+            uint8_t key_type;
+            uint8_t key_id;
+            uint32_t value;
+
+            decode_directory_entry(quadlet[i], &key_type, &key_id, &value);
+
+            if (key_type == KEY_TYPE_IMMEDIATE) {
+                switch (key_id) {
+                case KEY_ID_CSR_SPECIFIER_ID:
+                    if (identifier->specifier_id == INVALID_KEY_VALUE)
+                        identifier->specifier_id = value;
+                    break;
+                case KEY_ID_CSR_VERSION:
+                    if (identifier->version == INVALID_KEY_VALUE)
+                        identifier->version = value;
+                    break;
+                case KEY_ID_CSR_VENDOR_INFO:
+                    if (identifier->specifier_id == INVALID_KEY_VALUE)
+                        identifier->specifier_id = value;
+                default:
+                    break;
+                }
+            }
+        }
+
+        if (base->block_type == IEEE1212_DIRECTORY_BLOCK)
+            base = base->data.directory.parent;
+        else
+            base = NULL;
+    }
+
+}
+
+static size_t format_line_prefix(char *buf, size_t length, size_t offset, uint32_t quadlet,
+                                 bool add_delimiter)
+{
+    size_t consumed;
+
+    offset += IEEE1212_CONFIG_ROM_OFFSET;
+
+    consumed = snprintf(buf, length, "%3zu  %08x", offset, quadlet);
+
+    if (add_delimiter)
+        consumed += snprintf(buf + consumed, length - consumed, "  ");
+
+    return consumed;
+}
+
+static size_t format_blank_prefix(char *buf, size_t length)
+{
+    size_t consumed = snprintf(buf, length, "%3x  %08x  ", IEEE1212_CONFIG_ROM_OFFSET, 0u);
+    memset(buf, ' ', consumed);
+    return consumed;
+}
+
+static size_t format_horizontal_line(char *buf, size_t length)
+{
+    return snprintf(buf, length,
+                    "-----------------------------------------------------------------");
+}
+
+// The remainders of polynomial 0x1021 (x^16 + x^12 + x^5 + 1) for each value of byte, to process
+// eight bits at once instead of single nibble.
+static const uint16_t itu_t_crc_16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+static uint16_t compute_itu_t_crc_16(const uint32_t *quadlet, size_t quadlet_count)
+{
+    uint16_t crc = 0;
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i) {
+        int shift;
+
+        // The most significant byte goes first.
+        for (shift = 24; shift >= 0; shift -= 8) {
+            uint8_t index = (crc >> 8) ^ (quadlet[i] >> shift);
+
+            crc = (crc << 8) ^ itu_t_crc_16_table[index];
+        }
+    }
+
+    return crc;
+}
+
+uint16_t config_rom_compute_crc_16(const uint32_t *quadlets, size_t quadlet_count)
+{
+    return compute_itu_t_crc_16(quadlets, quadlet_count);
+}
+
+// The CRC in the ROM header covers crc_length quadlets of the ROM after the header, not only the
+// bus information block, up to the end of the content.
+static uint16_t compute_bus_info_crc(const uint32_t *quadlet, size_t data_length,
+                                     size_t *effective_crc_length)
+{
+    size_t crc_length = (quadlet[0] & IEEE1212_BUS_INFO_CRC_LENGTH_MASK) >>
+                        IEEE1212_BUS_INFO_CRC_LENGTH_SHIFT;
+
+    if (crc_length > data_length / 4 - 1)
+        crc_length = data_length / 4 - 1;
+    *effective_crc_length = crc_length;
+
+    return compute_itu_t_crc_16(quadlet + 1, crc_length);
+}
+
+static size_t format_bus_info_metadata(char *buf, size_t length, const uint32_t *quadlet,
+                                       size_t quadlet_count, size_t data_length)
+{
+    uint8_t block_length = (quadlet[0] & IEEE1212_BUS_INFO_BLOCK_LENGTH_MASK) >>
+                           IEEE1212_BUS_INFO_BLOCK_LENGTH_SHIFT;
+    uint8_t crc_length = (quadlet[0] & IEEE1212_BUS_INFO_CRC_LENGTH_MASK) >>
+                         IEEE1212_BUS_INFO_CRC_LENGTH_SHIFT;
+    uint16_t crc = (quadlet[0] & IEEE1212_BUS_INFO_CRC_MASK) >> IEEE1212_BUS_INFO_CRC_SHIFT;
+    size_t effective_crc_length;
+    uint16_t actual_crc;
+    size_t consumed;
+
+    consumed = snprintf(buf, length, "bus_info_length %d", block_length);
+
+    consumed += snprintf(buf + consumed, length - consumed, ", crc_length %d", crc_length);
+    actual_crc = compute_bus_info_crc(quadlet, data_length, &effective_crc_length);
+    if (effective_crc_length < crc_length)
+        consumed +=
+            snprintf(buf + consumed, length - consumed, " (up to %zu)", effective_crc_length);
+
+    consumed += snprintf(buf + consumed, length - consumed, ", crc %d", crc);
+    if (crc != actual_crc)
+        consumed += snprintf(buf + consumed, length - consumed, " (should be %d)", actual_crc);
+
+    return consumed;
+}
+
+static void format_ieee1394_bus_dependent_information(struct text_buffer *text, size_t offset,
+                                                      uint32_t quadlet)
+{
+    bool irm_capable = (quadlet & 0x80000000) >> 31;
+    bool cm_capable = (quadlet & 0x40000000) >> 30;
+    bool is_capable = (quadlet & 0x20000000) >> 29;
+    bool bm_capable = (quadlet & 0x10000000) >> 28;
+    uint8_t cyc_clk_acc = (quadlet & 0x00ff0000) >> 16;
+    uint8_t max_rec = (quadlet & 0x0000f000) >> 12;
+    uint8_t generation = (quadlet & 0x000000f0) >> 4;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    if (generation > 0) {
+        bool pm_capable = (quadlet & 0x08000000) >> 27;
+        uint8_t max_rom = (quadlet & 0x00000300) >> 8;
+        uint8_t spd = quadlet & 0x00000007;
+
+        line = append_line(text);
+        consumed = format_line_prefix(line, length, offset, quadlet, true);
+        snprintf(line + consumed, length - consumed,
+                 "irmc %d, cmc %d, isc %d, bmc %d, pmc %d, cyc_clk_acc %d,", irm_capable,
+                 cm_capable, is_capable, bm_capable, pm_capable, cyc_clk_acc);
+
+        line = append_line(text);
+        consumed = format_blank_prefix(line, length);
+        snprintf(line + consumed, length - consumed,
+                 "max_rec %d (%d), max_rom %d, gen %d, spd %d (S%d00)", max_rec, 2 << max_rec,
+                 max_rom, generation, spd, 1 << spd);
+    } else {
+        line = append_line(text);
+        consumed = format_line_prefix(line, length, offset, quadlet, true);
+        snprintf(line + consumed, length - consumed,
+                 "irmc %d, cmc %d, isc %d, bmc %d, cyc_clk_acc %d, max_rec %d (%d)", irm_capable,
+                 cm_capable, is_capable, bm_capable, cyc_clk_acc, max_rec, 2 << max_rec);
+    }
+}
+
+static void format_unspecified_bus_dependent_information(struct text_buffer *text, size_t offset,
+                                                         uint32_t quadlet)
+{
+    format_line_prefix(append_line(text), LINE_WIDTH, offset, quadlet, false);
+}
+
+static void format_bus_info_block(struct text_buffer *text, const struct ieee1212_block *bus_info,
+                                  size_t data_length)
+{
+    static const struct {
+        uint32_t bus_name_value;
+        const char *bus_name;
+        void (*format)(struct text_buffer *text, size_t offset, uint32_t quadlet);
+    } *bus_entry, bus_entries[] = {
+        {
+            0x31333934,
+            "1394",
+            format_ieee1394_bus_dependent_information,
+        },
+        {
+            0xffffffff,
+            "unspecified",
+            format_unspecified_bus_dependent_information,
+        },
+    };
+    size_t offset = bus_info->offset;
+    const uint32_t *quadlet = (const uint32_t *)bus_info->content;
+    size_t quadlet_count = bus_info->length / 4;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+    uint32_t company_id;
+    uint64_t device_id;
+    uint64_t eui64;
+    int i;
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    snprintf(line + consumed, length - consumed, "ROM header and bus information block");
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    format_horizontal_line(line + consumed, length - consumed);
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset, quadlet[0], true);
+    format_bus_info_metadata(line + consumed, length - consumed, quadlet, quadlet_count,
+                             data_length);
+
+    // The fields of IEEE 1394 are not available in the block shorter than the one of IEEE 1394.
+    if (quadlet_count < 5) {
+        for (i = 1; i < quadlet_count; ++i)
+            format_line_prefix(append_line(text), length, offset + 4 * i, quadlet[i], false);
+        return;
+    }
+
+    bus_entry = NULL;
+    for (i = 0; i < CONST_ARRAY_SIZE(bus_entries); ++i) {
+        if (bus_entries[i].bus_name_value == quadlet[1]) {
+            bus_entry = bus_entries + i;
+            break;
+        }
+    }
+    if (bus_entry == NULL)
+        bus_entry = &bus_entries[CONST_ARRAY_SIZE(bus_entries) - 1];
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset + 4, quadlet[1], true);
+    snprintf(line + consumed, length - consumed, "bus_name \"%s\"", bus_entry->bus_name);
+
+    bus_entry->format(text, offset + 8, quadlet[2]);
+
+    company_id = (quadlet[3] & 0xffffff00) >> 8;
+    device_id = ((((uint64_t)quadlet[3]) & 0x000000ff) << 32) | quadlet[4];
+    eui64 = (((uint64_t)quadlet[3]) << 32) | quadlet[4];
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset + 12, quadlet[3], true);
+    snprintf(line + consumed, length - consumed, "company_id %06x     | ", company_id);
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset + 16, quadlet[4], true);
+    snprintf(line + consumed, length - consumed,
+             "device_id %010" PRIu64 "  | EUI-64 %016" PRIu64,
+             device_id, eui64);
+
+    for (i = 5; i < quadlet_count; ++i)
+        format_line_prefix(append_line(text), length, offset + 4 * i, quadlet[i], false);
+}
+
+static size_t format_block_metadata(char *buf, size_t length, const char *block_name,
+                                    const uint32_t *quadlet, size_t quadlet_count)
+{
+    uint16_t block_length = (quadlet[0] & IEEE1212_BLOCK_LENGTH_MASK) >>
+                            IEEE1212_BLOCK_LENGTH_SHIFT;
+    uint16_t block_crc = (quadlet[0] & IEEE1212_BLOCK_CRC_MASK) >> IEEE1212_BLOCK_CRC_SHIFT;
+    uint16_t actual_block_crc = compute_itu_t_crc_16(quadlet + 1, quadlet_count - 1);
+    size_t consumed;
+
+    consumed = snprintf(buf, length, "%s_length %d", block_name, block_length);
+    if (1 + block_length != quadlet_count)
+        consumed +=
+            snprintf(buf + consumed, length - consumed, " (actual length %zu)", quadlet_count - 1);
+
+    consumed += snprintf(buf + consumed, length - consumed, ", crc %d", block_crc);
+    if (block_crc != actual_block_crc)
+        consumed +=
+            snprintf(buf + consumed, length - consumed, " (should be %d)", actual_block_crc);
+
+    return consumed;
+}
+
+static void format_leaf_block(struct text_buffer *text, const struct ieee1212_block *leaf,
+                              size_t data_length)
+{
+    struct spec_identifier identifier;
+    const struct key_formatter *formatter;
+    const char *spec_name = NULL;
+    size_t offset;
+    const uint32_t *quadlet;
+    size_t quadlet_count;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    detect_block_spec_identifier(leaf, &identifier);
+
+    detect_key_formatter(&formatter, &spec_name, &identifier, KEY_TYPE_LEAF,
+                         leaf->data.leaf.key_id);
+
+    offset = leaf->offset;
+    quadlet = (const uint32_t *)leaf->content;
+    quadlet_count = leaf->length / 4;
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    if (spec_name != NULL)
+        consumed += snprintf(line + consumed, length - consumed, "%s ", spec_name);
+    snprintf(line + consumed, length - consumed, "%s leaf at %zu", formatter->key_id_name,
+             IEEE1212_CONFIG_ROM_OFFSET + offset);
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    format_horizontal_line(line + consumed, length - consumed);
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset, quadlet[0], true);
+    format_block_metadata(line + consumed, length - consumed, "leaf", quadlet, quadlet_count);
+
+    offset += 4;
+    ++quadlet;
+    --quadlet_count;
+
+    formatter->format_content.leaf(text, offset, quadlet, quadlet_count, NULL);
+}
+
+static size_t format_entry_spec_name(char *buf, size_t length, const char *spec_name)
+{
+    if (spec_name != NULL)
+        return snprintf(buf, length, "%s ", spec_name);
+
+    return 0;
+}
+
+static size_t format_immediate_entry(char *buf, size_t length, size_t offset, uint32_t value,
+                                     const char *spec_name, const struct key_formatter *formatter)
+{
+    size_t consumed;
+
+    consumed = format_entry_spec_name(buf, length, spec_name);
+
+    if (formatter->key_id != INVALID_KEY_ID)
+        consumed += snprintf(buf + consumed, length - consumed, "%s", formatter->key_id_name);
+
+    if (formatter->format_content.immediate != NULL) {
+        if (formatter->key_id != INVALID_KEY_ID)
+            consumed += snprintf(buf + consumed, length - consumed, ": ");
+        consumed += formatter->format_content.immediate(buf + consumed, length - consumed, value);
+    }
+
+    return consumed;
+}
+
+static size_t format_csr_offset_entry(char *buf, size_t length, size_t offset, uint32_t value,
+                                      const char *spec_name, const struct key_formatter *formatter)
+{
+    size_t csr_offset = IEEE1212_REGISTER_SPACE_ADDRESS + 4 * value;
+    size_t consumed;
+
+    consumed = snprintf(buf, length, "--> ");
+    consumed += format_entry_spec_name(buf + consumed, length - consumed, spec_name);
+
+    if (formatter->key_id != INVALID_KEY_ID)
+        consumed += snprintf(buf + consumed, length - consumed, "%s ", formatter->key_id_name);
+    else
+        consumed += snprintf(buf + consumed, length - consumed, "CSR ");
+
+    consumed += snprintf(buf + consumed, length - consumed, "at %012zu", csr_offset);
+
+    return consumed;
+}
+
+static size_t format_leaf_entry(char *buf, size_t length, size_t offset, uint32_t value,
+                                const char *spec_name, const struct key_formatter *formatter)
+{
+    size_t leaf_offset = IEEE1212_CONFIG_ROM_OFFSET + offset + 4 * value;
+    size_t consumed;
+
+    consumed = snprintf(buf, length, "--> ");
+    consumed += format_entry_spec_name(buf + consumed, length - consumed, spec_name);
+
+    if (formatter->key_id != INVALID_KEY_ID)
+        consumed += snprintf(buf + consumed, length - consumed, "%s ", formatter->key_id_name);
+
+    consumed += snprintf(buf + consumed, length - consumed, "leaf at %zu", leaf_offset);
+
+    return consumed;
+}
+
+static size_t format_directory_entry(char *buf, size_t length, size_t offset, uint32_t value,
+                                     const char *spec_name, const struct key_formatter *formatter)
+{
+    size_t directory_offset = IEEE1212_CONFIG_ROM_OFFSET + offset + 4 * value;
+    size_t consumed;
+
+    consumed = snprintf(buf, length, "--> ");
+    consumed += format_entry_spec_name(buf + consumed, length - consumed, spec_name);
+
+    if (formatter->key_id != INVALID_KEY_ID)
+        consumed += snprintf(buf + consumed, length - consumed, "%s ", formatter->key_id_name);
+
+    consumed += snprintf(buf + consumed, length - consumed, "directory at %zu", directory_offset);
+
+    return consumed;
+}
+
+static void format_directory_entries(struct text_buffer *text, size_t directory_offset,
+                                     const uint32_t *quadlet, size_t quadlet_count,
+                                     const struct spec_identifier *identifier)
+{
+    static size_t (*const format_entry[])(char *buf, size_t length, size_t offset, uint32_t value,
+                                          const char *spec_name,
+                                          const struct key_formatter *formatter) = {
+        [KEY_TYPE_IMMEDIATE] = format_immediate_entry,
+        [KEY_TYPE_CSR_OFFSET] = format_csr_offset_entry,
+        [KEY_TYPE_LEAF] = format_leaf_entry,
+        [KEY_TYPE_DIRECTORY] = format_directory_entry,
+    };
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+    int i;
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, directory_offset, quadlet[0], true);
+    format_block_metadata(line + consumed, length - consumed, "directory", quadlet,
+                          quadlet_count);
+
+    for (i = 1; i < quadlet_count; ++i) {
+        const struct key_formatter *formatter;
+        size_t offset = directory_offset + i * 4;
+        uint8_t key_type;
+        uint8_t key_id;
+        uint32_t value;
+        size_t consumed;
+        const char *spec_name = NULL;
+
+        decode_directory_entry(quadlet[i], &key_type, &key_id, &value);
+
+        detect_key_formatter(&formatter, &spec_name, identifier, key_type, key_id);
+
+        line = append_line(text);
+        consumed = format_line_prefix(line, length, offset, quadlet[i], true);
+        format_entry[key_type](line + consumed, length - consumed, offset, value, spec_name,
+                               formatter);
+    }
+}
+
+static void format_directory_block(struct text_buffer *text,
+                                   const struct ieee1212_block *directory, size_t data_length)
+{
+    struct spec_identifier identifier;
+    size_t offset;
+    const uint32_t *quadlet;
+    size_t quadlet_count;
+    const struct key_formatter *formatter;
+    const char *spec_name = NULL;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    detect_block_spec_identifier(directory, &identifier);
+
+    offset = directory->offset;
+    quadlet = (const uint32_t *)directory->content;
+    quadlet_count = directory->length / 4;
+
+    detect_key_formatter(&formatter, &spec_name, &identifier, KEY_TYPE_DIRECTORY,
+                         directory->data.directory.key_id);
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    snprintf(line + consumed, length - consumed, "%s directory at %zu",
+             formatter->key_id_name, IEEE1212_CONFIG_ROM_OFFSET + offset);
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    format_horizontal_line(line + consumed, length - consumed);
+
+    formatter->format_content.directory(text, offset, quadlet, quadlet_count, &identifier);
+}
+
+static void format_root_directory_block(struct text_buffer *text,
+                                        const struct ieee1212_block *root, size_t data_length)
+{
+    struct spec_identifier identifier;
+    size_t offset = root->offset;
+    const uint32_t *quadlet = (const uint32_t *)root->content;
+    size_t quadlet_count = root->length / 4;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    detect_block_spec_identifier(root, &identifier);
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    snprintf(line + consumed, length - consumed, "root directory");
+
+    line = append_line(text);
+    consumed = format_blank_prefix(line, length);
+    format_horizontal_line(line + consumed, length - consumed);
+
+    format_directory_entries(text, offset, quadlet, quadlet_count, &identifier);
+}
+
+static void format_orphan_block(struct text_buffer *text, const struct ieee1212_block *orphan,
+                                size_t data_length)
+{
+    const uint32_t *quadlet = (const uint32_t *)orphan->content;
+    size_t quadlet_count = orphan->length / 4;
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i) {
+        size_t offset = orphan->offset + i * 4;
+        char *line = append_line(text);
+        size_t consumed = format_line_prefix(line, LINE_WIDTH, offset, quadlet[i], true);
+        snprintf(line + consumed, LINE_WIDTH - consumed, "(unreferenced data)");
+    }
+}
+
+// The text goes to the file descriptor by one system call when the stream has it, after the
+// preceding output buffered in the stream. The memory stream for the jobs of the pretty printer
+// has no file descriptor.
+static int write_text(FILE *output, const char *text, size_t length)
+{
+    int fd = fileno(output);
+
+    if (fd < 0) {
+        if (length > 0 && fwrite(text, 1, length, output) < length)
+            return -EIO;
+        return 0;
+    }
+
+    if (fflush(output) == EOF)
+        return -errno;
+
+    while (length > 0) {
+        ssize_t result = write(fd, text, length);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        text += result;
+        length -= result;
+    }
+
+    return 0;
+}
+
+static int print_blocks(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                        FILE *output)
+{
+    static void (*const format[])(struct text_buffer *text, const struct ieee1212_block *entry,
+                                  size_t data_length) = {
+        format_bus_info_block,  format_root_directory_block, format_leaf_block,
+        format_directory_block, format_orphan_block,
+    };
+    struct text_buffer text = {0};
+    struct ieee1212_block *block;
+    int err;
+
+    // Each block is followed by an empty line.
+    BLOCK_STORE_FOREACH(block, store)
+    {
+        format[block->block_type](&text, block, data_length);
+        append_line(&text);
+    }
+    terminate_line(&text);
+
+    err = text.err;
+    if (err == 0)
+        err = write_text(output, text.data, text.length);
+
+    free(text.data);
+
+    return err;
+}
+
+///////////////////////////////////////////////////////
+// Helpers to emit blocks in machine-readable formats.
+///////////////////////////////////////////////////////
+
+static const char *const block_type_names[] = {
+    [IEEE1212_BUS_INFO_BLOCK] = "bus_info",
+    [IEEE1212_ROOT_DIRECTORY_BLOCK] = "root_directory",
+    [IEEE1212_LEAF_BLOCK] = "leaf",
+    [IEEE1212_DIRECTORY_BLOCK] = "directory",
+    [ORPHAN_BLOCK] = "orphan",
+};
+
+static const char *const key_type_names[] = {
+    [KEY_TYPE_IMMEDIATE] = "immediate",
+    [KEY_TYPE_CSR_OFFSET] = "csr_offset",
+    [KEY_TYPE_LEAF] = "leaf",
+    [KEY_TYPE_DIRECTORY] = "directory",
+};
+
+// The bus information block is at the beginning of the content, thus its CRC is computed over the
+// content of data_length bytes.
+static void detect_block_crc(const struct ieee1212_block *block, size_t data_length,
+                             uint16_t *crc, uint16_t *actual_crc)
+{
+    const uint32_t *quadlet = (const uint32_t *)block->content;
+    size_t quadlet_count = block->length / 4;
+
+    if (block->block_type == IEEE1212_BUS_INFO_BLOCK) {
+        size_t effective_crc_length;
+
+        *crc = (quadlet[0] & IEEE1212_BUS_INFO_CRC_MASK) >> IEEE1212_BUS_INFO_CRC_SHIFT;
+        *actual_crc = compute_bus_info_crc(quadlet, data_length, &effective_crc_length);
+    } else {
+        *crc = (quadlet[0] & IEEE1212_BLOCK_CRC_MASK) >> IEEE1212_BLOCK_CRC_SHIFT;
+        *actual_crc = compute_itu_t_crc_16(quadlet + 1, quadlet_count - 1);
+    }
+}
+
+static const struct ieee1212_block *block_parent(const struct ieee1212_block *block)
+{
+    switch (block->block_type) {
+    case IEEE1212_LEAF_BLOCK:
+        return block->data.leaf.parent;
+    case IEEE1212_DIRECTORY_BLOCK:
+        return block->data.directory.parent;
+    default:
+        return NULL;
+    }
+}
+
+static void emit_json_string(FILE *output, const char *str, size_t length)
+{
+    size_t i;
+
+    fputc('"', output);
+    for (i = 0; i < length; ++i) {
+        uint8_t letter = str[i];
+
+        if (letter == '"' || letter == '\\')
+            fprintf(output, "\\%c", letter);
+        else if (letter < 0x20 || letter >= 0x7f)
+            fprintf(output, "\\u%04x", letter);
+        else
+            fputc(letter, output);
+    }
+    fputc('"', output);
+}
+
+static void emit_json_name(FILE *output, const char *key, const char *name)
+{
+    fprintf(output, ",\"%s\":", key);
+    if (name != NULL)
+        emit_json_string(output, name, strlen(name));
+    else
+        fputs("null", output);
+}
+
+static void emit_json_quadlets(FILE *output, const uint32_t *quadlet, size_t quadlet_count)
+{
+    size_t i;
+
+    fputs(",\"quadlets\":[", output);
+    for (i = 0; i < quadlet_count; ++i)
+        fprintf(output, "%s%" PRIu32, i > 0 ? "," : "", quadlet[i]);
+    fputc(']', output);
+}
+
+static void emit_json_directory_entries(FILE *output, const struct ieee1212_block *directory,
+                                        const struct spec_identifier *identifier)
+{
+    const uint32_t *quadlet = (const uint32_t *)directory->content;
+    size_t quadlet_count = directory->length / 4;
+    int i;
+
+    fputs(",\"entries\":[", output);
+    for (i = 1; i < quadlet_count; ++i) {
+        size_t offset = directory->offset + i * 4;
+        const struct key_formatter *formatter;
+        const char *spec_name = NULL;
+        uint8_t key_type;
+        uint8_t key_id;
+        uint32_t value;
+
+        decode_directory_entry(quadlet[i], &key_type, &key_id, &value);
+        detect_key_formatter(&formatter, &spec_name, identifier, key_type, key_id);
+
+        fprintf(output, "%s{\"offset\":%zu,\"key_type\":\"%s\",\"key_id\":%u", i > 1 ? "," : "",
+                IEEE1212_CONFIG_ROM_OFFSET + offset, key_type_names[key_type], key_id);
+        emit_json_name(output, "name",
+                       formatter->key_id != INVALID_KEY_ID ? formatter->key_id_name : NULL);
+        emit_json_name(output, "spec", spec_name);
+
+        switch (key_type) {
+        case KEY_TYPE_IMMEDIATE:
+            fprintf(output, ",\"value\":%" PRIu32, value);
+            if (formatter->format_content.immediate != NULL &&
+                formatter->key_id != INVALID_KEY_ID) {
+                char text[LINE_WIDTH];
+                size_t length;
+
+                length = formatter->format_content.immediate(text, sizeof(text), value);
+                if (length >= sizeof(text))
+                    length = sizeof(text) - 1;
+                fputs(",\"text\":", output);
+                emit_json_string(output, text, length);
+            }
+            break;
+        case KEY_TYPE_CSR_OFFSET:
+            fprintf(output, ",\"address\":%" PRIu64,
+                    (uint64_t)IEEE1212_REGISTER_SPACE_ADDRESS + 4 * value);
+            break;
+        default:
+            fprintf(output, ",\"target\":%zu", IEEE1212_CONFIG_ROM_OFFSET + offset + 4 * value);
+            break;
+        }
+
+        fputc('}', output);
+    }
+    fputc(']', output);
+}
+
+static void emit_json_leaf_text(FILE *output, const uint32_t *quadlet, size_t quadlet_count)
+{
+    char text[CONFIG_ROM_SIZE];
+    size_t length = 0;
+    int i, j;
+
+    // Textual descriptor (IEEE 1212) in minimal ASCII, or the similar leaf specific to IIDC.
+    if (quadlet_count < 2 || quadlet[0] != 0 || quadlet[1] != 0)
+        return;
+
+    for (i = 2; i < quadlet_count; ++i) {
+        for (j = 0; j < 4; ++j) {
+            size_t shift = 24 - j * 8;
+            uint8_t letter = (quadlet[i] >> shift) & 0xff;
+
+            if (letter != '\0')
+                text[length++] = letter;
+        }
+    }
+
+    fputs(",\"text\":", output);
+    emit_json_string(output, text, length);
+}
+
+static void emit_json_block(FILE *output, const struct ieee1212_block *block, size_t data_length)
+{
+    const uint32_t *quadlet = (const uint32_t *)block->content;
+    size_t quadlet_count = block->length / 4;
+    const struct ieee1212_block *parent = block_parent(block);
+    struct spec_identifier identifier;
+    const struct key_formatter *formatter;
+    const char *spec_name = NULL;
+    uint16_t crc;
+    uint16_t actual_crc;
+
+    fprintf(output, "{\"type\":\"%s\",\"offset\":%zu,\"length\":%zu",
+            block_type_names[block->block_type], IEEE1212_CONFIG_ROM_OFFSET + block->offset,
+            block->length);
+
+    if (parent != NULL)
+        fprintf(output, ",\"parent\":%zu", IEEE1212_CONFIG_ROM_OFFSET + parent->offset);
+
+    if (block->block_type != ORPHAN_BLOCK) {
+        detect_block_crc(block, data_length, &crc, &actual_crc);
+        fprintf(output, ",\"crc\":%u,\"crc_ok\":%s", crc, crc == actual_crc ? "true" : "false");
+    }
+
+    switch (block->block_type) {
+    case IEEE1212_BUS_INFO_BLOCK:
+        if (quadlet_count >= 5) {
+            emit_json_name(output, "bus_name",
+                           quadlet[1] == 0x31333934 ? "1394" : "unspecified");
+            fprintf(output, ",\"bus_dependent_info\":%" PRIu32 ",\"eui64\":\"%08" PRIx32
+                    "%08" PRIx32 "\"", quadlet[2], quadlet[3], quadlet[4]);
+        }
+        emit_json_quadlets(output, quadlet + 1, quadlet_count - 1);
+        break;
+    case IEEE1212_ROOT_DIRECTORY_BLOCK:
+        detect_block_spec_identifier(block, &identifier);
+        emit_json_directory_entries(output, block, &identifier);
+        break;
+    case IEEE1212_DIRECTORY_BLOCK:
+        detect_block_spec_identifier(block, &identifier);
+        detect_key_formatter(&formatter, &spec_name, &identifier, KEY_TYPE_DIRECTORY,
+                             block->data.directory.key_id);
+        fprintf(output, ",\"key_id\":%u", block->data.directory.key_id);
+        emit_json_name(output, "name", formatter->key_id_name);
+        emit_json_name(output, "spec", spec_name);
+        emit_json_directory_entries(output, block, &identifier);
+        break;
+    case IEEE1212_LEAF_BLOCK:
+        detect_block_spec_identifier(block, &identifier);
+        detect_key_formatter(&formatter, &spec_name, &identifier, KEY_TYPE_LEAF,
+                             block->data.leaf.key_id);
+        fprintf(output, ",\"key_id\":%u", block->data.leaf.key_id);
+        emit_json_name(output, "name", formatter->key_id_name);
+        emit_json_name(output, "spec", spec_name);
+        emit_json_quadlets(output, quadlet + 1, quadlet_count - 1);
+        if (block->data.leaf.key_id == KEY_ID_CSR_DESCRIPTOR || spec_name != NULL)
+            emit_json_leaf_text(output, quadlet + 1, quadlet_count - 1);
+        break;
+    case ORPHAN_BLOCK:
+    default:
+        emit_json_quadlets(output, quadlet, quadlet_count);
+        break;
+    }
+
+    fputs("}\n", output);
+}
+
+static int emit_blocks_json(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                            FILE *output)
+{
+    struct ieee1212_block *block;
+
+    BLOCK_STORE_FOREACH(block, store)
+        emit_json_block(output, block, data_length);
+
+    return 0;
+}
+
+static int emit_file_header_json(const char *path, FILE *output)
+{
+    fputs("{\"file\":", output);
+    emit_json_string(output, path, strlen(path));
+    fputs("}\n", output);
+
+    return 0;
+}
+
+// The record has 16 bytes header and the content of block. All of fields are big endian.
+//  0: type of block (0xff for the record of file name)
+//  1: key ID for leaf and directory, else 0xff
+//  2: flags; bit 0 is set when the CRC is valid
+//  3: reserved
+//  4: offset of block in register space with 0x400 base
+//  6: offset of parent block, else 0
+//  8: CRC in the block
+// 10: CRC computed for the content of block
+// 12: the number of quadlets in the content
+// 14: reserved
+#define BINARY_RECORD_HEADER_SIZE 16
+#define BINARY_RECORD_TYPE_FILE   0xff
+#define BINARY_RECORD_NO_KEY_ID   0xff
+#define BINARY_RECORD_FLAG_CRC_OK 0x01
+
+static void emit_binary_record_header(FILE *output, uint8_t type, uint8_t key_id, uint8_t flags,
+                                      uint16_t offset, uint16_t parent_offset, uint16_t crc,
+                                      uint16_t actual_crc, uint16_t quadlet_count)
+{
+    uint8_t header[BINARY_RECORD_HEADER_SIZE] = {
+        type,
+        key_id,
+        flags,
+        0,
+        offset >> 8,
+        offset & 0xff,
+        parent_offset >> 8,
+        parent_offset & 0xff,
+        crc >> 8,
+        crc & 0xff,
+        actual_crc >> 8,
+        actual_crc & 0xff,
+        quadlet_count >> 8,
+        quadlet_count & 0xff,
+        0,
+        0,
+    };
+
+    fwrite(header, 1, sizeof(header), output);
+}
+
+static int emit_blocks_binary(const uint8_t *data, ssize_t data_length, struct block_store *store,
+                              FILE *output)
+{
+    struct ieee1212_block *block;
+
+    BLOCK_STORE_FOREACH(block, store)
+    {
+        const uint32_t *quadlet = (const uint32_t *)block->content;
+        size_t quadlet_count = block->length / 4;
+        const struct ieee1212_block *parent = block_parent(block);
+        uint8_t key_id = BINARY_RECORD_NO_KEY_ID;
+        uint8_t flags = 0;
+        uint16_t crc = 0;
+        uint16_t actual_crc = 0;
+        int i;
+
+        if (block->block_type == IEEE1212_LEAF_BLOCK)
+            key_id = block->data.leaf.key_id;
+        else if (block->block_type == IEEE1212_DIRECTORY_BLOCK)
+            key_id = block->data.directory.key_id;
+
+        if (block->block_type != ORPHAN_BLOCK) {
+            detect_block_crc(block, data_length, &crc, &actual_crc);
+            if (crc == actual_crc)
+                flags |= BINARY_RECORD_FLAG_CRC_OK;
+        }
+
+        emit_binary_record_header(output, block->block_type, key_id, flags,
+                                  IEEE1212_CONFIG_ROM_OFFSET + block->offset,
+                                  parent != NULL ? IEEE1212_CONFIG_ROM_OFFSET + parent->offset : 0,
+                                  crc, actual_crc, quadlet_count);
+
+        for (i = 0; i < quadlet_count; ++i) {
+            uint32_t be = htobe32(quadlet[i]);
+            fwrite(&be, 1, sizeof(be), output);
+        }
+    }
+
+    return 0;
+}
+
+static int emit_file_header_binary(const char *path, FILE *output)
+{
+    size_t length = strlen(path);
+    size_t quadlet_count = (length + 3) / 4;
+    static const uint8_t padding[4];
+
+    emit_binary_record_header(output, BINARY_RECORD_TYPE_FILE, BINARY_RECORD_NO_KEY_ID, 0, 0, 0,
+                              0, 0, quadlet_count);
+    fwrite(path, 1, length, output);
+    fwrite(padding, 1, quadlet_count * 4 - length, output);
+
+    return 0;
+}
+
+////////////////////////////////////
+// Helpers to verify CRC of blocks.
+////////////////////////////////////
+
+static int verify_blocks(const char *path, ssize_t data_length, struct block_store *store,
+                         FILE *output)
+{
+    struct ieee1212_block *block;
+    int count = 0;
+
+    BLOCK_STORE_FOREACH(block, store)
+    {
+        uint16_t crc;
+        uint16_t actual_crc;
+
+        // Orphan block has no header quadlet.
+        if (block->block_type == ORPHAN_BLOCK)
+            continue;
+
+        detect_block_crc(block, data_length, &crc, &actual_crc);
+        if (crc != actual_crc) {
+            fprintf(output, "%s: %s block at %zu: crc %d (should be %d)\n", path,
+                    block_type_names[block->block_type], IEEE1212_CONFIG_ROM_OFFSET + block->offset,
+                    crc, actual_crc);
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+///////////////////////////////////////////////
+// Helpers to compare blocks with the baseline.
+///////////////////////////////////////////////
+
+// The baseline has one file per GUID, which records the digest of the whole content, and the
+// type, length, CRC field and digest of each block. A block is unchanged when a block with the
+// same record is in the baseline, wherever it is, so that blocks moved by a change of another
+// block are not reported. The digest is FNV-1a, which is cheap enough to compare each node in
+// every run; unchanged content is not formatted at all.
+
+#define FNV_1A_64_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_1A_64_PRIME        0x100000001b3ull
+
+struct block_digest {
+    unsigned int block_type;
+    size_t length;
+    uint16_t crc;
+    uint64_t hash;
+};
+
+struct rom_digest {
+    size_t length;
+    uint64_t hash;
+    struct block_digest blocks[MAX_BLOCK_COUNT];
+    size_t block_count;
+};
+
+static uint64_t compute_fnv_1a_64(const uint8_t *data, size_t length)
+{
+    uint64_t hash = FNV_1A_64_OFFSET_BASIS;
+    size_t i;
+
+    for (i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= FNV_1A_64_PRIME;
+    }
+
+    return hash;
+}
+
+static void compute_rom_digest(const uint8_t *data, ssize_t length,
+                               const struct block_store *store, struct rom_digest *digest)
+{
+    struct ieee1212_block *block;
+
+    digest->length = length;
+    digest->hash = compute_fnv_1a_64(data, length);
+    digest->block_count = 0;
+
+    BLOCK_STORE_FOREACH(block, store)
+    {
+        struct block_digest *entry = digest->blocks + digest->block_count++;
+        uint16_t actual_crc;
+
+        entry->block_type = block->block_type;
+        entry->length = block->length;
+        entry->crc = 0;
+        // Orphan block has no header quadlet.
+        if (block->block_type != ORPHAN_BLOCK)
+            detect_block_crc(block, length, &entry->crc, &actual_crc);
+        entry->hash = compute_fnv_1a_64(block->content, block->length);
+    }
+}
+
+static bool has_block_digest(const struct rom_digest *digest, const struct block_digest *entry)
+{
+    size_t i;
+
+    for (i = 0; i < digest->block_count; ++i) {
+        const struct block_digest *candidate = digest->blocks + i;
+
+        if (candidate->hash == entry->hash && candidate->crc == entry->crc &&
+            candidate->length == entry->length && candidate->block_type == entry->block_type)
+            return true;
+    }
+
+    return false;
+}
+
+// The GUID is in the bus information block of IEEE 1394.
+static bool detect_guid(const uint8_t *data, ssize_t length, uint64_t *guid)
+{
+    const uint32_t *quadlet = (const uint32_t *)data;
+
+    if (length < 20 || (quadlet[0] & IEEE1212_BUS_INFO_BLOCK_LENGTH_MASK) >>
+                               IEEE1212_BUS_INFO_BLOCK_LENGTH_SHIFT < 4)
+        return false;
+
+    *guid = ((uint64_t)quadlet[3] << 32) | quadlet[4];
+
+    return true;
+}
+
+static char *baseline_file_name(const char *baseline_dir, uint64_t guid)
+{
+    size_t size = strlen(baseline_dir) + 18;
+    char *name = malloc(size);
+
+    if (name != NULL)
+        snprintf(name, size, "%s/%016" PRIx64, baseline_dir, guid);
+
+    return name;
+}
+
+// A missing or malformed file is an empty baseline.
+static void load_baseline(const char *name, struct rom_digest *digest)
+{
+    struct block_digest *entry;
+    unsigned int block_type;
+    unsigned int crc;
+    FILE *file;
+
+    digest->length = 0;
+    digest->hash = 0;
+    digest->block_count = 0;
+
+    file = fopen(name, "r");
+    if (file == NULL)
+        return;
+
+    if (fscanf(file, "rom %zx %" SCNx64 "\n", &digest->length, &digest->hash) != 2) {
+        digest->length = 0;
+        fclose(file);
+        return;
+    }
+
+    while (digest->block_count < MAX_BLOCK_COUNT) {
+        entry = digest->blocks + digest->block_count;
+        if (fscanf(file, "%u %zx %x %" SCNx64 "\n", &block_type, &entry->length, &crc,
+                   &entry->hash) != 4)
+            break;
+        entry->block_type = block_type;
+        entry->crc = crc;
+        ++digest->block_count;
+    }
+
+    fclose(file);
+}
+
+// The file is replaced atomically, so that concurrent readers never see a partial one.
+static int save_baseline(const char *baseline_dir, const char *name,
+                         const struct rom_digest *digest)
+{
+    size_t size = strlen(name) + 8;
+    char *temp_name;
+    FILE *file;
+    int err = 0;
+    int fd;
+    size_t i;
+
+    if (mkdir(baseline_dir, 0755) < 0 && errno != EEXIST)
+        return -errno;
+
+    temp_name = malloc(size);
+    if (temp_name == NULL)
+        return -ENOMEM;
+    snprintf(temp_name, size, "%s.XXXXXX", name);
+
+    fd = mkstemp(temp_name);
+    if (fd < 0) {
+        err = -errno;
+        free(temp_name);
+        return err;
+    }
+    file = fdopen(fd, "w");
+    if (file == NULL) {
+        err = -errno;
+        close(fd);
+        unlink(temp_name);
+        free(temp_name);
+        return err;
+    }
+
+    fchmod(fd, 0644);
+    fprintf(file, "rom %zx %016" PRIx64 "\n", digest->length, digest->hash);
+    for (i = 0; i < digest->block_count; ++i) {
+        const struct block_digest *entry = digest->blocks + i;
+
+        fprintf(file, "%u %zx %04x %016" PRIx64 "\n", entry->block_type, entry->length,
+                entry->crc, entry->hash);
+    }
+
+    if (fclose(file) != 0 || rename(temp_name, name) < 0) {
+        err = -errno;
+        unlink(temp_name);
+    }
+    free(temp_name);
+
+    return err;
+}
+
+// Only the blocks which are not in the baseline are emitted, then the baseline is updated. The
+// content without GUID is emitted as a whole.
+static int emit_changed_blocks(const char *baseline_dir, const uint8_t *data, ssize_t length,
+                               struct block_store *store, const struct config_rom_format *format,
+                               FILE *output)
+{
+    struct rom_digest *digest;
+    struct rom_digest *baseline;
+    struct block_store changed;
+    struct ieee1212_block *block;
+    uint64_t guid;
+    char *name;
+    size_t i;
+    int err;
+
+    if (!detect_guid(data, length, &guid))
+        return format->emit_blocks(data, length, store, output);
+
+    name = baseline_file_name(baseline_dir, guid);
+    digest = malloc(sizeof(*digest));
+    baseline = malloc(sizeof(*baseline));
+    if (name == NULL || digest == NULL || baseline == NULL) {
+        err = -ENOMEM;
+        goto end;
+    }
+
+    compute_rom_digest(data, length, store, digest);
+    load_baseline(name, baseline);
+
+    err = 0;
+    if (baseline->length == digest->length && baseline->hash == digest->hash)
+        goto end;
+
+    // The copy refers to the blocks in the original store.
+    changed = *store;
+    i = 0;
+    BLOCK_STORE_FOREACH(block, store)
+    {
+        if (has_block_digest(baseline, digest->blocks + i))
+            changed.index[block->offset / 4] = NULL;
+        ++i;
+    }
+
+    err = format->emit_blocks(data, length, &changed, output);
+    if (err >= 0)
+        err = save_baseline(baseline_dir, name, digest);
+end:
+    free(baseline);
+    free(digest);
+    free(name);
+
+    return err;
+}
+
+//////////////
+// Protocols.
+//////////////
+
+#define OUI_ICANN_IANA        0x00005e
+#define SPEC_VERSION_RFC_2734 0x000001
+#define SPEC_VERSION_RFC_3146 0x000002
+#define SPEC_NAME_RFC_2734    "IPv4 over 1394 (RFC 2734)"
+#define SPEC_NAME_RFC_3146    "IPv6 over 1394 (RFC 3146)"
+
+static const struct spec_identifier spec_iana_ipv4 = {
+    OUI_ICANN_IANA,
+    SPEC_VERSION_RFC_2734,
+};
+
+static const struct spec_identifier spec_iana_ipv6 = {
+    OUI_ICANN_IANA,
+    SPEC_VERSION_RFC_3146,
+};
+
+#define OUI_INCITS           0x00609e
+#define SPEC_VERSION_SBP     0x010483
+#define SPEC_VERSION_SBP_AVC 0x0105bb
+#define SPEC_NAME_SBP        "SBP-2"
+#define SPEC_NAME_SBP_AVC    "AV/C over SBP-3"
+
+static const struct spec_identifier spec_incits_sbp = {
+    OUI_INCITS,
+    SPEC_VERSION_SBP,
+};
+
+static const struct spec_identifier spec_incits_sbp_avc = {
+    OUI_INCITS,
+    SPEC_VERSION_SBP_AVC,
+};
+
+#define OUI_1394TA                     0x00a02d
+#define SPEC_VERSION_AVC               0x010001
+#define SPEC_VERSION_CAL               0x010002
+#define SPEC_VERSION_EHS               0x010004
+#define SPEC_VERSION_HAVI              0x010008
+#define SPEC_VERSION_VENDOR_UNIQUE     0x014000
+#define SPEC_VERSION_VENDOR_UNIQUE_AVC 0x014001
+#define SPEC_VERSION_IIDC_104          0x000100
+#define SPEC_VERSION_IIDC_120          0x000101
+#define SPEC_VERSION_IIDC_130          0x000102
+#define SPEC_VERSION_IIDC2             0x000110
+#define SPEC_VERSION_DPP_111           0x0a6be2
+#define SPEC_VERSION_IICP              0x4b661f
+#define SPEC_NAME_AVC                  "AV/C"
+#define SPEC_NAME_CAL                  "CAL"
+#define SPEC_NAME_EHS                  "EHS"
+#define SPEC_NAME_HAVI                 "HAVi"
+#define SPEC_NAME_VENDOR_UNIQUE        "Vendor Unique"
+#define SPEC_NAME_VENDOR_UNIQUE_AVC    "Vendor Unique and AV/C"
+#define SPEC_NAME_IIDC_104             "IIDC 1.04"
+#define SPEC_NAME_IIDC_120             "IIDC 1.20"
+#define SPEC_NAME_IIDC_130             "IIDC 1.30"
+#define SPEC_NAME_IIDC2                "IIDC2"
+#define SPEC_NAME_DPP_111              "DPP 1.0"
+#define SPEC_NAME_IICP                 "IICP 1.0"
+
+static const struct spec_identifier spec_1394ta_avc = {
+    OUI_1394TA,
+    SPEC_VERSION_AVC,
+};
+
+static const struct spec_identifier spec_1394ta_cal = {
+    OUI_1394TA,
+    SPEC_VERSION_CAL,
+};
+
+static const struct spec_identifier spec_1394ta_ehs = {
+    OUI_1394TA,
+    SPEC_VERSION_EHS,
+};
+
+static const struct spec_identifier spec_1394ta_havi = {
+    OUI_1394TA,
+    SPEC_VERSION_HAVI,
+};
+
+static const struct spec_identifier spec_1394ta_vendor_unique = {
+    OUI_1394TA,
+    SPEC_VERSION_VENDOR_UNIQUE,
+};
+
+static const struct spec_identifier spec_1394ta_vendor_unique_avc = {
+    OUI_1394TA,
+    SPEC_VERSION_VENDOR_UNIQUE_AVC,
+};
+
+static const struct spec_identifier spec_1394ta_iidc_104 = {
+    OUI_1394TA,
+    SPEC_VERSION_IIDC_104,
+};
+
+static const struct spec_identifier spec_1394ta_iidc_120 = {
+    OUI_1394TA,
+    SPEC_VERSION_IIDC_120,
+};
+
+static const struct spec_identifier spec_1394ta_iidc_130 = {
+    OUI_1394TA,
+    SPEC_VERSION_IIDC_130,
+};
+
+static const struct spec_identifier spec_1394ta_iidc2 = {
+    OUI_1394TA,
+    SPEC_VERSION_IIDC2,
+};
+
+static const struct spec_identifier spec_1394ta_dpp_111 = {
+    OUI_1394TA,
+    SPEC_VERSION_DPP_111,
+};
+
+static const struct spec_identifier spec_1394ta_iicp = {
+    OUI_1394TA,
+    SPEC_VERSION_IICP,
+};
+
+#define OUI_ALESIS                0x000595
+#define SPEC_VERSION_ALESIS_AUDIO 0x000001
+#define SPEC_NAME_ALESIS_AUDIO    "audio"
+
+static const struct spec_identifier spec_alesis_audio = {
+    OUI_ALESIS,
+    SPEC_VERSION_ALESIS_AUDIO,
+};
+
+#define OUI_APPLE                   0x000a27
+#define SPEC_VERSION_ISIGHT_AUDIO   0x000010
+#define SPEC_VERSION_ISIGHT_FACTORY 0x000011
+#define SPEC_VERSION_ISIGHT_IRIS    0x000012
+#define SPEC_NAME_ISIGHT_AUDIO      "iSight audio unit"
+#define SPEC_NAME_ISIGHT_FACTORY    "iSight factory unit"
+#define SPEC_NAME_ISIGHT_IRIS       "iSight iris unit"
+
+static const struct spec_identifier spec_apple_isight_audio = {
+    OUI_APPLE,
+    SPEC_VERSION_ISIGHT_AUDIO,
+};
+
+static const struct spec_identifier spec_apple_isight_factory = {
+    OUI_APPLE,
+    SPEC_VERSION_ISIGHT_FACTORY,
+};
+
+static const struct spec_identifier spec_apple_isight_iris = {
+    OUI_APPLE,
+    SPEC_VERSION_ISIGHT_IRIS,
+};
+
+#define OUI_LACIE              0x00d04b
+#define SPEC_VERSION_LACIE_HID 0x484944
+#define SPEC_NAME_LACIE_HID    "HID"
+
+static const struct spec_identifier spec_lacie_hid = {
+    OUI_LACIE,
+    SPEC_VERSION_LACIE_HID,
+};
+
+///////////////////////////////////////////////
+// Directory entries specific to CSR directory.
+///////////////////////////////////////////////
+
+#define CSR_DESCRIPTOR_NAME       "descriptor"
+#define CSR_BUS_DEP_INFO_NAME     "bus dependent info"
+#define CSR_VENDOR_INFO_NAME      "vendor"
+#define CSR_HARDWARE_VERSION_NAME "hardware version"
+#define CSR_MODULE_INFO_NAME      "module"
+#define CSR_NODE_CAPS_NAME        "node capabilities"
+#define CSR_EUI_64_NAME           "eui-64"
+#define CSR_UNIT_NAME             "unit"
+#define CSR_SPECIFIER_ID_NAME     "specifier id"
+#define CSR_VERSION_NAME          "version"
+#define CSR_DEP_INFO_NAME         "dependent info"
+#define CSR_UNIT_LOCATION_NAME    "unit location"
+#define CSR_MODEL_NAME            "model"
+#define CSR_INSTANCE_NAME         "instance"
+#define CSR_KEYWORD_NAME          "keyword"
+#define CSR_FEATURE_NAME          "feature"
+#define CSR_MODIFIABLE_DESC_NAME  "modifiable descriptor"
+#define CSR_DIRECTORY_ID_NAME     "directory id"
+
+static void format_csr_textual_descriptor_leaf_content(struct text_buffer *text, size_t offset,
+                                                       const uint32_t *quadlet,
+                                                       size_t quadlet_count,
+                                                       const char *spec_name)
+{
+    uint8_t width;
+    uint16_t character_set;
+    uint16_t language;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+    int i, j;
+
+    if (quadlet_count < 2)
+        return;
+
+    width = quadlet[0] >> 28;
+    character_set = (quadlet[0] & 0x0fff0000) >> 16;
+    language = (quadlet[0] & 0x0000ffff) >> 0;
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset, quadlet[0], true);
+    if (character_set == 0) {
+        snprintf(line + consumed, length - consumed, "minimal ASCII");
+    } else {
+        snprintf(line + consumed, length - consumed, "width %d, character_set %d, language %d",
+                 width, character_set, language);
+    }
+
+    for (i = 1; i < quadlet_count; ++i) {
+        line = append_line(text);
+        consumed = format_line_prefix(line, length, offset + i * 4, quadlet[i], true);
+
+        if (quadlet[i] > 0) {
+            consumed += snprintf(line + consumed, length - consumed, "\"");
+
+            for (j = 0; j < 4; ++j) {
+                size_t shift = 24 - j * 8;
+                uint8_t letter = (quadlet[i] >> shift) & 0xff;
+                if (letter != '\0')
+                    consumed += snprintf(line + consumed, length - consumed, "%c", letter);
+            }
+
+            snprintf(line + consumed, length - consumed, "\"");
+        }
+    }
+}
+
+static void format_csr_icon_descriptor_leaf_content(struct text_buffer *text, size_t offset,
+                                                    const uint32_t *quadlet, size_t quadlet_count,
+                                                    const char *spec_name)
+{
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i)
+        format_line_prefix(append_line(text), LINE_WIDTH, offset + i * 4, quadlet[i], false);
+}
+
+static void format_csr_unspecified_descriptor_leaf_content(struct text_buffer *text,
+                                                           size_t offset, const uint32_t *quadlet,
+                                                           size_t quadlet_count,
+                                                           const char *spec_name)
+{
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i)
+        format_line_prefix(append_line(text), LINE_WIDTH, offset + i * 4, quadlet[i], false);
+}
+
+#define CSR_DESC_TYPE_MASK    0xff000000
+#define CSR_DESC_TYPE_SHIFT   24
+#define CSR_SPEC_MASK         0x00ffffff
+#define CSR_SPEC_SHIFT        0
+
+#define CSR_DESC_TYPE_TEXTUAL 0x00
+#define CSR_DESC_TYPE_ICON    0x01
+
+static void format_csr_descriptor_leaf_content(struct text_buffer *text, size_t offset,
+                                               const uint32_t *quadlet, size_t quadlet_count,
+                                               const char *spec_name)
+{
+    void (*format)(struct text_buffer *text, size_t offset, const uint32_t *quadlet,
+                   size_t quadlet_count, const char *spec_name);
+    uint8_t desc_type;
+    uint32_t spec_id;
+    char desc_type_name[64];
+    size_t consumed;
+    char *line;
+
+    if (quadlet_count < 1)
+        return;
+
+    desc_type = (quadlet[0] & CSR_DESC_TYPE_MASK) >> CSR_DESC_TYPE_SHIFT;
+    spec_id = (quadlet[0] & CSR_SPEC_MASK) & CSR_SPEC_SHIFT;
+
+    switch (desc_type) {
+    case CSR_DESC_TYPE_TEXTUAL:
+        snprintf(desc_type_name, sizeof(desc_type_name), "textual descriptor");
+        format = format_csr_textual_descriptor_leaf_content;
+        break;
+    case CSR_DESC_TYPE_ICON:
+        snprintf(desc_type_name, sizeof(desc_type_name), "icon descriptor");
+        format = format_csr_icon_descriptor_leaf_content;
+        break;
+    default:
+        snprintf(desc_type_name, sizeof(desc_type_name), "descriptor_type %02x, specifier_ID %x",
+                 desc_type, spec_id);
+        format = format_csr_unspecified_descriptor_leaf_content;
+        break;
+    }
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, LINE_WIDTH, offset, quadlet[0], true);
+    snprintf(line + consumed, LINE_WIDTH - consumed, "%s", desc_type_name);
+
+    offset += 4;
+    ++quadlet;
+    quadlet_count -= 1;
+
+    format(text, offset, quadlet, quadlet_count, spec_name);
+}
+
+static void format_csr_keyword_leaf_content(struct text_buffer *text, size_t offset,
+                                            const uint32_t *quadlet, size_t quadlet_count,
+                                            const char *spec_name)
+{
+    size_t length = LINE_WIDTH;
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i) {
+        char *line = append_line(text);
+        size_t consumed;
+        int j;
+
+        consumed = format_line_prefix(line, length, offset + 4 * i, quadlet[i], true);
+        if (quadlet[i] > 0) {
+            consumed += snprintf(line + consumed, length - consumed, "\"");
+
+            for (j = 0; j < 4; ++j) {
+                size_t shift = 24 - j * 8;
+                uint8_t letter = (quadlet[i] >> shift) & 0xff;
+
+                if (letter != '\0')
+                    consumed += snprintf(line + consumed, length - consumed, "%c", letter);
+                else if (i < quadlet_count - 1)
+                    consumed += snprintf(line + consumed, length - consumed, "\" \"");
+                else
+                    break;
+            }
+
+            snprintf(line + consumed, length - consumed, "\"");
+        }
+    }
+}
+
+static void format_csr_unit_location_leaf_content(struct text_buffer *text, size_t offset,
+                                                  const uint32_t *quadlet, size_t quadlet_count,
+                                                  const char *spec_name)
+{
+    uint64_t base_address;
+    uint64_t upper_bound;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    if (quadlet_count < 4)
+        return;
+
+    base_address = (((uint64_t)quadlet[0]) << 32) | quadlet[1];
+    upper_bound = (((uint64_t)quadlet[2]) << 32) | quadlet[3];
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset, quadlet[0], true);
+    snprintf(line + consumed, length - consumed, "base_address %016" PRIu64, base_address);
+
+    format_line_prefix(append_line(text), length, offset + 4, quadlet[1], false);
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset + 8, quadlet[2], true);
+    snprintf(line + consumed, length - consumed, "upper_bound %016" PRIu64, upper_bound);
+
+    format_line_prefix(append_line(text), length, offset + 12, quadlet[3], false);
+}
+
+static void format_csr_eui64_leaf_content(struct text_buffer *text, size_t offset,
+                                          const uint32_t *quadlet, size_t quadlet_count,
+                                          const char *spec_name)
+{
+    uint32_t company_id;
+    uint64_t device_id;
+    uint64_t eui64;
+    size_t length = LINE_WIDTH;
+    size_t consumed;
+    char *line;
+
+    if (quadlet_count < 2)
+        return;
+
+    company_id = (quadlet[0] & 0xffffff00) >> 8;
+    device_id = ((((uint64_t)quadlet[0]) & 0x000000ff) << 32) | quadlet[1];
+    eui64 = (((uint64_t)quadlet[0]) << 32) | quadlet[1];
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset, quadlet[0], true);
+    snprintf(line + consumed, length - consumed, "company_id %06x     | ", company_id);
+
+    line = append_line(text);
+    consumed = format_line_prefix(line, length, offset + 4, quadlet[1], true);
+    snprintf(line + consumed, length - consumed, "device_id %010" PRIu64 "  | EUI-64 %016" PRIu64, device_id,
+             eui64);
+}
+
+static void format_unspecified_leaf_content(struct text_buffer *text, size_t offset,
+                                            const uint32_t *quadlet, size_t quadlet_count,
+                                            const char *spec_name)
+{
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i)
+        format_line_prefix(append_line(text), LINE_WIDTH, offset + i * 4, quadlet[i], false);
+}
+
+static const struct key_formatter csr_key_formatters[] = {
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_DESCRIPTOR,
+        CSR_DESCRIPTOR_NAME,
+        .format_content.leaf = format_csr_descriptor_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_DESCRIPTOR,
+        CSR_DESCRIPTOR_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_BUS_DEP_INFO,
+        CSR_BUS_DEP_INFO_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_BUS_DEP_INFO,
+        CSR_BUS_DEP_INFO_NAME,
+        .format_content.leaf = format_unspecified_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_BUS_DEP_INFO,
+        CSR_BUS_DEP_INFO_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_VENDOR_INFO,
+        CSR_VENDOR_INFO_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_VENDOR_INFO,
+        CSR_VENDOR_INFO_NAME,
+        .format_content.leaf = format_unspecified_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_VENDOR_INFO,
+        CSR_VENDOR_INFO_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_HARDWARE_VERSION,
+        CSR_HARDWARE_VERSION_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_MODULE_INFO,
+        CSR_MODULE_INFO_NAME,
+        .format_content.leaf = format_csr_eui64_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_MODULE_INFO,
+        CSR_MODULE_INFO_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_EUI_64,
+        CSR_EUI_64_NAME,
+        .format_content.leaf = format_csr_eui64_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_UNIT,
+        CSR_UNIT_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_SPECIFIER_ID,
+        CSR_SPECIFIER_ID_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_VERSION,
+        CSR_VERSION_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_DEP_INFO,
+        CSR_DEP_INFO_NAME,
+    },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_CSR_DEP_INFO,
+        CSR_DEP_INFO_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_DEP_INFO,
+        CSR_DEP_INFO_NAME,
+        .format_content.leaf = format_unspecified_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_DEP_INFO,
+        CSR_DEP_INFO_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_UNIT_LOCATION,
+        CSR_UNIT_LOCATION_NAME,
+        .format_content.leaf = format_csr_unit_location_leaf_content,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_MODEL,
+        CSR_MODEL_NAME,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_INSTANCE,
+        CSR_INSTANCE_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_CSR_KEYWORD,
+        CSR_KEYWORD_NAME,
+        .format_content.leaf = format_csr_keyword_leaf_content,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_CSR_FEATURE,
+        CSR_FEATURE_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_DIRECTORY_ID,
+        CSR_DIRECTORY_ID_NAME,
+    },
+};
+
+////////////////////////////////////////////////
+// Directory entries specific to IEEE 1394 bus.
+////////////////////////////////////////////////
+
+static size_t format_ieee1394_bus_node_capabilities_immediate_value(char *buf, size_t length,
+                                                                    uint32_t value)
+{
+    return snprintf(buf, length, "per IEEE 1394");
+}
+
+static const struct key_formatter ieee1394_bus_key_formatters[] = {
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_CSR_NODE_CAPS,
+        CSR_NODE_CAPS_NAME,
+        .format_content.immediate = format_ieee1394_bus_node_capabilities_immediate_value,
+    },
+};
+
+//////////////////////////////////////
+// Directory entries specific to SBP.
+//////////////////////////////////////
+
+#define KEY_ID_SBP2_UNIT_UNIQUE_ID        0x0d // For leaf.
+#define KEY_ID_SBP2_LOGICAL_UNIT_NUMBER   0x14 // For immediate.
+#define KEY_ID_SBP2_MANAGEMENT_AGENT      0x14 // For CSR offset.
+#define KEY_ID_SBP2_LOGICAL_UNIT          0x14 // For directory.
+#define KEY_ID_SBP3_REVISION              0x21 // For immediate.
+#define KEY_ID_SBP3_PLUG_CONTROL_REGISTER 0x32 // For immediate.
+#define KEY_ID_SBP2_COMMAND_SET_SPEC_ID   0x38 // For immediate.
+#define KEY_ID_SBP2_COMMAND_SET           0x39 // For immediate.
+#define KEY_ID_SBP2_UNIT_CHARACTERISTIC   0x3a // For immediate.
+#define KEY_ID_SBP2_COMMAND_SET_REVISION  0x3b // For immediate.
+#define KEY_ID_SBP2_FIRMWARE_REVISION     0x3c // For immediate.
+#define KEY_ID_SBP2_RECONNECT_TIMEOUT     0x3d // For immediate.
+#define KEY_ID_SBP3_FAST_START            0x3e // For immediate.
+
+#define SBP2_UNIT_UNIQUE_ID_NAME          "unit unique id"
+#define SBP2_LOGICAL_UNIT_NUMBER_NAME     "logical unit number"
+#define SBP2_MANAGEMENT_AGENT_NAME        "management agent CSR"
+#define SBP2_LOGICAL_UNIT_NAME            "logical unit"
+#define SBP3_REVISION_NAME                "revision"
+#define SBP3_PLUG_CONTROL_REGISTER_NAME   "plug control register"
+#define SBP2_COMMAND_SET_SPEC_ID_NAME     "command set spec id"
+#define SBP2_COMMAND_SET_NAME             "command set"
+#define SBP2_UNIT_CHARACTERISTIC_NAME     "unit char."
+#define SBP2_COMMAND_SET_REVISION_NAME    "command set revision"
+#define SBP2_FIRMWARE_REVISION_NAME       "firmware revision"
+#define SBP2_RECONNECT_TIMEOUT_NAME       "reconnect timeout"
+#define SBP3_FAST_START_NAME              "fast start"
+
+static size_t format_sbp_logical_unit_number_immediate_value(char *buf, size_t length,
+                                                             uint32_t value)
+{
+    static const char *const device_types[] = {
+        [0x00] = "Disk",    [0x01] = "Tape",      [0x02] = "Printer",  [0x03] = "Processor",
+        [0x04] = "WORM",    [0x05] = "CD/DVD",    [0x06] = "Scanner",  [0x07] = "MOD",
+        [0x08] = "Changer", [0x09] = "Comm",      [0x0a] = "Prepress", [0x0b] = "Prepress",
+        [0x0c] = "RAID",    [0x0d] = "Enclosure", [0x0e] = "RBC",      [0x0f] = "OCRW",
+        [0x10] = "Bridge",  [0x11] = "OSD",       [0x12] = "ADC-2",
+    };
+    bool extended = (value & 0x800000) >> 23;
+    unsigned int ordered = (value & 0x400000) >> 22;
+    bool isoc = (value & 0x200000) >> 21;
+    unsigned int device_type = (value & 0x1f) >> 16;
+    unsigned int logical_unit = value & 0x00ffff;
+    size_t consumed = 0;
+
+    if (extended)
+        consumed += snprintf(buf + consumed, length - consumed, " extended_status 1,");
+
+    consumed += snprintf(buf + consumed, length - consumed, " ordered %d,", ordered);
+
+    if (isoc)
+        consumed += snprintf(buf + consumed, length - consumed, " isoch 1,");
+
+    if (device_type < CONST_ARRAY_SIZE(device_types)) {
+        consumed +=
+            snprintf(buf + consumed, length - consumed, "type %s,", device_types[device_type]);
+    } else if (logical_unit == 0x1e) {
+        consumed += snprintf(buf + consumed, length - consumed, "type w.k.LUN,");
+    } else if (logical_unit == 0x1f) {
+        consumed += snprintf(buf + consumed, length - consumed, "type unknown,");
+    } else {
+        consumed += snprintf(buf + consumed, length - consumed, "type %02x?,", device_type);
+    }
+
+    return consumed;
+}
+
+static size_t format_sbp3_revision_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    size_t consumed = snprintf(buf, length, "%d", value);
+
+    switch (value) {
+    case 0:
+        consumed += snprintf(buf + consumed, length - consumed, " = SBP-2");
+        break;
+    case 1:
+        consumed += snprintf(buf + consumed, length - consumed, " = SBP-3");
+        break;
+    default:
+        break;
+    }
+
+    return consumed;
+}
+
+static size_t format_sbp3_plug_control_register_immediate_value(char *buf, size_t length,
+                                                                uint32_t value)
+{
+    bool is_output = (value & 0x20) >> 5;
+    unsigned int plug_index = value & 0x1f;
+
+    return snprintf(buf, length, "plug control register: %sPCR, plug_index %d",
+                    is_output ? "o" : "i", plug_index);
+}
+
+static size_t format_sbp_command_set_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    if (value == 0x0104d8)
+        return snprintf(buf, length, "SCSI Primary Commands 2 and related standards");
+    else if (value == 0x010001)
+        return snprintf(buf, length, "AV/C");
+    else
+        return 0;
+}
+
+static size_t format_sbp_unit_characteristic_immediate_value(char *buf, size_t length,
+                                                             uint32_t value)
+{
+    bool distributed_data = (value & 0x010000) >> 16; // Extended by SBP-3.
+    float mgt_orb_timeout_sec = 0.5 * ((value & 0x00ff00) >> 8);
+    unsigned int orb_size = value & 0x0000ff;
+    size_t consumed = 0;
+
+    if (distributed_data)
+        consumed += snprintf(buf + consumed, length - consumed, "distrib. data 1, ");
+
+    consumed += snprintf(buf + consumed, length - consumed,
+                         "mgt_ORB_timeout %gs, ORB_size %d quadlets", mgt_orb_timeout_sec,
+                         orb_size);
+
+    return consumed;
+}
+
+static size_t format_sbp_firmware_revision_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    return snprintf(buf, length, "%06x", value);
+}
+
+static size_t format_sbp_reconnect_timeout_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    unsigned int max_reconnect_hold = 1 + (value & 0x00ffff);
+
+    return snprintf(buf, length, "reconnect timeout: max_reconnect_hold %ds", max_reconnect_hold);
+}
+
+static size_t format_sbp3_fast_start_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    unsigned int max_payload = (value & 0x00ff00) >> 8;
+    unsigned int fast_start_offset = value & 0x0000ff;
+    size_t consumed = 0;
+
+    if (max_payload > 0) {
+        unsigned int max_payload_bytes = max_payload << 2;
+
+        consumed += snprintf(buf + consumed, length - consumed, " max_payload %d bytes,",
+                             max_payload_bytes);
+    } else {
+        consumed += snprintf(buf + consumed, length - consumed, " max_payload per max_rec,");
+    }
+
+    consumed += snprintf(buf + consumed, length - consumed, " offset %d", fast_start_offset);
+
+    return consumed;
+}
+
+static const struct key_formatter incits_sbp_key_formatters[] = {
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_SBP2_UNIT_UNIQUE_ID,
+        SBP2_UNIT_UNIQUE_ID_NAME,
+        .format_content.leaf = format_csr_eui64_leaf_content,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_LOGICAL_UNIT_NUMBER,
+        SBP2_LOGICAL_UNIT_NUMBER_NAME,
+        .format_content.immediate = format_sbp_logical_unit_number_immediate_value,
+    },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_SBP2_MANAGEMENT_AGENT,
+        SBP2_MANAGEMENT_AGENT_NAME,
+    },
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_SBP2_LOGICAL_UNIT,
+        SBP2_LOGICAL_UNIT_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP3_REVISION,
+        SBP3_REVISION_NAME,
+        .format_content.immediate = format_sbp3_revision_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP3_PLUG_CONTROL_REGISTER,
+        SBP3_PLUG_CONTROL_REGISTER_NAME,
+        .format_content.immediate = format_sbp3_plug_control_register_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_COMMAND_SET_SPEC_ID,
+        SBP2_COMMAND_SET_SPEC_ID_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_COMMAND_SET,
+        SBP2_COMMAND_SET_NAME,
+        .format_content.immediate = format_sbp_command_set_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_UNIT_CHARACTERISTIC,
+        SBP2_UNIT_CHARACTERISTIC_NAME,
+        .format_content.immediate = format_sbp_unit_characteristic_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_COMMAND_SET_REVISION,
+        SBP2_COMMAND_SET_REVISION_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_FIRMWARE_REVISION,
+        SBP2_FIRMWARE_REVISION_NAME,
+        .format_content.immediate = format_sbp_firmware_revision_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP2_RECONNECT_TIMEOUT,
+        SBP2_RECONNECT_TIMEOUT_NAME,
+        .format_content.immediate = format_sbp_reconnect_timeout_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_SBP3_FAST_START,
+        SBP3_FAST_START_NAME,
+        .format_content.immediate = format_sbp3_fast_start_immediate_value,
+    },
+};
+
+///////////////////////////////////////
+// Directory entries specific to IIDC.
+///////////////////////////////////////
+
+#define KEY_ID_IIDC_CMD_REG_BASE             0x00 // For immediate.
+#define KEY_ID_IIDC_VENDOR_NAME              0x01 // For leaf.
+#define KEY_ID_IIDC_MODEL_NAME               0x02 // For leaf.
+
+#define IIDC_CMD_REG_BASE_NAME               "command_regs_base"
+#define IIDC_VENDOR_NAME                     "vendor name"
+#define IIDC_MODEL_NAME                      "model name"
+
+#define KEY_ID_IIDC_131_UNIT_SUB_SW_VERSION  0x38 // For immediate.
+#define KEY_ID_IIDC_131_RESERVED_0           0x39 // For immediate.
+#define KEY_ID_IIDC_131_RESERVED_1           0x3a // For immediate.
+#define KEY_ID_IIDC_131_RESERVED_2           0x3b // For immediate.
+#define KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_0 0x3c // For immediate.
+#define KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_1 0x3d // For immediate.
+#define KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_2 0x3e // For immediate.
+#define KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_3 0x3f // For immediate.
+
+#define IIDC_131_UNIT_SUB_SW_VERSION_NAME    "unit sub sw version"
+#define IIDC_131_RESERVED_NAME               "(reserved)"
+#define IIDC_131_VENDOR_UNIQUE_INFO_0_NAME   "vendor_unique_info_0"
+#define IIDC_131_VENDOR_UNIQUE_INFO_1_NAME   "vendor_unique_info_1"
+#define IIDC_131_VENDOR_UNIQUE_INFO_2_NAME   "vendor_unique_info_2"
+#define IIDC_131_VENDOR_UNIQUE_INFO_3_NAME   "vendor_unique_info_3"
+
+#define IIDC2_CMD_REG_BASE_NAME              "IIDC2Entry"
+
+static size_t format_iidc_131_unit_sub_sw_version_immediate_value(char *buf, size_t length,
+                                                                  uint32_t value)
+{
+    return snprintf(buf, length, "v1.3%d", value >> 4);
+}
+
+static size_t format_iidc2_100_unit_sub_sw_version_immediate_value(char *buf, size_t length,
+                                                                   uint32_t value)
+{
+    unsigned int major = value >> 16;
+    unsigned int minor = (value >> 8) & 0xff;
+    unsigned int micro = value & 0xff;
+
+    return snprintf(buf, length, "v%d.%d.%d", major, minor, micro);
+}
+
+static void format_iidc_104_leaf_content(struct text_buffer *text, size_t offset,
+                                         const uint32_t *quadlet, size_t quadlet_count,
+                                         const char *spec_name)
+{
+    size_t length = LINE_WIDTH;
+    int i;
+
+    for (i = 0; i < 2 && i < quadlet_count; ++i)
+        format_line_prefix(append_line(text), length, offset + i * 4, quadlet[i], false);
+
+    for (; i < quadlet_count; ++i) {
+        char *line = append_line(text);
+        size_t consumed;
+        int j;
+
+        consumed = format_line_prefix(line, length, offset + i * 4, quadlet[i], true);
+        if (quadlet[i] > 0) {
+            consumed += snprintf(line + consumed, length - consumed, "\"");
+
+            for (j = 0; j < 4; ++j) {
+                size_t shift = 24 - j * 8;
+                uint8_t letter = (quadlet[i] >> shift) & 0xff;
+                if (letter != '\0')
+                    consumed += snprintf(line + consumed, length - consumed, "%c", letter);
+            }
+
+            snprintf(line + consumed, length - consumed, "\"");
+        }
+    }
+}
+
+static const struct key_formatter ta1394_iidc_104_key_formatters[] = {
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IIDC_CMD_REG_BASE,
+        IIDC_CMD_REG_BASE_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_VENDOR_NAME,
+        IIDC_VENDOR_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_MODEL_NAME,
+        IIDC_MODEL_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+};
+
+static const struct key_formatter ta1394_iidc_131_key_formatters[] = {
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IIDC_CMD_REG_BASE,
+        IIDC_CMD_REG_BASE_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_VENDOR_NAME,
+        IIDC_VENDOR_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_MODEL_NAME,
+        IIDC_MODEL_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_UNIT_SUB_SW_VERSION,
+        IIDC_131_UNIT_SUB_SW_VERSION_NAME,
+        .format_content.immediate = format_iidc_131_unit_sub_sw_version_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_0,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_1,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_2,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_0,
+        IIDC_131_VENDOR_UNIQUE_INFO_0_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_1,
+        IIDC_131_VENDOR_UNIQUE_INFO_1_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_2,
+        IIDC_131_VENDOR_UNIQUE_INFO_2_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_3,
+        IIDC_131_VENDOR_UNIQUE_INFO_3_NAME,
+    },
+};
+
+static const struct key_formatter ta1394_iidc2_100_key_formatters[] = {
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IIDC_CMD_REG_BASE,
+        IIDC2_CMD_REG_BASE_NAME,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_VENDOR_NAME,
+        IIDC_VENDOR_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+    {
+        KEY_TYPE_LEAF,
+        KEY_ID_IIDC_MODEL_NAME,
+        IIDC_MODEL_NAME,
+        .format_content.leaf = format_iidc_104_leaf_content,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_UNIT_SUB_SW_VERSION,
+        IIDC_131_UNIT_SUB_SW_VERSION_NAME,
+        .format_content.immediate = format_iidc2_100_unit_sub_sw_version_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_0,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_1,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_RESERVED_2,
+        IIDC_131_RESERVED_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_0,
+        IIDC_131_VENDOR_UNIQUE_INFO_0_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_1,
+        IIDC_131_VENDOR_UNIQUE_INFO_1_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_2,
+        IIDC_131_VENDOR_UNIQUE_INFO_2_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IIDC_131_VENDOR_UNIQUE_INFO_3,
+        IIDC_131_VENDOR_UNIQUE_INFO_3_NAME,
+    },
+};
+
+//////////////////////////////////////
+// Directory entries specific to DPP.
+//////////////////////////////////////
+
+#define KEY_ID_DPP_111_COMMAND_SET_DIRECTORY      0x14 // Just for directory.
+#define KEY_ID_DPP_111_COMMAND_SET_SPEC_ID        0x38 // Just for immediate.
+#define KEY_ID_DPP_111_COMMAND_SET                0x39 // Just for immediate.
+#define KEY_ID_DPP_111_COMMAND_SET_DETAILS        0x3a // Just for immediate.
+#define KEY_ID_DPP_111_CONNECTION_REGISTER        0x3b // Just for CSR offset.
+#define KEY_ID_DPP_111_WRITE_TRANSACTION_INTERVAL 0x3c // Just for immediate.
+#define KEY_ID_DPP_111_UNIT_SW_DETAILS            0x3d // Just for immediate.
+
+#define DPP_111_COMMAND_SET_DIRECTORY_NAME        "command set directory"
+#define DPP_111_COMMAND_SET_SPEC_ID_NAME          "command set spec id"
+#define DPP_111_COMMAND_SET_NAME                  "command set"
+#define DPP_111_COMMAND_SET_DETAILS_NAME          "command set details"
+#define DPP_111_CONNECTION_REGISTER_NAME          "connection CSR"
+#define DPP_111_WRITE_TRANSACTION_INTERVAL_NAME   "write transaction interval"
+#define DPP_111_UNIT_SW_DETAILS_NAME              "unit sw details"
+
+static size_t format_dpp_111_command_set_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    switch (value) {
+    case 0xb081f2:
+        return snprintf(buf, length, "DPC");
+    case 0x020000:
+        return snprintf(buf, length, "FTC");
+    default:
+        return 0;
+    }
+}
+
+static size_t format_dpp_111_write_transaction_interval_immediate_value(char *buf, size_t length,
+                                                                        uint32_t value)
+{
+    return snprintf(buf, length, "%dms", value);
+}
+
+static size_t format_dpp_111_unit_sw_details_immediate_value(char *buf, size_t length,
+                                                             uint32_t value)
+{
+    unsigned int major = (value & 0x00f00000) >> 20;
+    unsigned int minor = (value & 0x000f0000) >> 16;
+    unsigned int micro = (value & 0x0000f000) >> 12;
+    bool sdu_write_order = value & 1;
+
+    return snprintf(buf, length, "v%d.%d.%d, sdu_write_order %d", major, minor, micro,
+                    sdu_write_order);
+}
+
+static const struct key_formatter ta1394_dpp_111_key_formatters[] = {
+    {
+        KEY_TYPE_DIRECTORY,
+        KEY_ID_DPP_111_COMMAND_SET_DIRECTORY,
+        DPP_111_COMMAND_SET_DIRECTORY_NAME,
+        .format_content.directory = format_directory_entries,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_DPP_111_COMMAND_SET_SPEC_ID,
+        DPP_111_COMMAND_SET_SPEC_ID_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_DPP_111_COMMAND_SET,
+        DPP_111_COMMAND_SET_NAME,
+        .format_content.immediate = format_dpp_111_command_set_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_DPP_111_COMMAND_SET_DETAILS,
+        DPP_111_COMMAND_SET_DETAILS_NAME,
+    },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_DPP_111_CONNECTION_REGISTER,
+        DPP_111_CONNECTION_REGISTER_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_DPP_111_WRITE_TRANSACTION_INTERVAL,
+        DPP_111_WRITE_TRANSACTION_INTERVAL_NAME,
+        .format_content.immediate = format_dpp_111_write_transaction_interval_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_DPP_111_UNIT_SW_DETAILS,
+        DPP_111_UNIT_SW_DETAILS_NAME,
+        .format_content.immediate = format_dpp_111_unit_sw_details_immediate_value,
+    },
+};
+
+///////////////////////////////////////
+// Directory entries specific to IICP.
+///////////////////////////////////////
+
+#define KEY_ID_IICP_DETAILS                     0x38 // For immediate.
+#define KEY_ID_IICP_COMMAND_SET_SPEC_ID         0x39 // For immediate.
+#define KEY_ID_IICP_COMMAND_SET                 0x3a // For immediate.
+#define KEY_ID_IICP_COMMAND_SET_DETAILS         0x3b // For immediate.
+#define KEY_ID_IICP_CONNECTION_REG_OFFSET       0x3c // For CSR offset.
+#define KEY_ID_IICP_CAPABILITIES                0x3d // For immediate.
+#define KEY_ID_IICP_INTERRUPT_ENABLE_REG_OFFSET 0x3e // For CSR offset.
+#define KEY_ID_IICP_INTERRUPT_HANDR_REG_OFFSET  0x3f // For CSR offset.
+
+#define IICP_DETAILS_NAME                       "details"
+#define IICP_COMMAND_SET_SPEC_ID_NAME           "command set spec id"
+#define IICP_COMMAND_SET_NAME                   "command set"
+#define IICP_COMMAND_SET_DETAILS_NAME           "command set details"
+#define IICP_CONNECTION_REG_OFFSET_NAME         "connection CSR"
+#define IICP_CAPABILITIES_NAME                  "capabilities"
+#define IICP_INTERRUPT_ENABLE_REG_OFFSET_NAME   "interrupt_enable CSR"
+#define IICP_INTERRUPT_HANDR_REG_OFFSET_NAME    "interrupt_handlr CSR"
+
+static size_t format_iicp_details_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    unsigned int major =
+        (((value & 0xf00000) >> 20) & 0xf) * 10 + (((value & 0x0f0000) >> 16) & 0xf);
+    unsigned int minor =
+        (((value & 0x00f000) >> 12) & 0xf) * 10 + (((value & 0x000f00) >> 8) & 0xf);
+
+    return snprintf(buf, length, "v%d.%d", major, minor);
+}
+
+static size_t format_iicp_command_set_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    switch (value) {
+    case 0x4b661f:
+        return snprintf(buf, length, "IICP only");
+    case 0xc27f10:
+        return snprintf(buf, length, "IICP488");
+    default:
+        return 0;
+    }
+}
+
+static size_t format_iicp_command_set_details_immediate_value(char *buf, size_t length,
+                                                              uint32_t value)
+{
+    unsigned int major =
+        (((value & 0xf00000) >> 20) & 0xf) * 10 + (((value & 0x0f0000) >> 16) & 0xf);
+    unsigned int minor =
+        (((value & 0x00f000) >> 12) & 0xf) * 10 + (((value & 0x000f00) >> 8) & 0xf);
+
+    return snprintf(buf, length, "v%d.%d", major, minor);
+}
+
+static size_t format_iicp_capabilities_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    unsigned int reserved_high_proto = (value & 0xff0000) >> 16;
+    unsigned int reserved_iicp = (value & 0x00ffc0) >> 6;
+    unsigned int ccli = (value & 0x000020) >> 5;
+    unsigned int cmgr = (value & 0x000010) >> 4;
+    unsigned int max_int_length_exponent = (value & 0x00000f);
+    size_t consumed = 0;
+
+    consumed += snprintf(buf, length, "hi proto %d, IICP %d, ccli %d, cmgr %d", reserved_high_proto,
+                         reserved_iicp, ccli, cmgr);
+
+    if (max_int_length_exponent > 0) {
+        unsigned int max_int_bytes = 2 << max_int_length_exponent;
+
+        consumed +=
+            snprintf(buf + consumed, length - consumed, "  maxIntLength %d bytes", max_int_bytes);
+    } else {
+        consumed += snprintf(buf + consumed, length - consumed, "  maxIntLength -");
+    }
+
+    return consumed;
+}
+
+static const struct key_formatter ta1394_iicp_key_formatters[] = {
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IICP_DETAILS,
+        IICP_DETAILS_NAME,
+        .format_content.immediate = format_iicp_details_immediate_value,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IICP_COMMAND_SET_SPEC_ID,
+        IICP_COMMAND_SET_SPEC_ID_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IICP_COMMAND_SET,
+        IICP_COMMAND_SET_NAME,
+        .format_content.immediate = format_iicp_command_set_immediate_value,
+    },
+    { KEY_TYPE_IMMEDIATE, KEY_ID_IICP_COMMAND_SET_DETAILS, IICP_COMMAND_SET_DETAILS_NAME,
+      .format_content.immediate = format_iicp_command_set_details_immediate_value },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IICP_CONNECTION_REG_OFFSET,
+        IICP_CONNECTION_REG_OFFSET_NAME,
+    },
+    {
+        KEY_TYPE_IMMEDIATE,
+        KEY_ID_IICP_CAPABILITIES,
+        IICP_CAPABILITIES_NAME,
+        .format_content.immediate = format_iicp_capabilities_immediate_value,
+    },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IICP_INTERRUPT_ENABLE_REG_OFFSET,
+        IICP_INTERRUPT_ENABLE_REG_OFFSET_NAME,
+    },
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_IICP_INTERRUPT_HANDR_REG_OFFSET,
+        IICP_INTERRUPT_HANDR_REG_OFFSET_NAME,
+    }
+};
+
+#define KEY_ID_APPLE_ISIGHT_AUDIO_REG 0x00 // For CSR offset.
+
+#define APPLE_ISIGHT_AUDIO_REG_NAME   "register file"
+
+static const struct key_formatter apple_isight_audio_key_formatters[] = {
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_APPLE_ISIGHT_AUDIO_REG,
+        APPLE_ISIGHT_AUDIO_REG_NAME,
+    },
+};
+
+#define KEY_ID_APPLE_ISIGHT_IRIS_REG 0x00 // For CSR offset.
+
+#define APPLE_ISIGHT_IRIS_REG_NAME   "Iris Status Address register"
+
+static const struct key_formatter apple_isight_iris_key_formatters[] = {
+    {
+        KEY_TYPE_CSR_OFFSET,
+        KEY_ID_APPLE_ISIGHT_IRIS_REG,
+        APPLE_ISIGHT_IRIS_REG_NAME,
+    },
+};
+
+static size_t format_unspecified_immediate_value(char *buf, size_t length, uint32_t value)
+{
+    return snprintf(buf, length, "(immediate value)");
+}
+
+static const struct key_formatter *find_formatter(const struct key_formatter *formatters,
+                                                  size_t formatter_count, uint32_t key_type,
+                                                  uint32_t key_id)
+{
+    int i;
+
+    for (i = 0; i < formatter_count; ++i) {
+        const struct key_formatter *formatter = formatters + i;
+        if (formatter->key_type == key_type && formatter->key_id == key_id)
+            return formatter;
+    }
+
+    return NULL;
+}
+
+struct spec_entry {
+    const char *spec_name;
+    const struct spec_identifier *identifier;
+    const struct key_formatter *formatters;
+    size_t formatter_count;
+};
+
+static const struct spec_entry spec_entries[] = {
+    {
+        SPEC_NAME_RFC_2734,
+        &spec_iana_ipv4,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_RFC_3146,
+        &spec_iana_ipv6,
+        NULL,
+        0,
+    },
+    // NOTE: both SBP-2 and -3 use the same identifiers.
+    {
+        SPEC_NAME_SBP,
+        &spec_incits_sbp,
+        incits_sbp_key_formatters,
+        CONST_ARRAY_SIZE(incits_sbp_key_formatters),
+    },
+    {
+        SPEC_NAME_SBP_AVC,
+        &spec_incits_sbp_avc,
+        incits_sbp_key_formatters,
+        CONST_ARRAY_SIZE(incits_sbp_key_formatters),
+    },
+    {
+        SPEC_NAME_AVC,
+        &spec_1394ta_avc,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_CAL,
+        &spec_1394ta_cal,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_EHS,
+        &spec_1394ta_ehs,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_HAVI,
+        &spec_1394ta_havi,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_VENDOR_UNIQUE,
+        &spec_1394ta_vendor_unique,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_VENDOR_UNIQUE_AVC,
+        &spec_1394ta_vendor_unique_avc,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_IIDC_104,
+        &spec_1394ta_iidc_104,
+        ta1394_iidc_104_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_iidc_104_key_formatters),
+    },
+    {
+        SPEC_NAME_IIDC_120,
+        &spec_1394ta_iidc_120,
+        ta1394_iidc_104_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_iidc_104_key_formatters),
+    },
+    {
+        SPEC_NAME_IIDC_130,
+        &spec_1394ta_iidc_130,
+        ta1394_iidc_131_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_iidc_131_key_formatters),
+    },
+    {
+        SPEC_NAME_IIDC2,
+        &spec_1394ta_iidc2,
+        ta1394_iidc2_100_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_iidc2_100_key_formatters),
+    },
+    {
+        SPEC_NAME_DPP_111,
+        &spec_1394ta_dpp_111,
+        ta1394_dpp_111_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_dpp_111_key_formatters),
+    },
+    {
+        SPEC_NAME_IICP,
+        &spec_1394ta_iicp,
+        ta1394_iicp_key_formatters,
+        CONST_ARRAY_SIZE(ta1394_iicp_key_formatters),
+    },
+    {
+        SPEC_NAME_ALESIS_AUDIO,
+        &spec_alesis_audio,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_ISIGHT_AUDIO,
+        &spec_apple_isight_audio,
+        apple_isight_audio_key_formatters,
+        CONST_ARRAY_SIZE(apple_isight_audio_key_formatters),
+    },
+    {
+        SPEC_NAME_ISIGHT_FACTORY,
+        &spec_apple_isight_factory,
+        NULL,
+        0,
+    },
+    {
+        SPEC_NAME_ISIGHT_IRIS,
+        &spec_apple_isight_iris,
+        apple_isight_iris_key_formatters,
+        CONST_ARRAY_SIZE(apple_isight_iris_key_formatters),
+    },
+    {
+        SPEC_NAME_LACIE_HID,
+        &spec_lacie_hid,
+        NULL,
+        0,
+    },
+};
+
+static const struct key_formatter default_formatters[] = {
+    [KEY_TYPE_IMMEDIATE] =
+        {
+            KEY_TYPE_IMMEDIATE,
+            INVALID_KEY_ID,
+            UNSPECIFIED_ENTRY_NAME,
+            .format_content.immediate = format_unspecified_immediate_value,
+        },
+    [KEY_TYPE_CSR_OFFSET] =
+        {
+            KEY_TYPE_CSR_OFFSET,
+            INVALID_KEY_ID,
+            UNSPECIFIED_ENTRY_NAME,
+        },
+    [KEY_TYPE_LEAF] =
+        {
+            KEY_TYPE_LEAF,
+            INVALID_KEY_ID,
+            UNSPECIFIED_ENTRY_NAME,
+            .format_content.leaf = format_unspecified_leaf_content,
+        },
+    [KEY_TYPE_DIRECTORY] =
+        {
+            KEY_TYPE_DIRECTORY,
+            INVALID_KEY_ID,
+            UNSPECIFIED_ENTRY_NAME,
+            .format_content.directory = format_directory_entries,
+        },
+};
+
+// Key type has 2 bits and key id has 6 bits, thus any formatter is indexed by 8 bits.
+#define KEY_FORMATTER_INDEX_COUNT       256
+#define KEY_FORMATTER_INDEX(type, id)   (((type) << 6) | (id))
+
+// The tables below are built once at startup by init_key_formatters() so that the cost to look up
+// formatter for each directory entry does not depend on the number of specifications and entries.
+static const struct spec_entry *sorted_spec_entries[CONST_ARRAY_SIZE(spec_entries)];
+static size_t sorted_spec_entry_count;
+static const struct key_formatter
+    *spec_key_formatters[CONST_ARRAY_SIZE(spec_entries)][KEY_FORMATTER_INDEX_COUNT];
+static const struct key_formatter *generic_key_formatters[KEY_FORMATTER_INDEX_COUNT];
+
+static int compare_spec_identifier(const struct spec_identifier *lhs,
+                                   const struct spec_identifier *rhs)
+{
+    if (lhs->specifier_id != rhs->specifier_id)
+        return lhs->specifier_id < rhs->specifier_id ? -1 : 1;
+    if (lhs->version != rhs->version)
+        return lhs->version < rhs->version ? -1 : 1;
+    return 0;
+}
+
+static int compare_spec_entry(const void *lhs, const void *rhs)
+{
+    const struct spec_entry *l = *(const struct spec_entry *const *)lhs;
+    const struct spec_entry *r = *(const struct spec_entry *const *)rhs;
+    int result = compare_spec_identifier(l->identifier, r->identifier);
+
+    // Keep the order in the table for the same identifiers.
+    if (result == 0 && l != r)
+        result = l < r ? -1 : 1;
+
+    return result;
+}
+
+static int search_spec_entry(const void *key, const void *entry)
+{
+    return compare_spec_identifier(key, (*(const struct spec_entry *const *)entry)->identifier);
+}
+
+static void init_key_formatters(void)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < CONST_ARRAY_SIZE(spec_entries); ++i) {
+        const struct spec_entry *spec_entry = spec_entries + i;
+
+        sorted_spec_entries[i] = spec_entry;
+
+        // The former entry takes precedence over the latter for the same key.
+        for (j = spec_entry->formatter_count; j > 0; --j) {
+            const struct key_formatter *formatter = spec_entry->formatters + j - 1;
+
+            if (formatter->key_id < 64)
+                spec_key_formatters[i][KEY_FORMATTER_INDEX(formatter->key_type,
+                                                           formatter->key_id)] = formatter;
+        }
+    }
+
+    qsort(sorted_spec_entries, CONST_ARRAY_SIZE(spec_entries), sizeof(*sorted_spec_entries),
+          compare_spec_entry);
+
+    // Drop duplicated identifiers except for the first one in the table.
+    sorted_spec_entry_count = 0;
+    for (i = 0; i < CONST_ARRAY_SIZE(spec_entries); ++i) {
+        if (sorted_spec_entry_count > 0 &&
+            !compare_spec_identifier(sorted_spec_entries[sorted_spec_entry_count - 1]->identifier,
+                                     sorted_spec_entries[i]->identifier))
+            continue;
+        sorted_spec_entries[sorted_spec_entry_count++] = sorted_spec_entries[i];
+    }
+
+    for (i = 0; i < KEY_FORMATTER_INDEX_COUNT; ++i) {
+        uint32_t key_type = i >> 6;
+        uint32_t key_id = i & 0x3f;
+        const struct key_formatter *formatter;
+
+        formatter = find_formatter(ieee1394_bus_key_formatters,
+                                   CONST_ARRAY_SIZE(ieee1394_bus_key_formatters), key_type, key_id);
+        if (formatter == NULL)
+            formatter = find_formatter(csr_key_formatters, CONST_ARRAY_SIZE(csr_key_formatters),
+                                       key_type, key_id);
+        if (formatter == NULL)
+            formatter = &default_formatters[key_type];
+
+        generic_key_formatters[i] = formatter;
+    }
+}
+
+static void detect_key_formatter(const struct key_formatter **formatter, const char **spec_name,
+                                 const struct spec_identifier *identifier, uint32_t key_type,
+                                 uint32_t key_id)
+{
+    const struct spec_entry *const *spec_entry;
+    size_t index;
+
+    if (key_id >= 64) {
+        *formatter = &default_formatters[key_type];
+        return;
+    }
+    index = KEY_FORMATTER_INDEX(key_type, key_id);
+
+    spec_entry = bsearch(identifier, sorted_spec_entries, sorted_spec_entry_count,
+                         sizeof(*sorted_spec_entries), search_spec_entry);
+    if (spec_entry != NULL) {
+        *formatter = spec_key_formatters[*spec_entry - spec_entries][index];
+        if (*formatter != NULL) {
+            *spec_name = (*spec_entry)->spec_name;
+            return;
+        }
+    }
+
+    *formatter = generic_key_formatters[index];
+}
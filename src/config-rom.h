@@ -0,0 +1,42 @@
+// config-rom.h - Decoder of content of configuration rom
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#ifndef CONFIG_ROM_H_INCLUDED
+#define CONFIG_ROM_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// The size of region for configuration rom is fixed in IEEE 1212.
+#define CONFIG_ROM_SIZE 1024
+
+// One of the output formats; text, json, or binary.
+struct config_rom_format;
+
+// Build the tables to look up formatters of directory entries. Call it once before decoding.
+void config_rom_init(void);
+
+// Return NULL for unknown name.
+const struct config_rom_format *config_rom_find_format(const char *name);
+
+int config_rom_emit_file_header(const struct config_rom_format *format, const char *path,
+                                FILE *output);
+
+// The content is in host byte order, as in sysfs and FW_CDEV_IOC_GET_INFO, or in big endian.
+int config_rom_decode(const uint8_t *data, ssize_t length, const struct config_rom_format *format,
+                      FILE *output);
+
+// Decode only the blocks which differ from the baseline kept for the GUID of the node in the
+// directory, then update the baseline. Nothing is written if the content is unchanged.
+int config_rom_decode_changes(const char *baseline_dir, const uint8_t *data, ssize_t length,
+                              const struct config_rom_format *format, FILE *output);
+
+// ITU-T CRC-16 of the quadlets in host byte order, as in the CRC field of blocks.
+uint16_t config_rom_compute_crc_16(const uint32_t *quadlets, size_t quadlet_count);
+
+// Return the number of blocks with mismatched CRC, or negative error code.
+int config_rom_verify(const char *path, const uint8_t *data, ssize_t length, FILE *output);
+
+#endif
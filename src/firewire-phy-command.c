@@ -12,18 +12,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
-#include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
 #include <getopt.h>
-#include <fcntl.h>
-#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <linux/firewire-cdev.h>
 #include <linux/firewire-constants.h>
+#include <asm/byteorder.h>
 
 #include "config.h"
+#include "fw-device.h"
+#include "fw-retry.h"
+#include "fw-stats.h"
 
 #ifndef FW_CDEV_IOC_SEND_PHY_PACKET
 #error kernel headers too old
@@ -33,149 +34,76 @@
 
 #define ptr_to_u64(p) ((uintptr_t)(p))
 
+#define TOPOLOGY_MAP_ADDR	0xfffff0001000uLL
+#define MAX_SELF_IDS		252
+
+#define PHY_TIMEOUT		100	/* ms, for the replies to all packets */
+
+#define PING_RING_SIZE		1024	/* samples per node for the percentiles */
+/*
+ * Each hop adds a repeater delay (PHY_DELAY, at most 144 ns) and a cable of
+ * up to 4.5 m (about 23 ns) to both the ping and the reply, in 24.576 MHz ticks.
+ */
+#define PING_HOP_TICKS		8
+
 typedef __u8 u8;
 typedef __u32 u32;
 typedef __u64 u64;
 
-struct node {
-	struct node *next;
-	char *name;
-	int fd;
-	u32 card;
-	u32 id;
-	u32 generation;
-	bool is_local;
-};
-
-static struct node *nodes;
-static struct node *local_node;
+static struct fw_device_index devices;
+static struct fw_device *local_node;
 static u32 param_node_id;
-static u32 ping_time;
-static u32 self_ids[3];
+static u32 param_node_ids[64];
+static unsigned int param_node_count;
+static unsigned int failures;
+static unsigned int ping_count = 1;
+static unsigned int ping_interval = 100;	/* ms */
 
 static void help(void)
 {
 	fputs("Usage: firewire-phy-command [options] command [parameters]\n"
 	      "Commands:\n"
 	      "  config [root <node>] [gapcount <value>]\n"
-	      "  ping <node>\n"
-	      "  read <node> [<page> <port>] <register>\n"
-	      "  nop|disable|suspend|clear|enable|resume <node> <port>\n"
+	      "  ping <nodes>\n"
+	      "  read <nodes> [<page> <port>] <register>\n"
+	      "  nop|disable|suspend|clear|enable|resume <nodes> <port>\n"
 	      "  resume\n"
 	      "  linkon <node>\n"
 	      "  reset\n"
+	      "  monitor\n"
+	      "  optimize-gap [dry-run]\n"
+	      "<nodes> is a comma-separated list of nodes, or all\n"
 	      "Options:\n"
-	      " -b, --bus=node  bus to send packet on\n"
-	      " -h, --help      show this message and exit\n"
-	      " -V, --version   show version number and exit\n"
+	      " -b, --bus=node       bus to send packet on\n"
+	      " -n, --count=n        ping n times and print statistics\n"
+	      " -i, --interval=ms    time between pings, default 100\n"
+	      "     --stats          print time spent in system calls at exit\n"
+	      " -h, --help           show this message and exit\n"
+	      " -V, --version        show version number and exit\n"
 	      "\n"
 	      "Report bugs to <" PACKAGE_BUGREPORT ">.\n"
 	      PACKAGE_NAME " home page: <" PACKAGE_URL ">.\n",
 	      stderr);
 }
 
-static int fw_filter(const struct dirent *dirent)
+static void probe_device(struct fw_device *device)
 {
-	unsigned int i;
-
-	if (dirent->d_name[0] != 'f' ||
-	    dirent->d_name[1] != 'w')
-		return false;
-	i = 2;
-	do {
-		if (!isdigit(dirent->d_name[i]))
-			return false;
-	} while (dirent->d_name[++i]);
-	return true;
-}
-
-static void open_all_nodes(void)
-{
-	struct dirent **ents;
-	int count, i;
-	struct node *node;
-	struct fw_cdev_get_info get_info;
-	struct fw_cdev_event_bus_reset bus_reset;
-	bool eacces = false;
-
-	count = scandir("/dev", &ents, fw_filter, versionsort);
-	if (count < 0) {
-		perror("cannot read /dev");
-		exit(EXIT_FAILURE);
-	}
-
-	for (i = count - 1; i >= 0; --i) {
-		node = malloc(sizeof(*node));
-		if (!node) {
-			fputs("out of memory\n", stderr);
-			exit(EXIT_FAILURE);
-		}
-
-		if (asprintf(&node->name, "/dev/%s", ents[i]->d_name) < 0) {
-			perror("asprintf failed");
-			exit(EXIT_FAILURE);
-		}
-		node->fd = open(node->name, O_RDWR);
-		if (node->fd == -1) {
-			if (errno == EACCES)
-				eacces = true;
-			free(node->name);
-			free(node);
-			continue;
-		}
-
-		get_info.version = 4;
-		get_info.rom_length = 0;
-		get_info.rom = 0;
-		get_info.bus_reset = ptr_to_u64(&bus_reset);
-		get_info.bus_reset_closure = 0;
-		if (ioctl(node->fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
-			close(node->fd);
-			free(node->name);
-			free(node);
-			continue;
-		}
-		node->card = get_info.card;
-		node->id = bus_reset.node_id;
-		node->generation = bus_reset.generation;
-		node->is_local = bus_reset.node_id == bus_reset.local_node_id;
-
-		node->next = nodes;
-		nodes = node;
-		free(ents[i]);
-	}
-	free(ents);
-
-	if (!nodes) {
-		if (eacces) {
-			errno = EACCES;
-			perror("/dev/fw*");
-		} else {
-			fputs("no fw devices found\n", stderr);
-		}
-		exit(EXIT_FAILURE);
-	}
-}
-
-static void close_all_nodes(void)
-{
-	struct node *node, *next;
-
-	for (node = nodes; node; node = next) {
-		close(node->fd);
-		free(node->name);
-		next = node->next;
-		free(node);
+	if (fw_device_probe(&devices, device))
+		return;
+	if (device->invalid) {
+		fprintf(stderr, "%s: not a fw device\n", device->name);
+	} else {
+		errno = device->error;
+		perror(device->name);
 	}
+	exit(EXIT_FAILURE);
 }
 
 static void find_local_node(const char *bus_name)
 {
 	int bus_card;
 	char *endptr;
-	int fd;
-	struct fw_cdev_get_info get_info;
-	struct node *node;
+	struct fw_device *device;
 
 	if (bus_name) {
 		bus_card = strtol(bus_name, &endptr, 0);
@@ -185,47 +113,28 @@ static void find_local_node(const char *bus_name)
 				exit(EXIT_FAILURE);
 			}
 		} else {
-			bus_card = -1;
-			for (node = nodes; node; node = node->next)
-				if (!strcmp(node->name, bus_name)) {
-					bus_card = node->card;
-					break;
-				}
-			if (bus_card < 0) {
-				fd = open(bus_name, O_RDWR);
-				if (fd == -1) {
-					perror(bus_name);
-					exit(EXIT_FAILURE);
-				}
-				get_info.version = 4;
-				get_info.rom_length = 0;
-				get_info.rom = 0;
-				get_info.bus_reset = 0;
-				get_info.bus_reset_closure = 0;
-				if (ioctl(fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
-					fprintf(stderr, "%s: not a fw device\n", bus_name);
-					exit(EXIT_FAILURE);
-				}
-				close(fd);
-				bus_card = get_info.card;
-			}
+			device = fw_device_get(&devices, bus_name);
+			probe_device(device);
+			bus_card = device->card;
 		}
 	} else {
 		bus_card = -1;
 	}
 
-	for (node = nodes; node; node = node->next) {
-		if (node->is_local &&
-		    (bus_card == -1 || node->card == bus_card)) {
-			local_node = node;
-			return;
-		}
-	}
+	local_node = fw_device_find_local(&devices, bus_card);
+	if (local_node)
+		return;
 
-	if (bus_card == -1)
+	if (devices.eacces) {
+		errno = EACCES;
+		perror("/dev/fw*");
+	} else if (devices.count == 0) {
+		fputs("no fw devices found\n", stderr);
+	} else if (bus_card == -1) {
 		fputs("local node not found\n", stderr);
-	else
+	} else {
 		fprintf(stderr, "local node for card %d not found\n", bus_card);
+	}
 	exit(EXIT_FAILURE);
 }
 
@@ -233,10 +142,7 @@ static void find_param_node(const char *name)
 {
 	int id;
 	char *endptr;
-	struct node *node;
-	int fd;
-	struct fw_cdev_get_info get_info;
-	struct fw_cdev_event_bus_reset bus_reset;
+	struct fw_device *device;
 	char card_str[16];
 
 	id = strtol(name, &endptr, 0);
@@ -249,107 +155,276 @@ static void find_param_node(const char *name)
 		return;
 	}
 
-	for (node = nodes; node; node = node->next)
-		if (!strcmp(node->name, name)) {
-			param_node_id = node->id & 0x3f;
-			sprintf(card_str, "%u", node->card);
-			find_local_node(card_str);
-			return;
+	device = fw_device_get(&devices, name);
+	probe_device(device);
+	param_node_id = device->node_id & 0x3f;
+	sprintf(card_str, "%u", device->card);
+	find_local_node(card_str);
+}
+
+/*
+ * Parses a comma-separated list of nodes, or "all" for all nodes on the bus
+ * except the local one.  Device files must all be on the same bus.
+ */
+static void find_param_nodes(const char *list)
+{
+	char *names, *name, *saveptr;
+	int card = -1;
+	unsigned int i, root_id;
+
+	param_node_count = 0;
+	if (!strcmp(list, "all")) {
+		root_id = local_node->bus_reset.root_node_id & 0x3f;
+		for (i = 0; i <= root_id; ++i)
+			if (i != (local_node->node_id & 0x3f))
+				param_node_ids[param_node_count++] = i;
+		if (!param_node_count) {
+			fputs("no other nodes on the bus\n", stderr);
+			exit(EXIT_FAILURE);
 		}
+		return;
+	}
 
-	fd = open(name, O_RDWR);
-	if (fd == -1) {
-		perror(name);
+	names = strdup(list);
+	if (!names) {
+		fputs("out of memory\n", stderr);
 		exit(EXIT_FAILURE);
 	}
-	get_info.version = 4;
-	get_info.rom_length = 0;
-	get_info.rom = 0;
-	get_info.bus_reset = ptr_to_u64(&bus_reset);
-	get_info.bus_reset_closure = 0;
-	if (ioctl(fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
-		fprintf(stderr, "%s: not a fw device\n", name);
+	for (name = strtok_r(names, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+		find_param_node(name);
+		if (card >= 0 && local_node->card != (u32)card) {
+			fputs("nodes are on different buses\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		card = local_node->card;
+		for (i = 0; i < param_node_count; ++i)
+			if (param_node_ids[i] == param_node_id)
+				break;
+		if (i == param_node_count)
+			param_node_ids[param_node_count++] = param_node_id;
+	}
+	free(names);
+	if (!param_node_count) {
+		fputs("missing destination node\n", stderr);
 		exit(EXIT_FAILURE);
 	}
-	close(fd);
-	param_node_id = bus_reset.node_id & 0x3f;
-	sprintf(card_str, "%u", get_info.card);
-	find_local_node(card_str);
 }
 
-static u32 _send_packet(u32 quadlet0, u32 quadlet1, u32 response_mask, u32 response_bits)
+/*
+ * A PHY packet, and the reply that it expects.  The packets of a command are
+ * all sent back to back, and each reply is matched to its packet with the
+ * response mask and bits, which include the PHY ID of the node.
+ */
+struct phy_request {
+	u32 phy_id;
+	u32 quadlets[2];
+	u32 response_mask;	/* 0 if there is no reply */
+	u32 response_bits;
+	bool sent;
+	bool resubmitted;	/* after RCODE_GENERATION, i.e., with a newer generation */
+	bool answered;
+	u32 response;
+	u32 ping_time;
+	u32 self_ids[3];
+	unsigned int self_id_count;
+};
+
+static struct phy_request phy_requests[64];
+static unsigned int phy_request_count;
+
+static void add_request(u32 phy_id, u32 quadlet0, u32 quadlet1,
+			u32 response_mask, u32 response_bits)
+{
+	struct phy_request *request = &phy_requests[phy_request_count++];
+
+	memset(request, 0, sizeof(*request));
+	request->phy_id = phy_id;
+	request->quadlets[0] = quadlet0;
+	request->quadlets[1] = quadlet1;
+	request->response_mask = response_mask;
+	request->response_bits = response_bits;
+}
+
+static void enable_phy_packet_reception(void)
 {
+	static bool enabled;
 	struct fw_cdev_receive_phy_packets receive_phy_packets;
-	struct fw_cdev_send_phy_packet send_phy_packet;
-	struct pollfd pollfd;
-	int poll_result;
-	ssize_t bytes;
-	union fw_cdev_event event;
-	bool wait_for_sent = true;
-	bool wait_for_response = response_mask != 0;
-	unsigned int self_id_index = 0;
-	u32 response = 0;
-
-	if (wait_for_response) {
-		receive_phy_packets.closure = 0;
-		if (ioctl(local_node->fd, FW_CDEV_IOC_RECEIVE_PHY_PACKETS, &receive_phy_packets) < 0) {
-			perror("RECEIVE_PHY_PACKETS ioctl failed");
-			exit(EXIT_FAILURE);
-		}
-	}
 
-	send_phy_packet.closure = 0;
-	send_phy_packet.data[0] = quadlet0;
-	send_phy_packet.data[1] = quadlet1;
-	send_phy_packet.generation = local_node->generation;
-	if (ioctl(local_node->fd, FW_CDEV_IOC_SEND_PHY_PACKET, &send_phy_packet) < 0) {
-		perror("SEND_PHY_PACKET ioctl failed");
+	if (enabled)
+		return;
+	receive_phy_packets.closure = 0;
+	if (fw_stats_ioctl(local_node->fd, FW_CDEV_IOC_RECEIVE_PHY_PACKETS, &receive_phy_packets) < 0) {
+		perror("RECEIVE_PHY_PACKETS ioctl failed");
 		exit(EXIT_FAILURE);
 	}
+	enabled = true;
+}
 
-	pollfd.fd = local_node->fd;
-	pollfd.events = POLLIN;
-	while (wait_for_sent || wait_for_response) {
-		poll_result = poll(&pollfd, 1, 100);
-		if (poll_result < 0) {
-			perror("poll failed");
-			exit(EXIT_FAILURE);
-		}
-		if (poll_result == 0) {
-			fputs("timeout\n", stderr);
-			exit(EXIT_FAILURE);
-		}
-		bytes = read(local_node->fd, &event, sizeof(event));
-		if (bytes < sizeof(struct fw_cdev_event_common)) {
-			fputs("short read\n", stderr);
-			exit(EXIT_FAILURE);
+static void set_deadline(struct timespec *deadline)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += PHY_TIMEOUT / 1000;
+	deadline->tv_nsec += PHY_TIMEOUT % 1000 * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_nsec -= 1000000000;
+		++deadline->tv_sec;
+	}
+}
+
+static int remaining_ms(const struct timespec *deadline)
+{
+	struct timespec now;
+	long long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (deadline->tv_sec - now.tv_sec) * 1000LL +
+	     (deadline->tv_nsec - now.tv_nsec + 999999) / 1000000;
+	return ms > 0 ? ms : 0;
+}
+
+/* returns the request that is answered by the packet, if any */
+static struct phy_request *handle_reply(u32 quadlet)
+{
+	struct phy_request *request;
+	unsigned int i;
+
+	for (i = 0; i < phy_request_count; ++i) {
+		request = &phy_requests[i];
+		if (request->answered || !request->response_mask ||
+		    (quadlet & request->response_mask) != request->response_bits)
+			continue;
+		request->response = quadlet;
+		if ((quadlet & 0xc0000000) == 0x80000000) {
+			request->self_ids[request->self_id_count++] = quadlet;
+			if (request->self_id_count < ARRAY_SIZE(request->self_ids) &&
+			    (quadlet & 1))
+				return NULL;
 		}
+		request->answered = true;
+		return request;
+	}
+	return NULL;
+}
+
+/*
+ * Sends the packets in phy_requests[], and waits for them to be sent and for
+ * their replies, PHY_TIMEOUT for all of them together, counted again from
+ * each bus reset.  Returns the number of packets that got no reply.
+ */
+static unsigned int send_requests(void)
+{
+	struct fw_cdev_send_phy_packet send_phy_packet;
+	struct phy_request *request;
+	struct fw_retry retry;
+	union fw_cdev_event event;
+	struct timespec deadline;
+	unsigned int i, unsent = phy_request_count, unanswered = 0, failed = 0;
+	bool reset_seen = false;
+	int timeout;
+
+	for (i = 0; i < phy_request_count; ++i)
+		if (phy_requests[i].response_mask)
+			++unanswered;
+	if (unanswered)
+		enable_phy_packet_reception();
+
+	fw_retry_init(&retry, local_node->fd, local_node->generation, local_node->node_id);
+	for (i = 0; i < phy_request_count; ++i) {
+		send_phy_packet.closure = i;
+		send_phy_packet.data[0] = phy_requests[i].quadlets[0];
+		send_phy_packet.data[1] = phy_requests[i].quadlets[1];
+		send_phy_packet.generation = local_node->generation;
+		fw_retry_send_phy_packet(&retry, &send_phy_packet);
+	}
+	set_deadline(&deadline);
+
+	while (unsent || unanswered) {
+		timeout = remaining_ms(&deadline);
+		if (!timeout || !fw_retry_read_event(&retry, &event, sizeof(event), timeout))
+			break;
 		switch (event.common.type) {
 		case FW_CDEV_EVENT_BUS_RESET:
-			fputs("bus reset\n", stderr);
-			exit(EXIT_FAILURE);
+			local_node->generation = retry.generation;
+			reset_seen = true;
+			set_deadline(&deadline);
+			break;
 		case FW_CDEV_EVENT_PHY_PACKET_SENT:
-			wait_for_sent = false;
+			if (event.phy_packet.closure >= phy_request_count)
+				break;
+			request = &phy_requests[event.phy_packet.closure];
+			if (request->sent)
+				break;
+			if (fw_retry_resubmit(&retry, event.phy_packet.closure,
+					      event.phy_packet.rcode)) {
+				request->resubmitted = true;
+				break;
+			}
+			request->sent = true;
+			--unsent;
 			if (event.phy_packet.length >= 4)
-				ping_time = event.phy_packet.data[0];
+				request->ping_time = event.phy_packet.data[0];
+			if (!request->response_mask || request->answered)
+				fw_retry_forget(&retry, event.phy_packet.closure);
 			break;
 		case FW_CDEV_EVENT_PHY_PACKET_RECEIVED:
-			if ((event.phy_packet.data[0] & response_mask) == response_bits) {
-				response = event.phy_packet.data[0];
-				if ((response & 0xc0000000) == 0x80000000) {
-					self_ids[self_id_index++] = response;
-					if (self_id_index >= ARRAY_SIZE(self_ids) ||
-					    !(response & 1))
-						wait_for_response = false;
-				} else {
-					wait_for_response = false;
+			if (event.phy_packet.length < 4)
+				break;
+			request = handle_reply(event.phy_packet.data[0]);
+			if (!request)
+				break;
+			--unanswered;
+			if (request->sent)
+				fw_retry_forget(&retry, request - phy_requests);
+			break;
+		}
+
+		/*
+		 * After a bus reset, the replies (or some of the self-ID
+		 * packets) of the packets sent before it are lost.  If not
+		 * yet sent, the sent event tells whether a packet was dropped.
+		 */
+		if (reset_seen && !unsent) {
+			reset_seen = false;
+			for (i = 0; i < phy_request_count; ++i) {
+				request = &phy_requests[i];
+				if (request->response_mask && !request->answered &&
+				    !request->resubmitted) {
+					request->sent = false;
+					request->self_id_count = 0;
+					++unsent;
 				}
+				request->resubmitted = false;
 			}
-			break;
+			if (!fw_retry_resend_all(&retry)) {
+				fputs("bus reset\n", stderr);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	fw_retry_report(&retry);
+	fw_retry_release(&retry);
+
+	for (i = 0; i < phy_request_count; ++i) {
+		request = &phy_requests[i];
+		if (!request->sent || (request->response_mask && !request->answered)) {
+			request->answered = false;
+			++failed;
 		}
 	}
+	return failed;
+}
 
-	return response;
+/* sends one packet, and returns its reply */
+static u32 _send_packet(u32 quadlet0, u32 quadlet1, u32 response_mask, u32 response_bits)
+{
+	phy_request_count = 0;
+	add_request(0, quadlet0, quadlet1, response_mask, response_bits);
+	if (send_requests()) {
+		fputs("timeout\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return phy_requests[0].response;
 }
 
 static u32 send_packet(u32 quadlet, u32 response_mask, u32 response_bits)
@@ -357,6 +432,40 @@ static u32 send_packet(u32 quadlet, u32 response_mask, u32 response_bits)
 	return _send_packet(quadlet, ~quadlet, response_mask, response_bits);
 }
 
+/* sends one packet to each of the param nodes; returns the number of them without reply */
+static unsigned int send_node_packets(u32 quadlet, u32 response_mask, u32 response_bits)
+{
+	u32 phy_id;
+	unsigned int i;
+
+	phy_request_count = 0;
+	for (i = 0; i < param_node_count; ++i) {
+		phy_id = param_node_ids[i];
+		add_request(phy_id, quadlet | (phy_id << 24), ~(quadlet | (phy_id << 24)),
+			    response_mask, response_bits | (phy_id << 24));
+	}
+	return send_requests();
+}
+
+/*
+ * Returns whether the reply of a node is there, and prefixes its output with
+ * the PHY ID if there are several nodes.
+ */
+static bool begin_node_result(const struct phy_request *request)
+{
+	if (!request->answered) {
+		if (phy_request_count == 1)
+			fputs("timeout\n", stderr);
+		else
+			fprintf(stderr, "phy %u: timeout\n", request->phy_id);
+		++failures;
+		return false;
+	}
+	if (phy_request_count > 1)
+		printf("phy %u: ", request->phy_id);
+	return true;
+}
+
 static void command_config(char *args[])
 {
 	bool new_root = false;
@@ -419,7 +528,8 @@ static void print_port(u32 self_id, unsigned int shift)
 	fputs(port[(self_id >> shift) & 3], stdout);
 }
 
-static void command_ping(char *args[])
+/* prints the self-ID packet 0 of a node and its extended packets, if any */
+static void print_self_ids(const u32 *self_ids, unsigned int count)
 {
 	static const char *const speed[] = {
 		[0] = "S100",
@@ -439,25 +549,7 @@ static void command_ping(char *args[])
 	};
 	unsigned int i;
 
-	if (!args[0]) {
-		fputs("missing destination node\n", stderr);
-syntax_error:
-		help();
-		exit(EXIT_FAILURE);
-	}
-	find_param_node(args[0]);
-
-	if (args[1]) {
-		fprintf(stderr, "unexpected parameter `%s'\n", args[1]);
-		goto syntax_error;
-	}
-
-	send_packet((0 << 18) | (param_node_id << 24),
-		    0xff000000,
-		    (2 << 30) | (param_node_id << 24));
-	printf("time: %u ticks (%llu ns)",
-	       ping_time, (ping_time * 1000000uLL + 12288u) / 24576u);
-	printf(", selfID: phy %u %s gc=%u %s %s%s%s [",
+	printf("phy %u %s gc=%u %s %s%s%s [",
 	       (self_ids[0] >> 24) & 0x3f,
 	       speed[(self_ids[0] >> 14) & 3],
 	       (self_ids[0] >> 16) & 0x3f,
@@ -469,7 +561,7 @@ syntax_error:
 	print_port(self_ids[0], 4);
 	print_port(self_ids[0], 2);
 	if (self_ids[0] & 1) {
-		for (i = 1; i < ARRAY_SIZE(self_ids); ++i) {
+		for (i = 1; i < count; ++i) {
 			print_port(self_ids[i], 16);
 			print_port(self_ids[i], 14);
 			print_port(self_ids[i], 12);
@@ -482,15 +574,178 @@ syntax_error:
 				break;
 		}
 	}
-	puts("]");
+	putchar(']');
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+struct ping_sample {
+	u32 ticks;
+	bool after_reset;	/* a bus reset happened since the previous ping */
+};
+
+struct ping_stats {
+	struct ping_sample *ring;	/* the last PING_RING_SIZE samples */
+	unsigned int received;
+	u32 min, max;
+	u64 sum;
+};
+
+/*
+ * Pings the param nodes ping_count times, every ping_interval ms, and prints
+ * the round-trip statistics of each node.  The percentiles and the outliers,
+ * samples longer than twice the median, are taken from the most recent
+ * samples, which are kept in a ring per node that is allocated up front.
+ */
+static void ping_repeatedly(void)
+{
+	const struct phy_request *request;
+	struct ping_stats *stats, *node;
+	struct ping_sample *samples, *sample;
+	struct timespec next;
+	u32 *sorted, generation, nearest = 0, median, p99;
+	unsigned int ring_size, round, i, j, n, hops, outliers, reset_outliers;
+	bool after_reset;
+
+	ring_size = ping_count < PING_RING_SIZE ? ping_count : PING_RING_SIZE;
+	stats = calloc(param_node_count, sizeof(*stats));
+	samples = calloc(param_node_count * ring_size, sizeof(*samples));
+	sorted = malloc(ring_size * sizeof(*sorted));
+	if (!stats || !samples || !sorted) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < param_node_count; ++i) {
+		stats[i].ring = samples + i * ring_size;
+		stats[i].min = -1u;
+	}
+
+	generation = local_node->generation;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (round = 0; round < ping_count; ++round) {
+		if (round > 0) {
+			next.tv_sec += ping_interval / 1000;
+			next.tv_nsec += ping_interval % 1000 * 1000000;
+			if (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				++next.tv_sec;
+			}
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+				;
+		}
+
+		send_node_packets(0 << 18, 0xff000000, 2 << 30);
+		after_reset = local_node->generation != generation;
+		generation = local_node->generation;
+
+		for (i = 0; i < phy_request_count; ++i) {
+			request = &phy_requests[i];
+			if (!request->answered)
+				continue;
+			node = &stats[i];
+			sample = &node->ring[node->received % ring_size];
+			sample->ticks = request->ping_time;
+			sample->after_reset = after_reset;
+			++node->received;
+			node->sum += request->ping_time;
+			if (request->ping_time < node->min)
+				node->min = request->ping_time;
+			if (request->ping_time > node->max)
+				node->max = request->ping_time;
+		}
+	}
+
+	/* the nearest node is assumed to be one hop away */
+	for (i = 0; i < param_node_count; ++i)
+		if (stats[i].received && (!nearest || stats[i].min < nearest))
+			nearest = stats[i].min;
+
+	for (i = 0; i < param_node_count; ++i) {
+		node = &stats[i];
+		if (!node->received) {
+			fprintf(stderr, "phy %u: timeout\n", param_node_ids[i]);
+			++failures;
+			continue;
+		}
+
+		n = node->received < ring_size ? node->received : ring_size;
+		for (j = 0; j < n; ++j)
+			sorted[j] = node->ring[j].ticks;
+		qsort(sorted, n, sizeof(*sorted), compare_u32);
+		median = sorted[(n - 1) / 2];
+		p99 = sorted[(n * 99 - 1) / 100];
+
+		outliers = 0;
+		reset_outliers = 0;
+		for (j = 0; j < n; ++j)
+			if (node->ring[j].ticks > 2 * median) {
+				++outliers;
+				if (node->ring[j].after_reset)
+					++reset_outliers;
+			}
+
+		hops = 1 + (node->min - nearest + PING_HOP_TICKS / 2) / PING_HOP_TICKS;
+		printf("phy %u: %u/%u replies, ticks min %u mean %.1f p99 %u max %u, ~%u hop%s",
+		       param_node_ids[i], node->received, ping_count, node->min,
+		       (double)node->sum / node->received, p99, node->max,
+		       hops, hops == 1 ? "" : "s");
+		if (outliers)
+			printf(", %u outlier%s (%u at bus resets)",
+			       outliers, outliers == 1 ? "" : "s", reset_outliers);
+		putchar('\n');
+	}
+
+	free(sorted);
+	free(samples);
+	free(stats);
+}
+
+static void command_ping(char *args[])
+{
+	const struct phy_request *request;
+	unsigned int i;
+
+	if (!args[0]) {
+		fputs("missing destination node\n", stderr);
+syntax_error:
+		help();
+		exit(EXIT_FAILURE);
+	}
+	find_param_nodes(args[0]);
+
+	if (args[1]) {
+		fprintf(stderr, "unexpected parameter `%s'\n", args[1]);
+		goto syntax_error;
+	}
+
+	if (ping_count > 1) {
+		ping_repeatedly();
+		return;
+	}
+
+	send_node_packets(0 << 18, 0xff000000, 2 << 30);
+	for (i = 0; i < phy_request_count; ++i) {
+		request = &phy_requests[i];
+		if (!begin_node_result(request))
+			continue;
+		printf("time: %u ticks (%llu ns)", request->ping_time,
+		       (request->ping_time * 1000000uLL + 12288u) / 24576u);
+		fputs(", selfID: ", stdout);
+		print_self_ids(request->self_ids, request->self_id_count);
+		putchar('\n');
+	}
 }
 
 static void command_read(char *args[])
 {
-	unsigned int page, port, reg;
+	unsigned int page, port, reg, i;
 	char *endptr;
 	u32 packet;
-	u32 response;
 
 	if (!args[0]) {
 		fputs("missing destination node\n", stderr);
@@ -498,7 +753,7 @@ syntax_error:
 		help();
 		exit(EXIT_FAILURE);
 	}
-	find_param_node(args[0]);
+	find_param_nodes(args[0]);
 
 	if (!args[1]) {
 		fputs("missing register number\n", stderr);
@@ -568,14 +823,15 @@ syntax_error:
 	packet |= page << 15;
 	packet |= port << 11;
 	packet |= (reg & 7) << 8;
-	packet |= param_node_id << 24;
-	response = send_packet(packet, 0xffffff00, packet | (2 << 18));
-	printf("value: 0x%02x\n", response & 0xff);
+	send_node_packets(packet, 0xffffff00, packet | (2 << 18));
+	for (i = 0; i < phy_request_count; ++i)
+		if (begin_node_result(&phy_requests[i]))
+			printf("value: 0x%02x\n", phy_requests[i].response & 0xff);
 }
 
 static void command_remote_cmd(char *args[], u32 cmd)
 {
-	unsigned int port;
+	unsigned int port, i;
 	char *endptr;
 	u32 response;
 
@@ -585,7 +841,7 @@ syntax_error:
 		help();
 		exit(EXIT_FAILURE);
 	}
-	find_param_node(args[0]);
+	find_param_nodes(args[0]);
 
 	if (!args[1]) {
 		fputs("missing port number\n", stderr);
@@ -606,20 +862,24 @@ syntax_error:
 		goto syntax_error;
 	}
 
-	response = send_packet((0x8 << 18) | cmd | (port << 11) | (param_node_id << 24),
-			       0xff3ff807,
-			       (0xa << 18) | cmd | (port << 11) | (param_node_id << 24));
-	if (!(response & (1 << 3)))
-		puts("command rejected");
-	else if (!(response & 0x1f0))
-		fputs("port status: ok\n", stdout);
-	else
-		printf("port status:%s%s%s%s%s\n",
-		       response & (1 << 4) ? " disabled" : "",
-		       response & (1 << 5) ? " bias" : "",
-		       response & (1 << 6) ? " connected" : "",
-		       response & (1 << 7) ? " fault" : "",
-		       response & (1 << 8) ? " standby_fault" : "");
+	send_node_packets((0x8 << 18) | cmd | (port << 11), 0xff3ff807,
+			  (0xa << 18) | cmd | (port << 11));
+	for (i = 0; i < phy_request_count; ++i) {
+		if (!begin_node_result(&phy_requests[i]))
+			continue;
+		response = phy_requests[i].response;
+		if (!(response & (1 << 3)))
+			puts("command rejected");
+		else if (!(response & 0x1f0))
+			fputs("port status: ok\n", stdout);
+		else
+			printf("port status:%s%s%s%s%s\n",
+			       response & (1 << 4) ? " disabled" : "",
+			       response & (1 << 5) ? " bias" : "",
+			       response & (1 << 6) ? " connected" : "",
+			       response & (1 << 7) ? " fault" : "",
+			       response & (1 << 8) ? " standby_fault" : "");
+	}
 }
 
 static void command_nop(char *args[])
@@ -652,7 +912,7 @@ static void command_resume(char *args[])
 	if (args[0])
 		command_remote_cmd(args, 6);
 	else
-		send_packet((0xf << 18) | (local_node->id << 24), 0, 0);
+		send_packet((0xf << 18) | (local_node->node_id << 24), 0, 0);
 }
 
 static void command_standby(char *args[])
@@ -729,7 +989,382 @@ static void command_reset(char *args[])
 	}
 
 	initiate_bus_reset.type = FW_CDEV_SHORT_RESET;
-	if (ioctl(local_node->fd, FW_CDEV_IOC_INITIATE_BUS_RESET, &initiate_bus_reset) < 0) {
+	if (fw_stats_ioctl(local_node->fd, FW_CDEV_IOC_INITIATE_BUS_RESET, &initiate_bus_reset) < 0) {
+		perror("INITIATE_BUS_RESET ioctl failed");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * The self-ID packets are not delivered as PHY packets, so the monitor reads
+ * them from the TOPOLOGY_MAP register of the local node after each bus reset,
+ * and prints the nodes whose self-IDs have changed since the last one.
+ */
+struct topology {
+	unsigned int node_count;
+	u32 self_ids[64][3];
+	unsigned int self_id_count[64];
+};
+
+static bool monitor_reset_seen;
+
+static void print_timestamp(void)
+{
+	struct timespec ts;
+	struct tm tm;
+	char text[32];
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	localtime_r(&ts.tv_sec, &tm);
+	strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+	printf("%s.%06ld ", text, ts.tv_nsec / 1000);
+}
+
+static void monitor_handle_event(const void *buf)
+{
+	const struct fw_cdev_event_bus_reset *bus_reset = buf;
+	const struct fw_cdev_event_phy_packet *phy_packet = buf;
+	u32 q;
+
+	switch (bus_reset->type) {
+	case FW_CDEV_EVENT_BUS_RESET:
+		local_node->generation = bus_reset->generation;
+		monitor_reset_seen = true;
+		break;
+	case FW_CDEV_EVENT_PHY_PACKET_RECEIVED:
+		/* PHY configuration packets explain the next gap count or root */
+		if (phy_packet->length < 8)
+			break;
+		q = phy_packet->data[0];
+		if ((q >> 30) != 0 || phy_packet->data[1] != ~q || !(q & (3 << 22)))
+			break;
+		print_timestamp();
+		printf("phy config from generation %u:", local_node->generation);
+		if (q & (1 << 23))
+			printf(" root=%u", (q >> 24) & 0x3f);
+		if (q & (1 << 22))
+			printf(" gc=%u", (q >> 16) & 0x3f);
+		putchar('\n');
+		fflush(stdout);
+		break;
+	}
+}
+
+/* returns false if the request failed, e.g. because of another bus reset */
+static bool read_local_quadlets(u64 offset, u32 *quadlets, unsigned int count)
+{
+	u8 buf[sizeof(struct fw_cdev_event_response) + 512];
+	struct fw_cdev_event_response *response = (void *)buf;
+	struct fw_cdev_send_request send_request;
+	unsigned int i;
+	ssize_t bytes;
+
+	send_request.tcode = TCODE_READ_BLOCK_REQUEST;
+	send_request.length = count * 4;
+	send_request.offset = offset;
+	send_request.closure = 0;
+	send_request.data = 0;
+	send_request.generation = local_node->generation;
+	if (fw_stats_ioctl(local_node->fd, FW_CDEV_IOC_SEND_REQUEST, &send_request) < 0) {
+		perror("SEND_REQUEST ioctl failed");
+		exit(EXIT_FAILURE);
+	}
+
+	for (;;) {
+		bytes = fw_stats_read_event(local_node->fd, buf, sizeof(buf));
+		if (bytes < (ssize_t)sizeof(struct fw_cdev_event_common)) {
+			fputs("short read\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		if (response->type == FW_CDEV_EVENT_RESPONSE)
+			break;
+		monitor_handle_event(buf);
+	}
+	if (response->rcode != RCODE_COMPLETE || response->length != count * 4)
+		return false;
+	for (i = 0; i < count; ++i)
+		quadlets[i] = __be32_to_cpu(((u32 *)response->data)[i]);
+	return true;
+}
+
+static bool read_topology(struct topology *topology)
+{
+	u32 map[3 + MAX_SELF_IDS];
+	unsigned int self_id_count, i, chunk, phy_id;
+
+	if (!read_local_quadlets(TOPOLOGY_MAP_ADDR, map, 3))
+		return false;
+	self_id_count = map[2] & 0xffff;
+	if (self_id_count > MAX_SELF_IDS)
+		return false;
+	for (i = 0; i < self_id_count; i += chunk) {
+		chunk = self_id_count - i < 128 ? self_id_count - i : 128;
+		if (!read_local_quadlets(TOPOLOGY_MAP_ADDR + 12 + i * 4, map + 3 + i, chunk))
+			return false;
+	}
+
+	memset(topology, 0, sizeof(*topology));
+	topology->node_count = map[2] >> 16;
+	for (i = 0; i < self_id_count; ++i) {
+		u32 self_id = map[3 + i];
+		phy_id = (self_id >> 24) & 0x3f;
+		if ((self_id & 0xc0000000) != 0x80000000)
+			continue;
+		if (!(self_id & (1 << 23)))
+			topology->self_id_count[phy_id] = 0;
+		if (topology->self_id_count[phy_id] < 3)
+			topology->self_ids[phy_id][topology->self_id_count[phy_id]++] = self_id;
+	}
+	return true;
+}
+
+static bool same_self_ids(const struct topology *a, const struct topology *b,
+			  unsigned int phy_id)
+{
+	return a->self_id_count[phy_id] == b->self_id_count[phy_id] &&
+	       !memcmp(a->self_ids[phy_id], b->self_ids[phy_id],
+		       a->self_id_count[phy_id] * sizeof(u32));
+}
+
+static void print_topology_diff(const struct topology *old, const struct topology *new)
+{
+	unsigned int phy_id, changed = 0, root = 0;
+
+	for (phy_id = 0; phy_id < 64; ++phy_id) {
+		if (!same_self_ids(old, new, phy_id))
+			++changed;
+		if (new->self_id_count[phy_id])
+			root = phy_id;
+	}
+
+	print_timestamp();
+	printf("generation %u: %u node%s, root %u, %u changed\n", local_node->generation,
+	       new->node_count, new->node_count == 1 ? "" : "s", root, changed);
+	for (phy_id = 0; phy_id < 64; ++phy_id) {
+		if (same_self_ids(old, new, phy_id))
+			continue;
+		if (old->self_id_count[phy_id]) {
+			fputs("  - ", stdout);
+			print_self_ids(old->self_ids[phy_id], old->self_id_count[phy_id]);
+			putchar('\n');
+		}
+		if (new->self_id_count[phy_id]) {
+			fputs("  + ", stdout);
+			print_self_ids(new->self_ids[phy_id], new->self_id_count[phy_id]);
+			putchar('\n');
+		}
+	}
+	fflush(stdout);
+}
+
+static void command_monitor(char *args[])
+{
+	static struct topology topologies[2];
+	struct topology *old = &topologies[0], *new = &topologies[1], *swap;
+	struct fw_cdev_receive_phy_packets receive_phy_packets;
+	u8 buf[sizeof(struct fw_cdev_event_response) + 512];
+	struct fw_cdev_event_common *event = (void *)buf;
+	ssize_t bytes;
+
+	if (args[0]) {
+		fprintf(stderr, "unexpected parameter `%s'\n", args[0]);
+		help();
+		exit(EXIT_FAILURE);
+	}
+
+	receive_phy_packets.closure = 0;
+	if (fw_stats_ioctl(local_node->fd, FW_CDEV_IOC_RECEIVE_PHY_PACKETS, &receive_phy_packets) < 0) {
+		perror("RECEIVE_PHY_PACKETS ioctl failed");
+		exit(EXIT_FAILURE);
+	}
+
+	/* starts with an empty topology, so that all nodes are printed first */
+	monitor_reset_seen = true;
+	for (;;) {
+		while (monitor_reset_seen) {
+			monitor_reset_seen = false;
+			if (!read_topology(new)) {
+				/*
+				 * A bus reset during the read has already been
+				 * seen, so read again at once; otherwise retried
+				 * after the next bus reset.
+				 */
+				if (monitor_reset_seen)
+					continue;
+				break;
+			}
+			if (monitor_reset_seen)
+				continue;
+			print_topology_diff(old, new);
+			swap = old;
+			old = new;
+			new = swap;
+		}
+
+		bytes = fw_stats_read_event(local_node->fd, buf, sizeof(buf));
+		if (bytes < (ssize_t)sizeof(struct fw_cdev_event_common)) {
+			fputs("short read\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		monitor_handle_event(event);
+	}
+}
+
+/* port status of the self-ID packets, two bits per port */
+#define PORT_CHILD		3
+#define PORT_PARENT		2
+
+/*
+ * Returns the largest number of cable hops between any two nodes, or -1 if
+ * the self-IDs do not describe a tree.  The self-IDs are ordered by PHY ID,
+ * which is a post-order traversal, so the children of each node are the
+ * subtrees completed last.
+ */
+static int topology_hops(const struct topology *topology)
+{
+	unsigned int heights[64];
+	unsigned int depth = 0, phy_id, i, n, port, children, status;
+	unsigned int height, highest, second;
+	int hops = 0;
+
+	for (phy_id = 0; phy_id < 64; ++phy_id) {
+		const u32 *ids = topology->self_ids[phy_id];
+
+		n = topology->self_id_count[phy_id];
+		if (!n)
+			continue;
+		children = 0;
+		for (port = 0; port < 3; ++port)
+			if (((ids[0] >> (6 - port * 2)) & 3) == PORT_CHILD)
+				++children;
+		for (i = 1; i < n; ++i)
+			for (port = 0; port < 8; ++port) {
+				status = (ids[i] >> (16 - port * 2)) & 3;
+				if (status == PORT_CHILD)
+					++children;
+			}
+		if (children > depth)
+			return -1;
+
+		highest = 0;
+		second = 0;
+		for (i = 0; i < children; ++i) {
+			height = heights[--depth] + 1;
+			if (height > highest) {
+				second = highest;
+				highest = height;
+			} else if (height > second) {
+				second = height;
+			}
+		}
+		if ((int)(highest + second) > hops)
+			hops = highest + second;
+		heights[depth++] = highest;
+	}
+	return depth == 1 ? hops : -1;
+}
+
+static void command_optimize_gap(char *args[])
+{
+	/* IEEE 1394a-2000 table E-1, indexed by the number of hops */
+	static const u8 gap_count_table[] = {
+		63, 5, 7, 8, 10, 13, 16, 18, 21, 24, 26, 29, 32, 35, 37, 40
+	};
+	static struct topology topology;
+	struct fw_cdev_initiate_bus_reset initiate_bus_reset;
+	bool dry_run = false;
+	u32 generation, longest = 0, second = 0, ping_time, round_trip, clocks;
+	unsigned int phy_id, pinged = 0, table_gap_count, gap_count, i;
+	int hops;
+
+	if (args[0]) {
+		if (strcmp(args[0], "dry-run") || args[1]) {
+			fprintf(stderr, "unexpected parameter `%s'\n",
+				strcmp(args[0], "dry-run") ? args[0] : args[1]);
+			help();
+			exit(EXIT_FAILURE);
+		}
+		dry_run = true;
+	}
+
+	generation = local_node->generation;
+	if (!read_topology(&topology)) {
+		fputs("cannot read the topology map\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	hops = topology_hops(&topology);
+	if (hops < 0) {
+		fputs("inconsistent self-IDs\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	table_gap_count = hops < (int)ARRAY_SIZE(gap_count_table) ?
+			  gap_count_table[hops] : 63;
+
+	/* all nodes are pinged at once */
+	param_node_count = 0;
+	for (phy_id = 0; phy_id < 64; ++phy_id)
+		if (topology.self_id_count[phy_id] && phy_id != (local_node->node_id & 0x3f))
+			param_node_ids[param_node_count++] = phy_id;
+	if (param_node_count) {
+		if (send_node_packets(0 << 18, 0xff000000, 2 << 30)) {
+			fputs("timeout\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		pinged = param_node_count;
+	}
+	for (i = 0; i < pinged; ++i) {
+		ping_time = phy_requests[i].ping_time;
+		if (ping_time > longest) {
+			second = longest;
+			longest = ping_time;
+		} else if (ping_time > second) {
+			second = ping_time;
+		}
+	}
+	if (local_node->generation != generation) {
+		fputs("bus reset during measurement\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * The round trip between two nodes is at most the sum of their round
+	 * trips from the local node.  The subaction gap, 27 + 16 * gap_count
+	 * clocks of 98.304 MHz, must be longer than the worst of them; ping
+	 * times are in clocks of 24.576 MHz.
+	 */
+	round_trip = longest + second;
+	clocks = round_trip * 4;
+	gap_count = clocks > 27 ? (clocks - 27 + 15) / 16 : 1;
+	if (gap_count > 63)
+		gap_count = 63;
+	if (!pinged)
+		gap_count = table_gap_count;
+
+	printf("hops: %d, table gap count: %u, worst round trip: %u ticks (%llu ns), gap count: %u\n",
+	       hops, table_gap_count, round_trip,
+	       (round_trip * 1000000uLL + 12288u) / 24576u, gap_count);
+
+	/*
+	 * The bus manager of firewire-core (bm_work) sets the gap count of the
+	 * same table for the largest number of hops when the gap count in the
+	 * self-IDs differs from it, so any other one is undone by the next bus
+	 * reset if the local node, or another one that does the same, is the
+	 * bus manager.
+	 */
+	if (gap_count != table_gap_count) {
+		fflush(stdout);
+		fprintf(stderr, "warning: gap count %u differs from the table gap count %u; "
+			"the bus manager%s may set the table gap count again\n",
+			gap_count, table_gap_count,
+			(local_node->bus_reset.bm_node_id & 0x3f) == (local_node->node_id & 0x3f) ?
+			" (the local node)" : "");
+	}
+	if (dry_run)
+		return;
+
+	send_packet((1 << 22) | (gap_count << 16), 0, 0);
+	initiate_bus_reset.type = FW_CDEV_SHORT_RESET;
+	if (fw_stats_ioctl(local_node->fd, FW_CDEV_IOC_INITIATE_BUS_RESET, &initiate_bus_reset) < 0) {
 		perror("INITIATE_BUS_RESET ioctl failed");
 		exit(EXIT_FAILURE);
 	}
@@ -737,9 +1372,12 @@ static void command_reset(char *args[])
 
 int main(int argc, char *argv[])
 {
-	static const char short_options[] = "b:hV";
+	static const char short_options[] = "b:n:i:hV";
 	static const struct option long_options[] = {
 		{ "bus", 1, NULL, 'b' },
+		{ "count", 1, NULL, 'n' },
+		{ "interval", 1, NULL, 'i' },
+		{ "stats", 0, NULL, 'S' },
 		{ "help", 0, NULL, 'h' },
 		{ "version", 0, NULL, 'V' },
 		{}
@@ -764,8 +1402,12 @@ int main(int argc, char *argv[])
 		{ "link_on",  command_linkon },
 		{ "versaphy", command_versaphy },
 		{ "reset",    command_reset },
+		{ "monitor",  command_monitor },
+		{ "optimize-gap", command_optimize_gap },
 	};
 	const char *bus_name = NULL;
+	unsigned long l;
+	char *endptr;
 	unsigned int i;
 	int c;
 
@@ -774,6 +1416,25 @@ int main(int argc, char *argv[])
 		case 'b':
 			bus_name = optarg;
 			break;
+		case 'n':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l < 1 || l > 10000000) {
+				fprintf(stderr, "invalid count: `%s'\n", optarg);
+				return 1;
+			}
+			ping_count = l;
+			break;
+		case 'i':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l > 3600000) {
+				fprintf(stderr, "invalid interval: `%s'\n", optarg);
+				return 1;
+			}
+			ping_interval = l;
+			break;
+		case 'S':
+			fw_stats_enable();
+			break;
 		case 'h':
 			help();
 			return 0;
@@ -793,11 +1454,11 @@ int main(int argc, char *argv[])
 	}
 	for (i = 0; i < ARRAY_SIZE(commands); ++i)
 		if (!strcmp(commands[i].name, argv[optind])) {
-			open_all_nodes();
+			fw_device_index_init(&devices, 4);
 			find_local_node(bus_name);
 			commands[i].fn(argv + optind + 1);
-			close_all_nodes();
-			return 0;
+			fw_device_index_release(&devices);
+			return failures ? 1 : 0;
 		}
 
 	fprintf(stderr, "unknown command `%s'\n", argv[optind]);
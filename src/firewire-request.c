@@ -13,12 +13,15 @@
 #include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
 #include <dirent.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <poll.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <linux/firewire-cdev.h>
@@ -26,10 +29,30 @@
 #include <asm/byteorder.h>
 
 #include "config.h"
+#include "config-rom.h"
+#include "fw-device.h"
+#include "fw-retry.h"
+#include "fw-stats.h"
 
 #define FCP_COMMAND_ADDR	0xfffff0000b00uLL
 #define FCP_RESPONSE_ADDR	0xfffff0000d00uLL
 
+#define CSR_STATE_CLEAR		0xfffff0000000uLL
+#define CSR_STATE_SET		0xfffff0000004uLL
+#define CSR_SPLIT_TIMEOUT_HI	0xfffff0000018uLL
+#define CSR_SPLIT_TIMEOUT_LO	0xfffff000001cuLL
+#define CSR_BUSY_TIMEOUT	0xfffff0000210uLL
+#define CSR_PRIORITY_BUDGET	0xfffff0000218uLL
+#define CSR_BANDWIDTH_AVAILABLE	0xfffff0000220uLL
+#define CSR_CHANNELS_AVAILABLE	0xfffff0000224uLL
+#define CSR_CONFIG_ROM		0xfffff0000400uLL
+
+#define CSR_STATE_BIT_CMSTR	(1 << 8)
+#define BANDWIDTH_AVAILABLE_INITIAL	4915
+
+#define FCP_CTS_AVC		0x0
+#define AVC_RESPONSE_INTERIM	0xf
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
 
 #define ptr_to_u64(p) ((uintptr_t)(p))
@@ -52,59 +75,54 @@ static unsigned int register_length;
 static unsigned int read_length;
 static struct data data;
 static struct data data2;
+static struct fw_device_index devices;
+static struct fw_device *device;
 static int fd;
 static u32 card_index;
-static u32 node_id;
-static u32 generation;
+static struct fw_retry retry;
+static unsigned int max_payload = 512;
+static unsigned int queue_depth = 4;
+static const char *command_file;
+static unsigned int batch_line;
+static unsigned int failures;
+static int fcp_timeout = 2345;
+static unsigned int bench_count = 1000;
+static const struct config_rom_format *rom_format;
 
 static void open_device(void)
 {
-	struct fw_cdev_get_info get_info;
-	struct fw_cdev_event_bus_reset bus_reset;
-
-	fd = open(device_name, O_RDWR);
-	if (fd == -1) {
-		perror(device_name);
-		exit(EXIT_FAILURE);
-	}
-
 #ifdef HAVE_CDEV_4
-	get_info.version = 4;
+	fw_device_index_init(&devices, 4);
 #else
-	get_info.version = 3;
+	fw_device_index_init(&devices, 3);
 #endif
-	get_info.rom_length = 0;
-	get_info.rom = 0;
-	get_info.bus_reset = ptr_to_u64(&bus_reset);
-	get_info.bus_reset_closure = 0;
-	if (ioctl(fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
-		perror("GET_INFO ioctl failed");
+	device = fw_device_get(&devices, device_name);
+	if (!fw_device_probe(&devices, device)) {
+		errno = device->error;
+		perror(device->invalid ? "GET_INFO ioctl failed" : device_name);
 		exit(EXIT_FAILURE);
 	}
-	card_index = get_info.card;
-	node_id = bus_reset.node_id;
-	generation = bus_reset.generation;
+	fd = device->fd;
+	card_index = device->card;
+	fw_retry_init(&retry, fd, device->generation, device->node_id);
 }
 
 static struct fw_cdev_event_response *wait_for_response(void)
 {
 	static u8 buf[sizeof(struct fw_cdev_event_response) + 16384];
-	int r;
-	struct fw_cdev_event_common *event;
+	struct fw_cdev_event_response *response = (void *)buf;
 
 	for (;;) {
-		r = read(fd, buf, sizeof buf);
-		if (r < sizeof(struct fw_cdev_event_common)) {
-			fputs("short read\n", stderr);
-			exit(EXIT_FAILURE);
-		}
-		event = (void *)buf;
-		if (event->type == FW_CDEV_EVENT_RESPONSE)
-			return (struct fw_cdev_event_response *)buf;
+		fw_retry_read_event(&retry, buf, sizeof buf, -1);
+		if (response->type != FW_CDEV_EVENT_RESPONSE ||
+		    fw_retry_resubmit(&retry, response->closure, response->rcode))
+			continue;
+		fw_retry_forget(&retry, response->closure);
+		return response;
 	}
 }
 
-static void print_rcode(u32 rcode)
+static const char *rcode_name(u32 rcode)
 {
 	const char *s;
 
@@ -120,14 +138,28 @@ static void print_rcode(u32 rcode)
 	case RCODE_NO_ACK:		s = "error: no ack";	break;
 	default:			s = "unknown error";	break;
 	}
-	fprintf(stderr, "%s\n", s);
+	return s;
+}
+
+static void print_rcode(u32 rcode)
+{
+	++failures;
+	if (batch_line)
+		fprintf(stderr, "%u: ", batch_line);
+	fprintf(stderr, "%s\n", rcode_name(rcode));
 }
 
-static void print_data(const char *prefix, const void *p, unsigned int length, bool allow_value)
+static void print_data(const char *label, const void *p, unsigned int length, bool allow_value)
 {
+	char prefix[32];
 	const u8 *data = p;
 	unsigned int line, col;
 
+	if (batch_line)
+		snprintf(prefix, sizeof prefix, "%u: %s", batch_line, label);
+	else
+		snprintf(prefix, sizeof prefix, "%s", label);
+
 	if (allow_value) {
 		const u32 *data = p;
 		if (length == 4) {
@@ -154,29 +186,115 @@ static void print_data(const char *prefix, const void *p, unsigned int length, b
 	}
 }
 
-static void do_read(void)
+/*
+ * Reads a range larger than one packet can carry split into block requests of
+ * max_payload bytes, with up to queue_depth of them outstanding.  The closure
+ * of each request is its position in the range.
+ */
+static void do_split_read(void)
 {
 	struct fw_cdev_send_request send_request;
 	struct fw_cdev_event_response *response;
+	unsigned int sent, outstanding, position, length;
+	bool failed = false;
+	u8 *buf;
+
+	buf = malloc(read_length);
+	if (!buf) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	sent = 0;
+	outstanding = 0;
+	while (outstanding > 0 || (!failed && sent < read_length)) {
+		while (!failed && outstanding < queue_depth && sent < read_length) {
+			length = read_length - sent;
+			if (length > max_payload)
+				length = max_payload;
+			send_request.tcode = TCODE_READ_BLOCK_REQUEST;
+			send_request.length = length;
+			send_request.offset = address + sent;
+			send_request.closure = sent;
+			send_request.data = 0;
+			send_request.generation = retry.generation;
+			fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+			sent += length;
+			++outstanding;
+		}
+
+		response = wait_for_response();
+		--outstanding;
+		position = response->closure;
+		length = read_length - position;
+		if (length > max_payload)
+			length = max_payload;
+		if (response->rcode != RCODE_COMPLETE) {
+			fprintf(stderr, "%012llx: ", (unsigned long long)address + position);
+			print_rcode(response->rcode);
+			failed = true;
+		} else if (response->length != length) {
+			fprintf(stderr, "%012llx: short response\n", (unsigned long long)address + position);
+			failed = true;
+		} else {
+			memcpy(buf + position, response->data, length);
+		}
+	}
+
+	if (!failed)
+		print_data("result: ", buf, read_length, false);
+	free(buf);
+}
 
+static void prepare_read(struct fw_cdev_send_request *send_request)
+{
 	if (read_length == 4 && !(address & 3))
-		send_request.tcode = TCODE_READ_QUADLET_REQUEST;
+		send_request->tcode = TCODE_READ_QUADLET_REQUEST;
 	else
-		send_request.tcode = TCODE_READ_BLOCK_REQUEST;
-	send_request.length = read_length;
-	send_request.offset = address;
-	send_request.closure = 0;
-	send_request.data = 0;
-	send_request.generation = generation;
-	if (ioctl(fd, FW_CDEV_IOC_SEND_REQUEST, &send_request) < 0) {
-		perror("SEND_REQUEST ioctl failed");
-		exit(EXIT_FAILURE);
+		send_request->tcode = TCODE_READ_BLOCK_REQUEST;
+	send_request->length = read_length;
+	send_request->offset = address;
+	send_request->closure = 0;
+	send_request->data = 0;
+	send_request->generation = retry.generation;
+}
+
+static void report_read(u32 rcode, const void *result, unsigned int length,
+			unsigned int requested_length)
+{
+	if (rcode != RCODE_COMPLETE)
+		print_rcode(rcode);
+	else
+		print_data("result: ", result, length, length == requested_length);
+}
+
+static void do_read(void)
+{
+	struct fw_cdev_send_request send_request;
+	struct fw_cdev_event_response *response;
+
+	if (read_length > max_payload) {
+		do_split_read();
+		return;
 	}
+
+	prepare_read(&send_request);
+	fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
 	response = wait_for_response();
-	if (response->rcode != RCODE_COMPLETE)
-		print_rcode(response->rcode);
+	report_read(response->rcode, response->data, response->length, read_length);
+}
+
+static void prepare_write(struct fw_cdev_send_request *send_request)
+{
+	if (data.length == 4 && !(address & 3))
+		send_request->tcode = TCODE_WRITE_QUADLET_REQUEST;
 	else
-		print_data("result: ", response->data, response->length, response->length == read_length);
+		send_request->tcode = TCODE_WRITE_BLOCK_REQUEST;
+	send_request->length = data.length;
+	send_request->offset = address;
+	send_request->closure = 0;
+	send_request->data = ptr_to_u64(data.data);
+	send_request->generation = retry.generation;
 }
 
 static void do_write_request(int request)
@@ -184,19 +302,8 @@ static void do_write_request(int request)
 	struct fw_cdev_send_request send_request;
 	struct fw_cdev_event_response *response;
 
-	if (data.length == 4 && !(address & 3))
-		send_request.tcode = TCODE_WRITE_QUADLET_REQUEST;
-	else
-		send_request.tcode = TCODE_WRITE_BLOCK_REQUEST;
-	send_request.length = data.length;
-	send_request.offset = address;
-	send_request.closure = 0;
-	send_request.data = ptr_to_u64(data.data);
-	send_request.generation = generation;
-	if (ioctl(fd, request, &send_request) < 0) {
-		perror("SEND_REQUEST ioctl failed");
-		exit(EXIT_FAILURE);
-	}
+	prepare_write(&send_request);
+	fw_retry_send_request(&retry, request, &send_request);
 	response = wait_for_response();
 	if (response->rcode != RCODE_COMPLETE)
 		print_rcode(response->rcode);
@@ -212,12 +319,11 @@ static void do_broadcast(void)
 	do_write_request(FW_CDEV_IOC_SEND_BROADCAST_REQUEST);
 }
 
-static void do_lock_request(u32 tcode)
+/* returns the buffer of the payload, to be freed if not data.data */
+static u8 *prepare_lock(struct fw_cdev_send_request *send_request, u32 tcode)
 {
 	bool has_data2;
 	u8 *buf;
-	struct fw_cdev_send_request send_request;
-	struct fw_cdev_event_response *response;
 
 	has_data2 = tcode != TCODE_LOCK_FETCH_ADD && tcode != TCODE_LOCK_LITTLE_ADD;
 	if ((data.length != 4 && data.length != 8) ||
@@ -239,21 +345,33 @@ static void do_lock_request(u32 tcode)
 		memcpy(buf + data.length, data2.data, data2.length);
 	} else
 		buf = data.data;
-	send_request.tcode = tcode;;
-	send_request.length = has_data2 ? data.length * 2 : data.length;
-	send_request.offset = address;
-	send_request.closure = 0;
-	send_request.data = ptr_to_u64(buf);
-	send_request.generation = generation;
-	if (ioctl(fd, FW_CDEV_IOC_SEND_REQUEST, &send_request) < 0) {
-		perror("SEND_REQUEST ioctl failed");
-		exit(EXIT_FAILURE);
-	}
-	response = wait_for_response();
-	if (response->rcode != RCODE_COMPLETE)
-		print_rcode(response->rcode);
+	send_request->tcode = tcode;
+	send_request->length = has_data2 ? data.length * 2 : data.length;
+	send_request->offset = address;
+	send_request->closure = 0;
+	send_request->data = ptr_to_u64(buf);
+	send_request->generation = retry.generation;
+
+	return buf;
+}
+
+static void report_lock(u32 rcode, const void *result, unsigned int length)
+{
+	if (rcode != RCODE_COMPLETE)
+		print_rcode(rcode);
 	else
-		print_data("old: ", response->data, response->length, true);
+		print_data("old: ", result, length, true);
+}
+
+static void do_lock_request(u32 tcode)
+{
+	struct fw_cdev_send_request send_request;
+	struct fw_cdev_event_response *response;
+
+	prepare_lock(&send_request, tcode);
+	fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+	response = wait_for_response();
+	report_lock(response->rcode, response->data, response->length);
 }
 
 static void do_mask_swap(void)
@@ -286,29 +404,31 @@ static void do_wrap_add(void)
 	do_lock_request(TCODE_LOCK_WRAP_ADD);
 }
 
-static void send_response(u32 handle, u32 rcode)
+static void send_response(u32 handle, u32 rcode, const void *data, unsigned int length)
 {
 	struct fw_cdev_send_response send_response;
 
 	send_response.rcode = rcode;
-	send_response.length = 0;
-	send_response.data = 0;
+	send_response.length = length;
+	send_response.data = ptr_to_u64(data);
 	send_response.handle = handle;
-	if (ioctl(fd, FW_CDEV_IOC_SEND_RESPONSE, &send_response) < 0) {
+	if (fw_stats_ioctl(fd, FW_CDEV_IOC_SEND_RESPONSE, &send_response) < 0) {
 		perror("SEND_RESPONSE ioctl failed");
 		exit(EXIT_FAILURE);
 	}
 }
 
-static void do_fcp(void)
+/*
+ * The response register stays allocated until the process exits, so that the
+ * fcp commands of a batch share it.
+ */
+static void allocate_fcp_response(void)
 {
-	static u8 buf[sizeof(struct fw_cdev_event_response) + 0x200];
+	static bool allocated;
 	struct fw_cdev_allocate allocate;
-	struct fw_cdev_send_request send_request;
-	bool ack_received, response_received;
-	struct pollfd pfd;
-	int ready, r;
-	struct fw_cdev_event_common *event;
+
+	if (allocated)
+		return;
 
 	allocate.offset = FCP_RESPONSE_ADDR;
 	allocate.closure = 0;
@@ -316,78 +436,403 @@ static void do_fcp(void)
 #ifdef HAVE_CDEV_4
 	allocate.region_end = allocate.offset + allocate.length;
 #endif
-	if (ioctl(fd, FW_CDEV_IOC_ALLOCATE, &allocate) < 0) {
+	if (fw_stats_ioctl(fd, FW_CDEV_IOC_ALLOCATE, &allocate) < 0) {
 		perror("ALLOCATE ioctl failed");
 		exit(EXIT_FAILURE);
 	}
+	allocated = true;
+}
+
+static void send_fcp_command(u64 closure)
+{
+	struct fw_cdev_send_request send_request;
 
 	send_request.tcode = data.length == 4 ? TCODE_WRITE_QUADLET_REQUEST : TCODE_WRITE_BLOCK_REQUEST;
 	send_request.length = data.length;
 	send_request.offset = FCP_COMMAND_ADDR;
-	send_request.closure = 0;
+	send_request.closure = closure;
 	send_request.data = ptr_to_u64(data.data);
-	send_request.generation = generation;
-	if (ioctl(fd, FW_CDEV_IOC_SEND_REQUEST, &send_request) < 0) {
-		perror("SEND_REQUEST ioctl failed");
-		exit(EXIT_FAILURE);
+	send_request.generation = retry.generation;
+	fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+}
+
+/*
+ * Answers an incoming request, and returns whether it is a frame written by
+ * the device to our FCP response register.
+ */
+static bool get_fcp_response(struct fw_cdev_event_common *event,
+			     const u8 **frame, unsigned int *length)
+{
+#ifdef HAVE_CDEV_4
+	if (event->type == FW_CDEV_EVENT_REQUEST2) {
+		struct fw_cdev_event_request2 *request = (void *)event;
+		send_response(request->handle, RCODE_COMPLETE, NULL, 0);
+		if (request->card == card_index &&
+		    (request->source_node_id & 0x3f) == (retry.node_id & 0x3f) &&
+		    (request->tcode == TCODE_WRITE_QUADLET_REQUEST ||
+		     request->tcode == TCODE_WRITE_BLOCK_REQUEST) &&
+		    request->offset == FCP_RESPONSE_ADDR &&
+		    request->generation == retry.generation) {
+			*frame = (const u8 *)request->data;
+			*length = request->length;
+			return true;
+		}
+		return false;
 	}
+#endif
+	if (event->type == FW_CDEV_EVENT_REQUEST) {
+		struct fw_cdev_event_request *request = (void *)event;
+		send_response(request->handle, RCODE_COMPLETE, NULL, 0);
+		if ((request->tcode == TCODE_WRITE_QUADLET_REQUEST ||
+		     request->tcode == TCODE_WRITE_BLOCK_REQUEST) &&
+		    request->offset == FCP_RESPONSE_ADDR) {
+			*frame = (const u8 *)request->data;
+			*length = request->length;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void do_fcp(void)
+{
+	static u8 buf[sizeof(struct fw_cdev_event_response) + 0x200];
+	bool ack_received, response_received;
+	struct fw_cdev_event_common *event = (void *)buf;
+	const u8 *frame;
+	unsigned int length;
+
+	allocate_fcp_response();
+	send_fcp_command(0);
 
 	ack_received = false;
 	response_received = false;
-	pfd.fd = fd;
-	pfd.events = POLLIN;
 	while (!ack_received || !response_received) {
-		/* XXX what's a practical timeout for FCP responses? */
-		ready = poll(&pfd, 1, 2345);
-		if (ready < 0) {
-			perror("poll failed");
-			exit(EXIT_FAILURE);
-		}
-		if (!ready) {
+		if (!fw_retry_read_event(&retry, buf, sizeof buf, fcp_timeout)) {
 			fputs("timeout\n", stderr);
 			exit(EXIT_FAILURE);
 		}
-		r = read(fd, buf, sizeof buf);
-		if (r < sizeof(struct fw_cdev_event_common)) {
-			fputs("short read\n", stderr);
-			exit(EXIT_FAILURE);
-		}
-		event = (void *)buf;
 		if (event->type == FW_CDEV_EVENT_BUS_RESET) {
-			fputs("bus reset\n", stderr);
-			exit(EXIT_FAILURE);
+			/* the response to the command might have been lost */
+			if (response_received)
+				continue;
+			if (!fw_retry_resend_all(&retry)) {
+				fputs("bus reset\n", stderr);
+				exit(EXIT_FAILURE);
+			}
+			ack_received = false;
+			continue;
 		}
 		if (event->type == FW_CDEV_EVENT_RESPONSE) {
 			struct fw_cdev_event_response *response = (void *)buf;
+			if (fw_retry_resubmit(&retry, response->closure, response->rcode))
+				continue;
 			if (response->rcode != RCODE_COMPLETE) {
 				print_rcode(response->rcode);
 				return;
 			}
 			ack_received = true;
-#ifdef HAVE_CDEV_4
-		} else if (event->type == FW_CDEV_EVENT_REQUEST2) {
-			struct fw_cdev_event_request2 *request = (void *)buf;
-			send_response(request->handle, RCODE_COMPLETE);
-			if (request->card == card_index &&
-			    (request->source_node_id & 0x3f) == (node_id & 0x3f) &&
-			    (request->tcode == TCODE_WRITE_QUADLET_REQUEST ||
-			     request->tcode == TCODE_WRITE_BLOCK_REQUEST) &&
-			    request->offset == FCP_RESPONSE_ADDR &&
-			    request->generation == generation) {
-				print_data("response: ", request->data, request->length, false);
-				response_received = true;
+		} else if (get_fcp_response(event, &frame, &length)) {
+			if (length >= 3 && (frame[0] >> 4) == FCP_CTS_AVC &&
+			    (frame[0] & 0x0f) == AVC_RESPONSE_INTERIM) {
+				/* the final response follows */
+				print_data("interim: ", frame, length, false);
+				continue;
 			}
-#endif
-		} else if (event->type == FW_CDEV_EVENT_REQUEST) {
-			struct fw_cdev_event_request *request = (void *)buf;
-			send_response(request->handle, RCODE_COMPLETE);
-			if ((request->tcode == TCODE_WRITE_QUADLET_REQUEST ||
-			     request->tcode == TCODE_WRITE_BLOCK_REQUEST) &&
-			    request->offset == FCP_RESPONSE_ADDR) {
-				print_data("response: ", request->data, request->length, false);
-				response_received = true;
+			print_data("response: ", frame, length, false);
+			response_received = true;
+			fw_retry_forget(&retry, 0);
+		}
+	}
+}
+
+/*
+ * In an FCP session, frames are read from the input one per line and sent
+ * while up to queue_depth of them wait for their responses.  An AV/C response
+ * is matched to the command by its subunit and opcode, and the next command
+ * for the same pair is held back until the final response arrives; other
+ * frames are matched in order.  An INTERIM response is printed and restarts
+ * the timeout, as the final response follows later.
+ */
+static void parse_data(const char *s, struct data *data);
+
+struct fcp_command {
+	bool used;
+	unsigned int line;
+	bool avc;
+	u8 subunit;
+	u8 opcode;
+	u64 sequence;
+	struct timespec deadline;
+};
+
+static struct fcp_command *fcp_commands;
+static u64 fcp_sequence;
+
+static void set_fcp_deadline(struct fcp_command *command)
+{
+	clock_gettime(CLOCK_MONOTONIC, &command->deadline);
+	command->deadline.tv_sec += fcp_timeout / 1000;
+	command->deadline.tv_nsec += (fcp_timeout % 1000) * 1000000;
+	if (command->deadline.tv_nsec >= 1000000000) {
+		command->deadline.tv_nsec -= 1000000000;
+		++command->deadline.tv_sec;
+	}
+}
+
+/* returns the milliseconds until the earliest deadline, or -1 if none */
+static int expire_fcp_commands(void)
+{
+	struct timespec now;
+	long long earliest = -1, remaining;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < queue_depth; ++i) {
+		struct fcp_command *command = &fcp_commands[i];
+		if (!command->used)
+			continue;
+		remaining = (command->deadline.tv_sec - now.tv_sec) * 1000LL +
+			    (command->deadline.tv_nsec - now.tv_nsec) / 1000000;
+		if (remaining <= 0) {
+			fprintf(stderr, "%u: timeout\n", command->line);
+			++failures;
+			command->used = false;
+			fw_retry_forget(&retry, command->sequence);
+		} else if (earliest < 0 || remaining < earliest) {
+			earliest = remaining;
+		}
+	}
+	return earliest;
+}
+
+static struct fcp_command *find_fcp_command(bool avc, u8 subunit, u8 opcode)
+{
+	struct fcp_command *found = NULL;
+	unsigned int i;
+
+	for (i = 0; i < queue_depth; ++i) {
+		struct fcp_command *command = &fcp_commands[i];
+		if (!command->used || command->avc != avc)
+			continue;
+		if (avc && (command->subunit != subunit || command->opcode != opcode))
+			continue;
+		if (!found || command->sequence < found->sequence)
+			found = command;
+	}
+	return found;
+}
+
+static void handle_fcp_session_event(struct fw_cdev_event_common *event)
+{
+	struct fcp_command *command;
+	const u8 *frame;
+	unsigned int length, i;
+	bool avc;
+
+	if (event->type == FW_CDEV_EVENT_BUS_RESET) {
+		/* send the commands again whose responses might have been lost */
+		if (!fw_retry_resend_all(&retry)) {
+			fputs("bus reset\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < queue_depth; ++i)
+			if (fcp_commands[i].used)
+				set_fcp_deadline(&fcp_commands[i]);
+		return;
+	}
+	if (event->type == FW_CDEV_EVENT_RESPONSE) {
+		struct fw_cdev_event_response *response = (void *)event;
+		if (response->rcode == RCODE_COMPLETE ||
+		    fw_retry_resubmit(&retry, response->closure, response->rcode))
+			return;
+		for (i = 0; i < queue_depth; ++i) {
+			command = &fcp_commands[i];
+			if (command->used && command->sequence == response->closure) {
+				batch_line = command->line;
+				print_rcode(response->rcode);
+				command->used = false;
+				fw_retry_forget(&retry, command->sequence);
+			}
+		}
+		return;
+	}
+	if (!get_fcp_response(event, &frame, &length) || length < 1)
+		return;
+
+	avc = (frame[0] >> 4) == FCP_CTS_AVC;
+	if (avc && length < 3)
+		return;
+	command = find_fcp_command(avc, avc ? frame[1] : 0, avc ? frame[2] : 0);
+	if (!command)
+		return;
+
+	batch_line = command->line;
+	if (avc && (frame[0] & 0x0f) == AVC_RESPONSE_INTERIM) {
+		print_data("interim: ", frame, length, false);
+		set_fcp_deadline(command);
+	} else {
+		print_data("response: ", frame, length, false);
+		command->used = false;
+		fw_retry_forget(&retry, command->sequence);
+	}
+	fflush(stdout);
+}
+
+/* returns false if the frame must wait for an outstanding command */
+static bool submit_fcp_frame(char *line, unsigned int line_number)
+{
+	struct fcp_command *command = NULL;
+	unsigned int i;
+	bool avc;
+
+	while (isspace(*line))
+		++line;
+	if (*line == '\0' || *line == '#')
+		return true;
+
+	for (i = 0; i < queue_depth; ++i)
+		if (!fcp_commands[i].used) {
+			command = &fcp_commands[i];
+			break;
+		}
+	if (!command)
+		return false;
+
+	register_length = 0;
+	parse_data(line, &data);
+	if (data.length < 1) {
+		fprintf(stderr, "%s:%u: empty frame\n", command_file, line_number);
+		exit(EXIT_FAILURE);
+	}
+	avc = (data.data[0] >> 4) == FCP_CTS_AVC;
+	if (avc && data.length < 3) {
+		fprintf(stderr, "%s:%u: AV/C frame too short\n", command_file, line_number);
+		exit(EXIT_FAILURE);
+	}
+	if (avc && find_fcp_command(true, data.data[1], data.data[2])) {
+		free(data.data);
+		return false;
+	}
+
+	command->used = true;
+	command->line = line_number;
+	command->avc = avc;
+	command->subunit = avc ? data.data[1] : 0;
+	command->opcode = avc ? data.data[2] : 0;
+	command->sequence = ++fcp_sequence;
+	set_fcp_deadline(command);
+	send_fcp_command(command->sequence);
+	free(data.data);
+
+	return true;
+}
+
+static void do_fcp_session(void)
+{
+	static u8 buf[sizeof(struct fw_cdev_event_response) + 0x200];
+	char input[4096];
+	size_t input_length = 0;
+	unsigned int line_number = 0;
+	unsigned int i;
+	bool eof = false, blocked = false, outstanding;
+	struct pollfd pfds[2];
+	char *newline;
+	int input_fd, timeout, ready, r;
+
+	if (!strcmp(command_file, "-"))
+		input_fd = STDIN_FILENO;
+	else
+		input_fd = open(command_file, O_RDONLY);
+	if (input_fd < 0) {
+		perror(command_file);
+		exit(EXIT_FAILURE);
+	}
+
+	fcp_commands = calloc(queue_depth, sizeof(*fcp_commands));
+	if (!fcp_commands) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	allocate_fcp_response();
+
+	for (;;) {
+		/* submit the complete lines buffered so far */
+		blocked = false;
+		while ((newline = memchr(input, '\n', input_length)) ||
+		       (eof && input_length > 0)) {
+			size_t length = newline ? newline - input : input_length;
+			input[length] = '\0';
+			if (!submit_fcp_frame(input, line_number + 1)) {
+				if (newline)
+					*newline = '\n';
+				blocked = true;
+				break;
+			}
+			++line_number;
+			if (newline)
+				++length;
+			input_length -= length;
+			memmove(input, input + length, input_length);
+		}
+
+		outstanding = false;
+		for (i = 0; i < queue_depth; ++i)
+			outstanding |= fcp_commands[i].used;
+		if (eof && input_length == 0 && !outstanding)
+			break;
+
+		pfds[0].fd = fd;
+		pfds[0].events = POLLIN;
+		pfds[1].fd = input_fd;
+		pfds[1].events = POLLIN;
+		timeout = expire_fcp_commands();
+		ready = fw_stats_poll(pfds, eof || blocked ? 1 : 2, timeout);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll failed");
+			exit(EXIT_FAILURE);
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			r = fw_stats_read_event(fd, buf, sizeof buf);
+			if (r < sizeof(struct fw_cdev_event_common)) {
+				fputs("short read\n", stderr);
+				exit(EXIT_FAILURE);
 			}
+			fw_retry_handle_event(&retry, buf);
+			handle_fcp_session_event((void *)buf);
 		}
+
+		if (!eof && !blocked && (pfds[1].revents & (POLLIN | POLLHUP))) {
+			if (input_length >= sizeof(input) - 1) {
+				fprintf(stderr, "%s:%u: line too long\n", command_file, line_number + 1);
+				exit(EXIT_FAILURE);
+			}
+			r = read(input_fd, input + input_length, sizeof(input) - 1 - input_length);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				perror(command_file);
+				exit(EXIT_FAILURE);
+			}
+			if (r == 0)
+				eof = true;
+			input_length += r;
+		}
+
+		expire_fcp_commands();
+	}
+
+	free(fcp_commands);
+	if (input_fd != STDIN_FILENO)
+		close(input_fd);
+
+	if (failures) {
+		fw_retry_report(&retry);
+		exit(EXIT_FAILURE);
 	}
 }
 
@@ -396,7 +841,7 @@ static void do_bus_reset(u32 type)
 	struct fw_cdev_initiate_bus_reset reset;
 
 	reset.type = type;
-	if (ioctl(fd, FW_CDEV_IOC_INITIATE_BUS_RESET, &reset) < 0) {
+	if (fw_stats_ioctl(fd, FW_CDEV_IOC_INITIATE_BUS_RESET, &reset) < 0) {
 		perror("INITIATE_BUS_RESET ioctl failed");
 		exit(EXIT_FAILURE);
 	}
@@ -412,6 +857,14 @@ static void do_long_reset(void)
 	do_bus_reset(FW_CDEV_LONG_RESET);
 }
 
+static void do_batch(void);
+static void do_bench(void);
+static void do_bus_manager(void);
+static void do_irm(void);
+static void do_rom_dump(void);
+static void do_serve(void);
+static const struct command *bench_command;
+
 static const struct command {
 	const char *name;
 	command_func function;
@@ -419,22 +872,45 @@ static const struct command {
 	bool has_length;
 	bool has_data;
 	bool has_data2;
+	bool has_file;
+	bool has_command;
+	bool has_settings;
+	bool has_format;
+	bool has_interval;
+	bool has_ranges;
+	u32 lock_tcode;
 } commands[] = {
 	{ "read",            do_read,         .has_addr = true, .has_length = true },
 	{ "write",           do_write,        .has_addr = true, .has_data = true },
 	{ "broadcast",       do_broadcast,    .has_addr = true, .has_data = true },
-	{ "mask_swap",       do_mask_swap,    .has_addr = true, .has_data = true, .has_data2 = true },
-	{ "compare_swap",    do_compare_swap, .has_addr = true, .has_data = true, .has_data2 = true },
-	{ "add",             do_add_big,      .has_addr = true, .has_data = true },
-	{ "add_big",         do_add_big,      .has_addr = true, .has_data = true },
-	{ "add_little",      do_add_little,   .has_addr = true, .has_data = true },
-	{ "bounded_add",     do_bounded_add,  .has_addr = true, .has_data = true, .has_data2 = true },
-	{ "bounded_add_big", do_bounded_add,  .has_addr = true, .has_data = true, .has_data2 = true },
-	{ "wrap_add",        do_wrap_add,     .has_addr = true, .has_data = true, .has_data2 = true },
-	{ "wrap_add_big",    do_wrap_add,     .has_addr = true, .has_data = true, .has_data2 = true },
+	{ "mask_swap",       do_mask_swap,    .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_MASK_SWAP },
+	{ "compare_swap",    do_compare_swap, .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_COMPARE_SWAP },
+	{ "add",             do_add_big,      .has_addr = true, .has_data = true,
+	  .lock_tcode = TCODE_LOCK_FETCH_ADD },
+	{ "add_big",         do_add_big,      .has_addr = true, .has_data = true,
+	  .lock_tcode = TCODE_LOCK_FETCH_ADD },
+	{ "add_little",      do_add_little,   .has_addr = true, .has_data = true,
+	  .lock_tcode = TCODE_LOCK_LITTLE_ADD },
+	{ "bounded_add",     do_bounded_add,  .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_BOUNDED_ADD },
+	{ "bounded_add_big", do_bounded_add,  .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_BOUNDED_ADD },
+	{ "wrap_add",        do_wrap_add,     .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_WRAP_ADD },
+	{ "wrap_add_big",    do_wrap_add,     .has_addr = true, .has_data = true, .has_data2 = true,
+	  .lock_tcode = TCODE_LOCK_WRAP_ADD },
 	{ "fcp",             do_fcp,                            .has_data = true },
+	{ "fcp_session",     do_fcp_session,                    .has_file = true },
 	{ "reset",           do_reset },
 	{ "long_reset",      do_long_reset },
+	{ "batch",           do_batch,                          .has_file = true },
+	{ "bench",           do_bench,                          .has_command = true },
+	{ "bus_manager",     do_bus_manager,                    .has_settings = true },
+	{ "irm",             do_irm,                            .has_interval = true },
+	{ "rom_dump",        do_rom_dump,                       .has_format = true },
+	{ "serve",           do_serve,                          .has_ranges = true },
 };
 
 static const struct register_name {
@@ -663,41 +1139,202 @@ static void parse_data(const char *s, struct data *data)
 	data->length = len;
 }
 
-static void help(void)
+static int bm_split_timeout = -1;	/* in cycles, or -2 for the maximum */
+static int bm_priority_budget = -1;	/* or -2 for the budgets favoring SBP-2 */
+static int bm_cycle_master = -1;	/* 0 = off, 1 = on, 2 = auto */
+static unsigned int irm_interval;	/* in cycles, or 0 to read once */
+
+static int parse_setting_value(const char *s, int max)
 {
-	fputs("firewire-request <dev> read <addr> [<length>]\n"
-	      "firewire-request <dev> write <addr> <data>\n"
-	      "firewire-request <dev> <locktype> <addr> <data> [<data>]\n"
-	      "firewire-request <dev> broadcast <addr> <data>\n"
-	      "firewire-request <dev> fcp <data>\n"
-	      "firewire-request <dev> reset|long_reset\n"
-	      "\n"
-	      "<dev> is device node (/dev/fwX)\n"
-	      "<addr> is address in hex or register name\n"
-	      "<length> is byte length in hex, default from register or 4\n"
-	      "<data> is data bytes in hex (spaces must be quoted)\n"
-	      "<locktype> is mask_swap|compare_swap|add_big|add_little|bounded_add|wrap_add\n"
-	      "\n"
-	      "Options:\n"
-	      " -D,--dump-register-names  show known register names and exit\n"
-	      " -v,--verbose              more information\n"
-	      " -h,--help                 show this message and exit\n"
-	      " -V,--version              show version number and exit\n"
-	      "\n"
-	      "Report bugs to <" PACKAGE_BUGREPORT ">.\n"
-	      PACKAGE_NAME " home page: <" PACKAGE_URL ">.\n",
-	      stderr);
+	char *endptr;
+	unsigned long int l;
+
+	l = strtoul(s, &endptr, 16);
+	if (*endptr != '\0' || l > (unsigned long int)max)
+		return -1;
+	return l;
 }
 
-static void help_registers(void)
-{
-	unsigned int i;
+/*
+ * In serve mode, each address range is backed by a buffer, or by a file that
+ * is mapped into memory, and read, write and lock requests to it are answered
+ * from there.
+ */
+#define SERVE_MAX_RANGES	16
 
-	puts("address    length name");
-	for (i = 0; i < ARRAY_SIZE(register_names); ++i) {
-		bool hi_lo;
-		if (register_names[i].hide && !verbose)
-			continue;
+enum { SERVE_READS, SERVE_WRITES, SERVE_LOCKS, SERVE_ERRORS, SERVE_COUNTERS };
+
+struct serve_range {
+	u64 offset;
+	unsigned int length;
+	const char *file;
+	u8 *buf;
+	unsigned long long counts[SERVE_COUNTERS];
+	unsigned long long reported[SERVE_COUNTERS];
+};
+
+static struct serve_range serve_ranges[SERVE_MAX_RANGES];
+static unsigned int serve_range_count;
+
+/*
+ * Parses the <addr>[,<length>[,<file>]] ranges of serve.  The length defaults
+ * to that of the register, or of the file.  Returns false on syntax error.
+ */
+static bool parse_ranges(int argc, char *argv[], int index)
+{
+	struct serve_range *range;
+	struct stat st;
+	char *arg, *length, *file, *endptr;
+	unsigned long long l;
+
+	serve_range_count = 0;
+	if (index >= argc)
+		return false;
+	for (; index < argc; ++index) {
+		if (serve_range_count >= SERVE_MAX_RANGES) {
+			fprintf(stderr, "too many ranges: `%s'\n", argv[index]);
+			return false;
+		}
+		arg = strdup(argv[index]);
+		if (!arg) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		length = strchr(arg, ',');
+		file = NULL;
+		if (length) {
+			*length++ = '\0';
+			file = strchr(length, ',');
+			if (file)
+				*file++ = '\0';
+		}
+
+		range = &serve_ranges[serve_range_count++];
+		register_length = 0;
+		parse_address(arg);
+		range->offset = address;
+		range->file = file && *file ? file : NULL;
+		if (length && *length) {
+			l = strtoull(length, &endptr, 16);
+			if (*endptr != '\0' || l == 0 || l > 0xffffffffuLL ||
+			    range->offset + l > 0x1000000000000uLL) {
+				fprintf(stderr, "invalid length: `%s'\n", length);
+				return false;
+			}
+			range->length = l;
+		} else if (register_length) {
+			range->length = register_length;
+		} else if (range->file && stat(range->file, &st) == 0 && st.st_size > 0 &&
+			   st.st_size <= 0xffffffff) {
+			range->length = st.st_size;
+		} else {
+			fprintf(stderr, "missing length: `%s'\n", argv[index]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Parses the name/value pairs of bus_manager.  Returns false on syntax error. */
+static bool parse_settings(int argc, char *argv[], int index)
+{
+	bm_split_timeout = -1;
+	bm_priority_budget = -1;
+	bm_cycle_master = -1;
+	for (; index < argc; index += 2) {
+		if (index + 1 >= argc) {
+			fprintf(stderr, "missing value for `%s'\n", argv[index]);
+			return false;
+		}
+		if (!strcasecmp(argv[index], "split_timeout")) {
+			if (!strcasecmp(argv[index + 1], "max"))
+				bm_split_timeout = -2;
+			else
+				bm_split_timeout = parse_setting_value(argv[index + 1], 8 * 8000 - 1);
+			if (bm_split_timeout == -1) {
+				fprintf(stderr, "invalid split timeout: `%s'\n", argv[index + 1]);
+				return false;
+			}
+		} else if (!strcasecmp(argv[index], "priority_budget")) {
+			if (!strcasecmp(argv[index + 1], "sbp"))
+				bm_priority_budget = -2;
+			else
+				bm_priority_budget = parse_setting_value(argv[index + 1], 0x3f);
+			if (bm_priority_budget == -1) {
+				fprintf(stderr, "invalid priority budget: `%s'\n", argv[index + 1]);
+				return false;
+			}
+		} else if (!strcasecmp(argv[index], "cycle_master")) {
+			if (!strcasecmp(argv[index + 1], "off"))
+				bm_cycle_master = 0;
+			else if (!strcasecmp(argv[index + 1], "on"))
+				bm_cycle_master = 1;
+			else if (!strcasecmp(argv[index + 1], "auto"))
+				bm_cycle_master = 2;
+			else {
+				fprintf(stderr, "invalid cycle master setting: `%s'\n", argv[index + 1]);
+				return false;
+			}
+		} else {
+			fprintf(stderr, "unknown setting: `%s'\n", argv[index]);
+			return false;
+		}
+	}
+	return true;
+}
+
+static void help(void)
+{
+	fputs("firewire-request <dev> read <addr> [<length>]\n"
+	      "firewire-request <dev> write <addr> <data>\n"
+	      "firewire-request <dev> <locktype> <addr> <data> [<data>]\n"
+	      "firewire-request <dev> broadcast <addr> <data>\n"
+	      "firewire-request <dev> fcp <data>\n"
+	      "firewire-request <dev> fcp_session [<file>]\n"
+	      "firewire-request <dev> reset|long_reset\n"
+	      "firewire-request <dev> batch [<file>]\n"
+	      "firewire-request <dev> bench read|write|<locktype> <parameters>\n"
+	      "firewire-request <dev> bus_manager [<setting> <value>]...\n"
+	      "firewire-request <dev> irm [<cycles>]\n"
+	      "firewire-request <dev> rom_dump [text|json|binary]\n"
+	      "firewire-request <dev> serve <addr>[,<length>[,<file>]]...\n"
+	      "\n"
+	      "<dev> is device node (/dev/fwX)\n"
+	      "<addr> is address in hex or register name\n"
+	      "<length> is byte length in hex, default from register or 4\n"
+	      "<data> is data bytes in hex (spaces must be quoted)\n"
+	      "<locktype> is mask_swap|compare_swap|add_big|add_little|bounded_add|wrap_add\n"
+	      "<file> has one command (batch) or frame (fcp_session) per line, default stdin\n"
+	      "       or holds the content of a serve range, default memory\n"
+	      "<setting> is split_timeout <cycles>|max, priority_budget <n>|sbp,\n"
+	      "          or cycle_master on|off|auto\n"
+	      "<cycles> is number of 125 us cycles in hex\n"
+	      "\n"
+	      "Options:\n"
+	      " -D,--dump-register-names  show known register names and exit\n"
+	      " -p,--max-payload=<bytes>  split reads into requests of <bytes>, default 512\n"
+	      " -q,--queue-depth=<n>      keep up to <n> requests outstanding, default 4\n"
+	      " -t,--timeout=<ms>         wait for FCP responses for <ms>, default 2345\n"
+	      " -n,--count=<n>            run bench transaction <n> times, default 1000\n"
+	      " -v,--verbose              more information\n"
+	      "    --stats                print time spent in system calls at exit\n"
+	      " -h,--help                 show this message and exit\n"
+	      " -V,--version              show version number and exit\n"
+	      "\n"
+	      "Report bugs to <" PACKAGE_BUGREPORT ">.\n"
+	      PACKAGE_NAME " home page: <" PACKAGE_URL ">.\n",
+	      stderr);
+}
+
+static void help_registers(void)
+{
+	unsigned int i;
+
+	puts("address    length name");
+	for (i = 0; i < ARRAY_SIZE(register_names); ++i) {
+		bool hi_lo;
+		if (register_names[i].hide && !verbose)
+			continue;
 		hi_lo = !verbose && i < ARRAY_SIZE(register_names) - 2 &&
 			register_names[i].address == register_names[i + 1].address;
 		printf("%012Lx %4x %s%s\n", register_names[i].address,
@@ -708,12 +1345,1506 @@ static void help_registers(void)
 	}
 }
 
+/*
+ * Parses the command and its parameters in argv[index..argc-1] into the global
+ * variables.  Returns NULL on syntax error.
+ */
+static const struct command *parse_command(int argc, char *argv[], int index)
+{
+	const struct command *command;
+	unsigned int i;
+
+	if (index >= argc)
+		return NULL;
+	for (i = 0; i < ARRAY_SIZE(commands); ++i)
+		if (!strcasecmp(argv[index], commands[i].name)) {
+			command = &commands[i];
+			goto command_found;
+		}
+	fprintf(stderr, "unknown command: `%s'\n", argv[index]);
+	return NULL;
+command_found:
+	++index;
+
+	register_length = 0;
+
+	if (command->has_addr) {
+		if (index >= argc)
+			return NULL;
+		parse_address(argv[index++]);
+	}
+
+	if (command->has_length) {
+		if (index < argc)
+			parse_read_length(argv[index++]);
+		else if (register_length)
+			read_length = register_length;
+		else
+			read_length = 4;
+	}
+
+	if (command->has_data) {
+		if (index >= argc)
+			return NULL;
+		parse_data(argv[index++], &data);
+	}
+
+	if (command->has_data2) {
+		if (index >= argc)
+			return NULL;
+		parse_data(argv[index++], &data2);
+	}
+
+	if (command->has_file)
+		command_file = index < argc ? argv[index++] : "-";
+
+	if (command->has_command) {
+		bench_command = parse_command(argc, argv, index);
+		return bench_command ? command : NULL;
+	}
+
+	if (command->has_settings)
+		return parse_settings(argc, argv, index) ? command : NULL;
+
+	if (command->has_ranges)
+		return parse_ranges(argc, argv, index) ? command : NULL;
+
+	if (command->has_interval) {
+		irm_interval = 0;
+		if (index < argc) {
+			irm_interval = parse_setting_value(argv[index++], 0xffffff);
+			if (irm_interval == -1u || irm_interval == 0) {
+				fprintf(stderr, "invalid interval: `%s'\n", argv[index - 1]);
+				return NULL;
+			}
+		}
+	}
+
+	if (command->has_format) {
+		rom_format = config_rom_find_format(index < argc ? argv[index++] : "text");
+		if (!rom_format) {
+			fprintf(stderr, "unknown format: `%s'\n", argv[index - 1]);
+			return NULL;
+		}
+	}
+
+	if (index < argc) {
+		fprintf(stderr, "superfluous parameter: `%s'\n", argv[index]);
+		return NULL;
+	}
+
+	return command;
+}
+
+#define BATCH_MAX_ARGS	8
+
+/*
+ * In batch mode, reads, writes and lock requests are sent without waiting for
+ * the responses of the previous ones, unless their address ranges overlap and
+ * one of them changes the register.  Anything else waits for all outstanding
+ * requests.  Results are printed in the order of the commands, prefixed with
+ * the line number.
+ */
+struct batch_job {
+	const struct command *command;
+	unsigned int line;
+	u64 address;
+	unsigned int length;
+	bool modifies;
+	bool done;
+	u32 rcode;
+	unsigned int result_length;
+	u8 *result;
+};
+
+static struct batch_job *batch_jobs;
+static unsigned int batch_head, batch_count;
+
+static int split_line(char *line, char *args[], int max_args)
+{
+	char *p = line, *q;
+	char quote;
+	int count = 0;
+
+	for (;;) {
+		while (isspace(*p))
+			++p;
+		if (*p == '\0' || *p == '#')
+			return count;
+		if (count >= max_args)
+			return -1;
+		args[count++] = q = p;
+		while (*p != '\0' && !isspace(*p)) {
+			if (*p == '"' || *p == '\'') {
+				quote = *p++;
+				while (*p != '\0' && *p != quote)
+					*q++ = *p++;
+				if (*p == '\0')
+					return -1;
+				++p;
+			} else {
+				*q++ = *p++;
+			}
+		}
+		if (*p != '\0')
+			++p;
+		*q = '\0';
+	}
+}
+
+static void report_batch_job(struct batch_job *job)
+{
+	batch_line = job->line;
+	if (job->command->lock_tcode)
+		report_lock(job->rcode, job->result, job->result_length);
+	else if (job->command->function == do_read)
+		report_read(job->rcode, job->result, job->result_length, job->length);
+	else if (job->rcode != RCODE_COMPLETE)
+		print_rcode(job->rcode);
+	fflush(stdout);
+	free(job->result);
+	job->result = NULL;
+}
+
+static void receive_batch_response(void)
+{
+	struct fw_cdev_event_response *response;
+	struct batch_job *job;
+
+	response = wait_for_response();
+	job = &batch_jobs[response->closure];
+	job->rcode = response->rcode;
+	job->result_length = response->length;
+	if (response->length > 0) {
+		job->result = malloc(response->length);
+		if (!job->result) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(job->result, response->data, response->length);
+	}
+	job->done = true;
+
+	while (batch_count > 0 && batch_jobs[batch_head].done) {
+		report_batch_job(&batch_jobs[batch_head]);
+		batch_head = (batch_head + 1) % queue_depth;
+		--batch_count;
+	}
+}
+
+static bool batch_job_conflicts(const struct batch_job *job)
+{
+	const struct batch_job *other;
+	unsigned int i;
+
+	for (i = 0; i < batch_count; ++i) {
+		other = &batch_jobs[(batch_head + i) % queue_depth];
+		if (!other->done && (job->modifies || other->modifies) &&
+		    job->address < other->address + other->length &&
+		    other->address < job->address + job->length)
+			return true;
+	}
+	return false;
+}
+
+static void queue_batch_job(const struct command *command, unsigned int line)
+{
+	struct fw_cdev_send_request send_request;
+	struct batch_job pending;
+	unsigned int slot;
+	u8 *buf = NULL;
+
+	if (command->lock_tcode) {
+		buf = prepare_lock(&send_request, command->lock_tcode);
+		if (buf == data.data)
+			buf = NULL;
+	} else if (command->function == do_read) {
+		prepare_read(&send_request);
+	} else {
+		prepare_write(&send_request);
+	}
+
+	pending.command = command;
+	pending.line = line;
+	pending.address = address;
+	pending.length = command->function == do_read ? read_length : data.length;
+	pending.modifies = command->function != do_read;
+	pending.done = false;
+	pending.rcode = 0;
+	pending.result_length = 0;
+	pending.result = NULL;
+
+	while (batch_count >= queue_depth || batch_job_conflicts(&pending))
+		receive_batch_response();
+
+	slot = (batch_head + batch_count) % queue_depth;
+	batch_jobs[slot] = pending;
+
+	send_request.closure = slot;
+	fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+	++batch_count;
+
+	free(buf);
+}
+
+static void do_batch(void)
+{
+	const struct command *command;
+	char *args[BATCH_MAX_ARGS];
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned int line_number = 0;
+	FILE *file;
+	int count;
+
+	if (!strcmp(command_file, "-"))
+		file = stdin;
+	else
+		file = fopen(command_file, "r");
+	if (!file) {
+		perror(command_file);
+		exit(EXIT_FAILURE);
+	}
+
+	batch_jobs = calloc(queue_depth, sizeof(*batch_jobs));
+	if (!batch_jobs) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	while (getline(&line, &line_size, file) >= 0) {
+		++line_number;
+		count = split_line(line, args, ARRAY_SIZE(args));
+		if (count == 0)
+			continue;
+		command = count > 0 ? parse_command(count, args, 0) : NULL;
+		if (!command || command->function == do_batch) {
+			fprintf(stderr, "%s:%u: invalid command\n", command_file, line_number);
+			exit(EXIT_FAILURE);
+		}
+		/* these run until interrupted, so the following lines would never run */
+		if (command->function == do_serve ||
+		    (command->function == do_irm && irm_interval)) {
+			fprintf(stderr, "%s:%u: command does not return in batch mode\n",
+				command_file, line_number);
+			exit(EXIT_FAILURE);
+		}
+
+		if (command->lock_tcode ||
+		    (command->function == do_read && read_length <= max_payload) ||
+		    command->function == do_write) {
+			queue_batch_job(command, line_number);
+		} else {
+			while (batch_count > 0)
+				receive_batch_response();
+			batch_line = line_number;
+			command->function();
+			fflush(stdout);
+		}
+
+		if (command->has_data)
+			free(data.data);
+		if (command->has_data2)
+			free(data2.data);
+	}
+	while (batch_count > 0)
+		receive_batch_response();
+
+	free(line);
+	free(batch_jobs);
+	if (file != stdin)
+		fclose(file);
+
+	if (failures) {
+		fw_retry_report(&retry);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Runs the read, write or lock request of bench_command bench_count times with
+ * up to queue_depth of them outstanding, and prints the throughput, the
+ * distribution of the latencies measured by CLOCK_MONOTONIC from submission
+ * to response, and the count of each rcode.
+ */
+#define RCODE_COUNT	0x20
+
+static u64 monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000uLL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void do_bench(void)
+{
+	const struct command *command = bench_command;
+	struct fw_cdev_send_request send_request;
+	struct fw_cdev_event_response *response;
+	unsigned int rcodes[RCODE_COUNT] = { 0 };
+	unsigned int sent, received, outstanding, payload, i;
+	u64 *latencies, start, elapsed, sum;
+	double seconds;
+
+	if (command->lock_tcode) {
+		prepare_lock(&send_request, command->lock_tcode);
+		payload = data.length;
+	} else if (command->function == do_read && read_length <= max_payload) {
+		prepare_read(&send_request);
+		payload = read_length;
+	} else if (command->function == do_write) {
+		prepare_write(&send_request);
+		payload = data.length;
+	} else {
+		fputs("bench supports read, write and lock requests only\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	latencies = malloc(bench_count * sizeof(*latencies));
+	if (!latencies) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	start = monotonic_ns();
+	sent = 0;
+	received = 0;
+	outstanding = 0;
+	while (received < bench_count) {
+		while (outstanding < queue_depth && sent < bench_count) {
+			send_request.closure = sent;
+			latencies[sent] = monotonic_ns();
+			fw_retry_send_request(&retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+			++sent;
+			++outstanding;
+		}
+
+		response = wait_for_response();
+		latencies[response->closure] = monotonic_ns() - latencies[response->closure];
+		++rcodes[response->rcode < RCODE_COUNT ? response->rcode : RCODE_COUNT - 1];
+		++received;
+		--outstanding;
+	}
+	elapsed = monotonic_ns() - start;
+
+	qsort(latencies, bench_count, sizeof(*latencies), compare_u64);
+	sum = 0;
+	for (i = 0; i < bench_count; ++i)
+		sum += latencies[i];
+	seconds = elapsed / 1e9;
+
+	printf("transactions: %u in %.6f s, %u failed\n",
+	       bench_count, seconds, bench_count - rcodes[RCODE_COMPLETE]);
+	printf("throughput: %.1f transactions/s, %.1f KiB/s\n",
+	       bench_count / seconds, (double)rcodes[RCODE_COMPLETE] * payload / 1024 / seconds);
+	printf("latency (us): min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+	       latencies[0] / 1e3, (double)sum / bench_count / 1e3,
+	       latencies[(bench_count - 1) / 2] / 1e3,
+	       latencies[(bench_count * 99 - 1) / 100] / 1e3,
+	       latencies[bench_count - 1] / 1e3);
+	for (i = 0; i < RCODE_COUNT; ++i)
+		if (rcodes[i])
+			printf("rcode %s: %u\n",
+			       i == RCODE_COMPLETE ? "complete" : rcode_name(i), rcodes[i]);
+
+	free(latencies);
+}
+
+/*
+ * Reads the registers that a bus manager is responsible for from all nodes on
+ * the bus of the device, with all requests outstanding at the same time,
+ * reports inconsistencies, and then writes the new settings in one batch.
+ */
+enum {
+	BM_SPLIT_TIMEOUT_HI,
+	BM_SPLIT_TIMEOUT_LO,
+	BM_BUSY_TIMEOUT,
+	BM_STATE,
+	BM_PRIORITY_BUDGET,
+	BM_BANDWIDTH_AVAILABLE,
+	BM_CHANNELS_AVAILABLE_HI,
+	BM_CHANNELS_AVAILABLE_LO,
+	BM_REGISTER_COUNT
+};
+
+static const struct bm_register {
+	u64 address;
+	const char *name;
+	bool irm_only;
+} bm_registers[BM_REGISTER_COUNT] = {
+	[BM_SPLIT_TIMEOUT_HI]      = { CSR_SPLIT_TIMEOUT_HI, "split_timeout_hi" },
+	[BM_SPLIT_TIMEOUT_LO]      = { CSR_SPLIT_TIMEOUT_LO, "split_timeout_lo" },
+	[BM_BUSY_TIMEOUT]          = { CSR_BUSY_TIMEOUT, "busy_timeout" },
+	[BM_STATE]                 = { CSR_STATE_CLEAR, "state" },
+	[BM_PRIORITY_BUDGET]       = { CSR_PRIORITY_BUDGET, "priority_budget" },
+	[BM_BANDWIDTH_AVAILABLE]   = { CSR_BANDWIDTH_AVAILABLE, "bandwidth_available", true },
+	[BM_CHANNELS_AVAILABLE_HI] = { CSR_CHANNELS_AVAILABLE, "channels_available_hi", true },
+	[BM_CHANNELS_AVAILABLE_LO] = { CSR_CHANNELS_AVAILABLE + 4, "channels_available_lo", true },
+};
+
+struct bus_node {
+	struct fw_device *device;
+	bool is_local;
+	bool is_irm;
+	bool is_root;
+	bool sbp2;
+	struct fw_retry retry;
+	unsigned int pending;
+	u32 values[BM_REGISTER_COUNT];
+	u32 rcodes[BM_REGISTER_COUNT];
+};
+
+static struct bus_node *bus_nodes;
+static unsigned int bus_node_count;
+
+static bool rom_has_sbp2_unit(const u32 *rom, unsigned int quadlets)
+{
+	unsigned int i;
+
+	/* a Unit_Spec_ID entry with the SBP-2 specifier ID */
+	for (i = 5; i < quadlets; ++i)
+		if (rom[i] == 0x1200609e)
+			return true;
+	return false;
+}
+
+/* Opens the device files of all nodes on the bus of the device. */
+static void open_bus_nodes(void)
+{
+	struct fw_cdev_get_info get_info;
+	struct fw_cdev_event_bus_reset bus_reset;
+	struct fw_device *other;
+	struct bus_node *node;
+	u32 rom[256];
+	unsigned int i;
+
+	bus_nodes = calloc(devices.count, sizeof(*bus_nodes));
+	if (!bus_nodes) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < devices.count; ++i) {
+		other = devices.devices[i];
+		if (!fw_device_probe(&devices, other) || other->card != card_index)
+			continue;
+
+		/* the whole configuration ROM, and the current generation */
+		get_info.version = devices.version;
+		get_info.rom_length = sizeof(rom);
+		get_info.rom = ptr_to_u64(rom);
+		get_info.bus_reset = ptr_to_u64(&bus_reset);
+		get_info.bus_reset_closure = 0;
+		if (fw_stats_ioctl(other->fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0)
+			continue;
+		if (bus_reset.generation != device->generation) {
+			fputs("bus reset while opening the nodes\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+
+		node = &bus_nodes[bus_node_count++];
+		node->device = other;
+		node->is_local = bus_reset.node_id == bus_reset.local_node_id;
+		node->is_irm = bus_reset.node_id == device->bus_reset.irm_node_id;
+		node->is_root = bus_reset.node_id == device->bus_reset.root_node_id;
+		node->sbp2 = rom_has_sbp2_unit(rom, get_info.rom_length / 4 < ARRAY_SIZE(rom) ?
+						    get_info.rom_length / 4 : ARRAY_SIZE(rom));
+		fw_retry_init(&node->retry, other->fd, bus_reset.generation, bus_reset.node_id);
+	}
+}
+
+static void close_bus_nodes(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < bus_node_count; ++i) {
+		fw_retry_report(&bus_nodes[i].retry);
+		fw_retry_release(&bus_nodes[i].retry);
+	}
+	free(bus_nodes);
+	bus_nodes = NULL;
+	bus_node_count = 0;
+}
+
+static void bm_send(struct bus_node *node, unsigned int reg, u32 tcode, u64 address, u32 value)
+{
+	struct fw_cdev_send_request send_request;
+	u32 quadlet = __cpu_to_be32(value);
+
+	send_request.tcode = tcode;
+	send_request.length = 4;
+	send_request.offset = address;
+	send_request.closure = reg;
+	send_request.data = tcode == TCODE_WRITE_QUADLET_REQUEST ? ptr_to_u64(&quadlet) : 0;
+	send_request.generation = node->retry.generation;
+	fw_retry_send_request(&node->retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+	++node->pending;
+}
+
+/* Waits for the responses to all requests sent with bm_send(). */
+static void bm_wait(void)
+{
+	u8 buf[sizeof(struct fw_cdev_event_response) + 16];
+	struct fw_cdev_event_response *response = (void *)buf;
+	struct pollfd *pfds;
+	struct bus_node *node;
+	unsigned int i, pending;
+	int ready;
+
+	pfds = calloc(bus_node_count, sizeof(*pfds));
+	if (!pfds) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	for (;;) {
+		pending = 0;
+		for (i = 0; i < bus_node_count; ++i) {
+			pfds[i].fd = bus_nodes[i].pending ? bus_nodes[i].device->fd : -1;
+			pfds[i].events = POLLIN;
+			pending += bus_nodes[i].pending;
+		}
+		if (!pending)
+			break;
+		ready = fw_stats_poll(pfds, bus_node_count, FW_RETRY_WAIT);
+		if (ready < 0) {
+			perror("poll failed");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < bus_node_count; ++i) {
+			node = &bus_nodes[i];
+			/* on timeout, lets requests waiting for a bus reset be reissued */
+			if (!node->pending || (ready && !(pfds[i].revents & POLLIN)))
+				continue;
+			if (!fw_retry_read_event(&node->retry, buf, sizeof(buf), 0) ||
+			    response->type != FW_CDEV_EVENT_RESPONSE ||
+			    fw_retry_resubmit(&node->retry, response->closure, response->rcode))
+				continue;
+			fw_retry_forget(&node->retry, response->closure);
+			node->rcodes[response->closure] = response->rcode;
+			if (response->rcode == RCODE_COMPLETE && response->length == 4)
+				node->values[response->closure] = __be32_to_cpu(*(u32 *)response->data);
+			--node->pending;
+		}
+	}
+	free(pfds);
+}
+
+static bool bm_valid(const struct bus_node *node, unsigned int reg)
+{
+	return (!bm_registers[reg].irm_only || node->is_irm) &&
+	       node->rcodes[reg] == RCODE_COMPLETE;
+}
+
+/* returns the SPLIT_TIMEOUT of the node in cycles, or -1 if unknown */
+static int bm_split_timeout_cycles(const struct bus_node *node)
+{
+	unsigned int cycles;
+
+	if (!bm_valid(node, BM_SPLIT_TIMEOUT_HI) || !bm_valid(node, BM_SPLIT_TIMEOUT_LO))
+		return -1;
+	cycles = node->values[BM_SPLIT_TIMEOUT_LO] >> 19;
+	if (cycles > 7999)
+		cycles = 7999;
+	return (node->values[BM_SPLIT_TIMEOUT_HI] & 7) * 8000 + cycles;
+}
+
+static void print_bm_register(const struct bus_node *node, unsigned int reg)
+{
+	printf(" %s ", bm_registers[reg].name);
+	if (bm_valid(node, reg))
+		printf("%08x", node->values[reg]);
+	else
+		fputs(rcode_name(node->rcodes[reg]), stdout);
+}
+
+static void do_bus_manager(void)
+{
+	struct bus_node *node, *irm = NULL, *root = NULL;
+	unsigned int i, reg, budget, sbp2_count = 0;
+	int cycles, min_cycles = -1, max_cycles = -1, target;
+	bool cycle_master_needed;
+
+	open_bus_nodes();
+	for (i = 0; i < bus_node_count; ++i) {
+		node = &bus_nodes[i];
+		if (node->is_irm)
+			irm = node;
+		if (node->is_root)
+			root = node;
+		if (node->sbp2)
+			++sbp2_count;
+		for (reg = 0; reg < BM_REGISTER_COUNT; ++reg) {
+			node->rcodes[reg] = RCODE_CANCELLED;
+			if (!bm_registers[reg].irm_only || node->is_irm)
+				bm_send(node, reg, TCODE_READ_QUADLET_REQUEST,
+					bm_registers[reg].address, 0);
+		}
+	}
+	bm_wait();
+
+	for (i = 0; i < bus_node_count; ++i) {
+		node = &bus_nodes[i];
+		printf("%s: node %04x%s%s%s%s", node->device->name, node->retry.node_id,
+		       node->is_local ? " local" : "", node->is_root ? " root" : "",
+		       node->is_irm ? " irm" : "", node->sbp2 ? " sbp2" : "");
+		cycles = bm_split_timeout_cycles(node);
+		if (cycles >= 0) {
+			printf(" split_timeout %u.%03u ms", cycles / 8, cycles % 8 * 125);
+			if (min_cycles < 0 || cycles < min_cycles)
+				min_cycles = cycles;
+			if (cycles > max_cycles)
+				max_cycles = cycles;
+		} else {
+			fputs(" split_timeout unknown", stdout);
+		}
+		print_bm_register(node, BM_BUSY_TIMEOUT);
+		if (node->is_root && bm_valid(node, BM_STATE))
+			printf(" cycle_master %s",
+			       node->values[BM_STATE] & CSR_STATE_BIT_CMSTR ? "on" : "off");
+		/* PRIORITY_BUDGET is optional */
+		if (node->rcodes[BM_PRIORITY_BUDGET] != RCODE_ADDRESS_ERROR)
+			print_bm_register(node, BM_PRIORITY_BUDGET);
+		if (node->is_irm)
+			for (reg = BM_BANDWIDTH_AVAILABLE; reg < BM_REGISTER_COUNT; ++reg)
+				print_bm_register(node, reg);
+		putchar('\n');
+	}
+	if (min_cycles != max_cycles)
+		puts("split_timeout is inconsistent");
+
+	/* the new settings; nodes without a readable SPLIT_TIMEOUT are left alone */
+	target = bm_split_timeout == -2 ? max_cycles : bm_split_timeout;
+	for (i = 0; i < bus_node_count && target >= 0; ++i) {
+		node = &bus_nodes[i];
+		cycles = bm_split_timeout_cycles(node);
+		if (cycles < 0 || cycles == target)
+			continue;
+		bm_send(node, BM_SPLIT_TIMEOUT_HI, TCODE_WRITE_QUADLET_REQUEST,
+			CSR_SPLIT_TIMEOUT_HI, target / 8000);
+		bm_send(node, BM_SPLIT_TIMEOUT_LO, TCODE_WRITE_QUADLET_REQUEST,
+			CSR_SPLIT_TIMEOUT_LO, (target % 8000) << 19);
+	}
+
+	/*
+	 * PRIORITY_BUDGET is the number of priority arbitrations that the link of
+	 * the node itself may use in each fairness interval (FairnessControl of
+	 * OHCI), so it is written to the SBP-2 nodes, which move the data with
+	 * their own requests, and to the local node, their initiator, which answers
+	 * them.  By default, each SBP-2 node gets one, and the local node one for
+	 * each SBP-2 node.  Nodes that did not return the register are skipped.
+	 */
+	for (i = 0; i < bus_node_count && bm_priority_budget != -1; ++i) {
+		node = &bus_nodes[i];
+		if (!(node->sbp2 || node->is_local) || !bm_valid(node, BM_PRIORITY_BUDGET))
+			continue;
+		if (bm_priority_budget >= 0)
+			budget = bm_priority_budget;
+		else if (node->is_local)
+			budget = sbp2_count < 0x3f ? sbp2_count : 0x3f;
+		else
+			budget = 1;
+		bm_send(node, BM_PRIORITY_BUDGET, TCODE_WRITE_QUADLET_REQUEST, CSR_PRIORITY_BUDGET,
+			budget);
+		if (verbose)
+			printf("%s: priority_budget %u\n", node->device->name, budget);
+	}
+
+	if (bm_cycle_master != -1) {
+		if (!root) {
+			fputs("root node not found\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		/* isochronous traffic needs cycle start packets */
+		cycle_master_needed = bm_cycle_master == 1 ||
+			(bm_cycle_master == 2 &&
+			 (!irm || !bm_valid(irm, BM_BANDWIDTH_AVAILABLE) ||
+			  irm->values[BM_BANDWIDTH_AVAILABLE] < BANDWIDTH_AVAILABLE_INITIAL));
+		bm_send(root, BM_STATE, TCODE_WRITE_QUADLET_REQUEST,
+			cycle_master_needed ? CSR_STATE_SET : CSR_STATE_CLEAR,
+			CSR_STATE_BIT_CMSTR);
+		if (verbose)
+			printf("cycle_master %s\n", cycle_master_needed ? "on" : "off");
+	}
+
+	for (i = 0; i < bus_node_count; ++i)
+		for (reg = 0; reg < BM_REGISTER_COUNT; ++reg)
+			bus_nodes[i].rcodes[reg] = RCODE_COMPLETE;
+	bm_wait();
+	for (i = 0; i < bus_node_count; ++i)
+		for (reg = 0; reg < BM_REGISTER_COUNT; ++reg)
+			if (bus_nodes[i].rcodes[reg] != RCODE_COMPLETE) {
+				fprintf(stderr, "%s: writing %s failed: %s\n", bus_nodes[i].device->name,
+					bm_registers[reg].name, rcode_name(bus_nodes[i].rcodes[reg]));
+				++failures;
+			}
+
+	close_bus_nodes();
+	if (failures)
+		exit(EXIT_FAILURE);
+}
+
+/*
+ * The registers of the isochronous resource manager, i.e., of the node with
+ * the irm_node_id of the last bus reset, are read from its device file.  With
+ * an interval, they are sampled until interrupted, and a line is printed
+ * whenever they change.  Each sample is stamped with the cycle timer of the
+ * card, and the next one is read the given number of cycles later.
+ */
+#define BANDWIDTH_AVAILABLE_MASK	0x1fff
+
+
+static struct bus_node *find_irm(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < bus_node_count; ++i)
+		if (bus_nodes[i].is_irm)
+			return &bus_nodes[i];
+	fputs("IRM not found\n", stderr);
+	exit(EXIT_FAILURE);
+}
+
+/* Opens the nodes again after a bus reset, because the IRM may have changed. */
+static void reopen_bus_nodes(void)
+{
+	struct fw_cdev_get_info get_info;
+	unsigned int i;
+
+	for (i = 0; i < bus_node_count; ++i)
+		fw_retry_release(&bus_nodes[i].retry);
+	free(bus_nodes);
+	bus_nodes = NULL;
+	bus_node_count = 0;
+
+	memset(&get_info, 0, sizeof(get_info));
+	get_info.version = devices.version;
+	get_info.bus_reset = ptr_to_u64(&device->bus_reset);
+	if (fw_stats_ioctl(fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
+		perror("GET_INFO ioctl failed");
+		exit(EXIT_FAILURE);
+	}
+	device->generation = device->bus_reset.generation;
+	device->node_id = device->bus_reset.node_id;
+	open_bus_nodes();
+}
+
+static void read_irm(struct bus_node *irm)
+{
+	unsigned int reg;
+
+	for (reg = BM_BANDWIDTH_AVAILABLE; reg < BM_REGISTER_COUNT; ++reg) {
+		irm->rcodes[reg] = RCODE_CANCELLED;
+		bm_send(irm, reg, TCODE_READ_QUADLET_REQUEST, bm_registers[reg].address, 0);
+	}
+	bm_wait();
+}
+
+static bool irm_changed(const struct bus_node *irm, const u32 *values, const u32 *rcodes)
+{
+	unsigned int reg;
+
+	for (reg = BM_BANDWIDTH_AVAILABLE; reg < BM_REGISTER_COUNT; ++reg)
+		if (irm->rcodes[reg] != rcodes[reg] ||
+		    (bm_valid(irm, reg) && irm->values[reg] != values[reg]))
+			return true;
+	return false;
+}
+
+/* channel 0 is the most significant bit of CHANNELS_AVAILABLE_HI; a set bit is free */
+static void print_used_channels(u32 hi, u32 lo)
+{
+	u64 available = (u64)hi << 32 | lo;
+	unsigned int channel, last;
+	bool any = false;
+
+	fputs(" channels_used ", stdout);
+	for (channel = 0; channel < 64; channel = last + 1) {
+		last = channel;
+		if (available & (1uLL << (63 - channel)))
+			continue;
+		while (last < 63 && !(available & (1uLL << (62 - last))))
+			++last;
+		printf(any ? ",%u" : "%u", channel);
+		if (last > channel)
+			printf("-%u", last);
+		any = true;
+	}
+	if (!any)
+		fputs("none", stdout);
+}
+
+static void print_irm(const struct bus_node *irm)
+{
+	unsigned int units;
+
+	printf("%s: node %04x", irm->device->name, irm->retry.node_id);
+	if (bm_valid(irm, BM_BANDWIDTH_AVAILABLE)) {
+		units = irm->values[BM_BANDWIDTH_AVAILABLE] & BANDWIDTH_AVAILABLE_MASK;
+		printf(" bandwidth_available %u", units);
+		if (units <= BANDWIDTH_AVAILABLE_INITIAL)
+			printf(" (%u used)", BANDWIDTH_AVAILABLE_INITIAL - units);
+	} else {
+		print_bm_register(irm, BM_BANDWIDTH_AVAILABLE);
+	}
+	if (bm_valid(irm, BM_CHANNELS_AVAILABLE_HI) && bm_valid(irm, BM_CHANNELS_AVAILABLE_LO)) {
+		print_used_channels(irm->values[BM_CHANNELS_AVAILABLE_HI],
+				    irm->values[BM_CHANNELS_AVAILABLE_LO]);
+	} else {
+		print_bm_register(irm, BM_CHANNELS_AVAILABLE_HI);
+		print_bm_register(irm, BM_CHANNELS_AVAILABLE_LO);
+	}
+	putchar('\n');
+}
+
+static void print_cycle_time(u32 cycle_timer)
+{
+	printf("%03u:%04u ", cycle_timer >> 25, (cycle_timer >> 12) & 0x1fff);
+}
+
+static void do_irm(void)
+{
+	struct fw_cdev_get_cycle_timer2 cycle_timer;
+	struct timespec next;
+	struct bus_node *irm;
+	u32 values[BM_REGISTER_COUNT], rcodes[BM_REGISTER_COUNT];
+	unsigned int bus_resets;
+	u64 ns;
+	bool first = true;
+
+	open_bus_nodes();
+	irm = find_irm();
+	if (!irm_interval) {
+		read_irm(irm);
+		print_irm(irm);
+		close_bus_nodes();
+		return;
+	}
+
+	for (;;) {
+		cycle_timer.clk_id = CLOCK_MONOTONIC;
+		if (fw_stats_ioctl(fd, FW_CDEV_IOC_GET_CYCLE_TIMER2, &cycle_timer) < 0) {
+			perror("GET_CYCLE_TIMER2 ioctl failed");
+			exit(EXIT_FAILURE);
+		}
+		bus_resets = irm->retry.bus_resets;
+		read_irm(irm);
+		if (irm->retry.bus_resets != bus_resets) {
+			/* the values may be from a node that is no longer the IRM */
+			print_cycle_time(cycle_timer.cycle_timer);
+			puts("bus reset");
+			reopen_bus_nodes();
+			irm = find_irm();
+			first = true;
+			continue;
+		}
+		if (first || irm_changed(irm, values, rcodes)) {
+			print_cycle_time(cycle_timer.cycle_timer);
+			print_irm(irm);
+			fflush(stdout);
+			memcpy(values, irm->values, sizeof(values));
+			memcpy(rcodes, irm->rcodes, sizeof(rcodes));
+			first = false;
+		}
+
+		ns = cycle_timer.tv_sec * 1000000000uLL + cycle_timer.tv_nsec +
+		     irm_interval * 125000uLL;
+		next.tv_sec = ns / 1000000000;
+		next.tv_nsec = ns % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+			;
+	}
+}
+
+/*
+ * The configuration ROMs of all nodes are read at the same time, each with up
+ * to queue_depth requests outstanding.  The first quadlet is read alone, and
+ * then the rest of the bus information block with quadlet requests; the rest
+ * of the ROM, whose length is at first taken from the crc_length of the bus
+ * information block, with block requests of max_rec bytes (but no more than
+ * max_payload), or again with quadlet requests if the node does not support
+ * block reads.  When all quadlets up to the end of the ROM known so far have
+ * been read, the directories are looked at, and the blocks they point to
+ * beyond that end are read, too.  An address error beyond the bus information
+ * block ends the ROM there.
+ */
+#define ROM_QUADLETS	(CONFIG_ROM_SIZE / 4)
+#define ROM_RETRIES	3	/* per request, when the node is busy or does not respond */
+
+#define ROM_CLOSURE(index, count)	(((index) << 16) | (count))
+#define ROM_CLOSURE_INDEX(closure)	((closure) >> 16)
+#define ROM_CLOSURE_COUNT(closure)	((closure) & 0xffff)
+
+struct rom_dump {
+	u32 quadlets[ROM_QUADLETS];	/* in host byte order */
+	bool valid[ROM_QUADLETS];
+	bool requested[ROM_QUADLETS];
+	unsigned int length;		/* in quadlets, known so far */
+	unsigned int limit;		/* in quadlets, lowered by an address error */
+	unsigned int block_quadlets;	/* 1 for quadlet requests */
+	u8 retries[ROM_QUADLETS];	/* of the request starting there */
+	u32 failed_rcode;
+	unsigned int failed_index;
+	bool failed;
+	bool done;
+};
+
+static struct rom_dump *rom_dumps;
+
+static void rom_send(struct bus_node *node, unsigned int index, unsigned int count)
+{
+	struct fw_cdev_send_request send_request;
+	unsigned int i;
+
+	send_request.tcode = count == 1 ? TCODE_READ_QUADLET_REQUEST : TCODE_READ_BLOCK_REQUEST;
+	send_request.length = count * 4;
+	send_request.offset = CSR_CONFIG_ROM + index * 4;
+	send_request.closure = ROM_CLOSURE(index, count);
+	send_request.data = 0;
+	send_request.generation = node->retry.generation;
+	fw_retry_send_request(&node->retry, FW_CDEV_IOC_SEND_REQUEST, &send_request);
+	for (i = 0; i < count; ++i)
+		rom_dumps[node - bus_nodes].requested[index + i] = true;
+	++node->pending;
+}
+
+/* Sends requests for the next quadlets that are neither read nor requested. */
+static void rom_send_more(struct bus_node *node)
+{
+	struct rom_dump *rom = &rom_dumps[node - bus_nodes];
+	unsigned int index, count;
+
+	for (index = 0; index < rom->length && node->pending < queue_depth; index += count) {
+		if (rom->valid[index] || rom->requested[index]) {
+			count = 1;
+			continue;
+		}
+		for (count = 1; count < rom->block_quadlets && index + count < rom->length; ++count)
+			if (rom->valid[index + count] || rom->requested[index + count])
+				break;
+		rom_send(node, index, count);
+	}
+}
+
+static void rom_extend(unsigned int *end, unsigned int index, unsigned int limit)
+{
+	if (index > *end)
+		*end = index < limit ? index : limit;
+}
+
+/* Returns the number of quadlets up to the end of the last known block. */
+static unsigned int rom_extent(const struct rom_dump *rom)
+{
+	unsigned int dirs[ROM_QUADLETS], dir_count = 0;
+	bool seen[ROM_QUADLETS] = { false };
+	unsigned int end = rom->length, dir, length, i, target;
+	u32 entry;
+
+	if ((rom->quadlets[0] >> 24) == 0)
+		return end;		/* a minimal ROM */
+	dir = 1 + (rom->quadlets[0] >> 24);
+	rom_extend(&end, dir + 1, rom->limit);
+	if (dir < ROM_QUADLETS) {
+		dirs[dir_count++] = dir;
+		seen[dir] = true;
+	}
+	while (dir_count > 0) {
+		dir = dirs[--dir_count];
+		if (dir >= rom->length)
+			continue;	/* its header has not been read yet */
+		length = rom->quadlets[dir] >> 16;
+		rom_extend(&end, dir + 1 + length, rom->limit);
+		for (i = dir + 1; i <= dir + length && i < rom->length; ++i) {
+			entry = rom->quadlets[i];
+			target = i + (entry & 0xffffff);
+			if (entry >> 30 < 2 || target >= ROM_QUADLETS)
+				continue;
+			rom_extend(&end, target + 1, rom->limit);
+			if (entry >> 30 == 2) {
+				if (target < rom->length)
+					rom_extend(&end, target + 1 + (rom->quadlets[target] >> 16),
+						   rom->limit);
+			} else if (!seen[target]) {
+				dirs[dir_count++] = target;
+				seen[target] = true;
+			}
+		}
+	}
+	return end;
+}
+
+static void rom_fail(struct bus_node *node, unsigned int index, u32 rcode)
+{
+	struct rom_dump *rom = &rom_dumps[node - bus_nodes];
+
+	rom->failed = true;
+	rom->failed_index = index;
+	rom->failed_rcode = rcode;
+}
+
+static void rom_handle_response(struct bus_node *node,
+				const struct fw_cdev_event_response *response)
+{
+	struct rom_dump *rom = &rom_dumps[node - bus_nodes];
+	unsigned int index = ROM_CLOSURE_INDEX(response->closure);
+	unsigned int count = ROM_CLOSURE_COUNT(response->closure);
+	unsigned int i, info_length, crc_length, max_rec;
+
+	fw_retry_forget(&node->retry, response->closure);
+	--node->pending;
+	if (rom->failed)
+		return;
+	for (i = 0; i < count; ++i)
+		rom->requested[index + i] = false;
+
+	switch (response->rcode) {
+	case RCODE_COMPLETE:
+		if (response->length != count * 4) {
+			rom_fail(node, index, RCODE_DATA_ERROR);
+			return;
+		}
+		for (i = 0; i < count; ++i) {
+			rom->quadlets[index + i] = __be32_to_cpu(((u32 *)response->data)[i]);
+			rom->valid[index + i] = true;
+		}
+		rom->retries[index] = 0;
+		break;
+	case RCODE_BUSY:
+	case RCODE_CANCELLED:
+	case RCODE_CONFLICT_ERROR:
+		/* the quadlets are requested again by rom_send_more() */
+		if (++rom->retries[index] > ROM_RETRIES)
+			rom_fail(node, index, response->rcode);
+		return;
+	case RCODE_TYPE_ERROR:
+	case RCODE_ADDRESS_ERROR:
+		if (count > 1) {
+			/* no block reads, then */
+			rom->block_quadlets = 1;
+			return;
+		}
+		/*
+		 * Beyond the bus information block, the ROM ends there; its
+		 * length or a directory entry is wrong, and what was read
+		 * before is decoded.
+		 */
+		if (response->rcode == RCODE_ADDRESS_ERROR && rom->valid[0] &&
+		    index > rom->quadlets[0] >> 24) {
+			if (index < rom->limit)
+				rom->limit = index;
+			if (rom->length > rom->limit)
+				rom->length = rom->limit;
+			return;
+		}
+		/* fall through */
+	default:
+		rom_fail(node, index, response->rcode);
+		return;
+	}
+
+	if (index == 0) {
+		info_length = rom->quadlets[0] >> 24;
+		crc_length = (rom->quadlets[0] >> 16) & 0xff;
+		if (info_length == 0)
+			rom->length = 1;	/* a minimal ROM, only the vendor ID */
+		else
+			rom_extend(&rom->length, 1 + (crc_length > info_length ? crc_length
+										: info_length),
+				   rom->limit);
+	}
+	if (index <= 2 && index + count > 2 && (rom->quadlets[0] >> 24) >= 2) {
+		max_rec = (rom->quadlets[2] >> 12) & 0xf;
+		if (max_rec >= 1 && max_rec <= 13) {
+			rom->block_quadlets = (2 << max_rec) / 4;
+			if (rom->block_quadlets > max_payload / 4)
+				rom->block_quadlets = max_payload / 4;
+			if (rom->block_quadlets < 1)
+				rom->block_quadlets = 1;
+		}
+	}
+}
+
+static void do_rom_dump(void)
+{
+	u8 buf[sizeof(struct fw_cdev_event_response) + 4 * ROM_QUADLETS];
+	struct fw_cdev_event_response *response = (void *)buf;
+	struct pollfd *pfds;
+	struct bus_node *node;
+	struct rom_dump *rom;
+	unsigned int i, busy;
+	int ready, err;
+	u64 start;
+
+	config_rom_init();
+	open_bus_nodes();
+	rom_dumps = calloc(bus_node_count, sizeof(*rom_dumps));
+	pfds = calloc(bus_node_count, sizeof(*pfds));
+	if (!rom_dumps || !pfds) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	/* the rest is requested when the first quadlet tells the lengths */
+	for (i = 0; i < bus_node_count; ++i) {
+		rom_dumps[i].length = 1;
+		rom_dumps[i].limit = ROM_QUADLETS;
+		rom_dumps[i].block_quadlets = 1;
+	}
+
+	for (;;) {
+		busy = 0;
+		for (i = 0; i < bus_node_count; ++i) {
+			node = &bus_nodes[i];
+			rom = &rom_dumps[i];
+			if (!rom->failed && !rom->done) {
+				rom_send_more(node);
+				/* all read that is known to be there? */
+				if (node->pending == 0) {
+					rom->length = rom_extent(rom);
+					rom_send_more(node);
+					if (node->pending == 0)
+						rom->done = true;
+				}
+			}
+			pfds[i].fd = node->pending ? node->device->fd : -1;
+			pfds[i].events = POLLIN;
+			busy += node->pending;
+		}
+		if (!busy)
+			break;
+		ready = fw_stats_poll(pfds, bus_node_count, FW_RETRY_WAIT);
+		if (ready < 0) {
+			perror("poll failed");
+			exit(EXIT_FAILURE);
+		}
+		for (i = 0; i < bus_node_count; ++i) {
+			node = &bus_nodes[i];
+			/* on timeout, lets requests waiting for a bus reset be reissued */
+			if (!node->pending || (ready && !(pfds[i].revents & POLLIN)))
+				continue;
+			if (!fw_retry_read_event(&node->retry, buf, sizeof(buf), 0) ||
+			    response->type != FW_CDEV_EVENT_RESPONSE ||
+			    fw_retry_resubmit(&node->retry, response->closure, response->rcode))
+				continue;
+			rom_handle_response(node, response);
+		}
+	}
+	free(pfds);
+
+	for (i = 0; i < bus_node_count; ++i) {
+		node = &bus_nodes[i];
+		rom = &rom_dumps[i];
+		if (rom->failed) {
+			fprintf(stderr, "%s: reading %012llx failed: %s\n", node->device->name,
+				(unsigned long long)CSR_CONFIG_ROM + rom->failed_index * 4,
+				rcode_name(rom->failed_rcode));
+			++failures;
+			continue;
+		}
+		if (verbose)
+			fprintf(stderr, "%s: %u bytes, %u byte requests\n", node->device->name,
+				rom->length * 4, rom->block_quadlets * 4);
+		if (bus_node_count > 1)
+			config_rom_emit_file_header(rom_format, node->device->name, stdout);
+		start = fw_stats_start();
+		err = config_rom_decode((const u8 *)rom->quadlets, rom->length * 4, rom_format,
+					stdout);
+		fw_stats_stop(FW_STATS_DECODE, start);
+		if (err < 0) {
+			fprintf(stderr, "%s: %s\n", node->device->name, strerror(-err));
+			++failures;
+		}
+	}
+	fflush(stdout);
+
+	free(rom_dumps);
+	close_bus_nodes();
+	if (failures)
+		exit(EXIT_FAILURE);
+}
+
+static u64 load_be(const u8 *p, unsigned int size)
+{
+	u64 value = 0;
+	unsigned int i;
+
+	for (i = 0; i < size; ++i)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+static void store_be(u8 *p, unsigned int size, u64 value)
+{
+	while (size--) {
+		p[size] = value;
+		value >>= 8;
+	}
+}
+
+static u64 load_le(const u8 *p, unsigned int size)
+{
+	u64 value = 0;
+
+	while (size--)
+		value = (value << 8) | p[size];
+	return value;
+}
+
+static void store_le(u8 *p, unsigned int size, u64 value)
+{
+	unsigned int i;
+
+	for (i = 0; i < size; ++i) {
+		p[i] = value;
+		value >>= 8;
+	}
+}
+
+/*
+ * Executes a lock request on the register at reg, and stores its old value in
+ * old.  The payload is the argument followed by the data, or only the data for
+ * the add transactions.  Returns the size of the register, or 0 if invalid.
+ */
+static unsigned int serve_lock(u8 *reg, u32 tcode, const u8 *payload, unsigned int length,
+			       u8 *old)
+{
+	unsigned int size;
+	u64 value, arg, data;
+
+	if (tcode == TCODE_LOCK_FETCH_ADD || tcode == TCODE_LOCK_LITTLE_ADD) {
+		size = length;
+		arg = 0;
+		data = load_be(payload, size);
+	} else {
+		size = length / 2;
+		arg = load_be(payload, size);
+		data = load_be(payload + size, size);
+	}
+	if ((size != 4 && size != 8) || (length != size && length != size * 2))
+		return 0;
+
+	memcpy(old, reg, size);
+	value = load_be(reg, size);
+	switch (tcode) {
+	case TCODE_LOCK_MASK_SWAP:
+		value = data | (value & ~arg);
+		break;
+	case TCODE_LOCK_COMPARE_SWAP:
+		if (value == arg)
+			value = data;
+		break;
+	case TCODE_LOCK_FETCH_ADD:
+		value += data;
+		break;
+	case TCODE_LOCK_LITTLE_ADD:
+		store_le(reg, size, load_le(reg, size) + load_le(payload, size));
+		return size;
+	case TCODE_LOCK_BOUNDED_ADD:
+		if (value != arg)
+			value += data;
+		break;
+	case TCODE_LOCK_WRAP_ADD:
+		value = value != arg ? value + data : data;
+		break;
+	default:
+		return 0;
+	}
+	store_be(reg, size, value);
+	return size;
+}
+
+static void serve_request(u64 closure, u32 handle, u32 tcode, u64 offset,
+			  const u8 *payload, unsigned int length)
+{
+	struct serve_range *range;
+	u8 old[8];
+	u8 *p;
+	unsigned int extent, size;
+
+	if (closure >= serve_range_count) {
+		send_response(handle, RCODE_ADDRESS_ERROR, NULL, 0);
+		return;
+	}
+	range = &serve_ranges[closure];
+	/* the payload of most lock requests has two operands */
+	extent = length;
+	if (tcode >= TCODE_LOCK_MASK_SWAP && tcode <= TCODE_LOCK_VENDOR_DEPENDENT &&
+	    tcode != TCODE_LOCK_FETCH_ADD && tcode != TCODE_LOCK_LITTLE_ADD)
+		extent = length / 2;
+	if (offset < range->offset || offset - range->offset + extent > range->length) {
+		++range->counts[SERVE_ERRORS];
+		send_response(handle, RCODE_ADDRESS_ERROR, NULL, 0);
+		return;
+	}
+	p = range->buf + (offset - range->offset);
+
+	switch (tcode) {
+	case TCODE_READ_QUADLET_REQUEST:
+	case TCODE_READ_BLOCK_REQUEST:
+		++range->counts[SERVE_READS];
+		send_response(handle, RCODE_COMPLETE, p, length);
+		return;
+	case TCODE_WRITE_QUADLET_REQUEST:
+	case TCODE_WRITE_BLOCK_REQUEST:
+		++range->counts[SERVE_WRITES];
+		memcpy(p, payload, length);
+		send_response(handle, RCODE_COMPLETE, NULL, 0);
+		return;
+	case TCODE_LOCK_MASK_SWAP:
+	case TCODE_LOCK_COMPARE_SWAP:
+	case TCODE_LOCK_FETCH_ADD:
+	case TCODE_LOCK_LITTLE_ADD:
+	case TCODE_LOCK_BOUNDED_ADD:
+	case TCODE_LOCK_WRAP_ADD:
+		size = serve_lock(p, tcode, payload, length, old);
+		if (!size)
+			break;
+		++range->counts[SERVE_LOCKS];
+		send_response(handle, RCODE_COMPLETE, old, size);
+		return;
+	}
+	++range->counts[SERVE_ERRORS];
+	send_response(handle, RCODE_TYPE_ERROR, NULL, 0);
+}
+
+static void serve_map_range(struct serve_range *range)
+{
+	struct stat st;
+	int file_fd;
+
+	if (!range->file) {
+		range->buf = calloc(1, range->length);
+		if (!range->buf) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
+
+	file_fd = open(range->file, O_RDWR | O_CREAT, 0666);
+	if (file_fd < 0 || fstat(file_fd, &st) < 0) {
+		perror(range->file);
+		exit(EXIT_FAILURE);
+	}
+	if (st.st_size < range->length && ftruncate(file_fd, range->length) < 0) {
+		perror(range->file);
+		exit(EXIT_FAILURE);
+	}
+	range->buf = mmap(NULL, range->length, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, 0);
+	if (range->buf == MAP_FAILED) {
+		perror(range->file);
+		exit(EXIT_FAILURE);
+	}
+	close(file_fd);
+}
+
+/* prints the request rates of the ranges that were accessed since the last report */
+static void serve_report(double seconds)
+{
+	static const char *const names[SERVE_COUNTERS] = {
+		[SERVE_READS] = "reads",
+		[SERVE_WRITES] = "writes",
+		[SERVE_LOCKS] = "locks",
+		[SERVE_ERRORS] = "errors",
+	};
+	struct serve_range *range;
+	unsigned long long delta;
+	unsigned int i, j;
+	bool active;
+
+	for (i = 0; i < serve_range_count; ++i) {
+		range = &serve_ranges[i];
+		active = false;
+		for (j = 0; j < SERVE_COUNTERS; ++j)
+			if (range->counts[j] != range->reported[j])
+				active = true;
+		if (!active)
+			continue;
+		printf("%012llx:", (unsigned long long)range->offset);
+		for (j = 0; j < SERVE_COUNTERS; ++j) {
+			delta = range->counts[j] - range->reported[j];
+			if (j == SERVE_ERRORS && !delta)
+				continue;
+			printf(" %.0f %s/s", delta / seconds, names[j]);
+			range->reported[j] = range->counts[j];
+		}
+		putchar('\n');
+	}
+	fflush(stdout);
+}
+
+/*
+ * Allocates the address ranges, and answers the requests to them until
+ * interrupted, with a report of the request rates every second.
+ */
+static void do_serve(void)
+{
+	static u8 buf[sizeof(struct fw_cdev_event_request2) + 16384];
+	struct fw_cdev_event_common *event = (void *)buf;
+	struct fw_cdev_allocate allocate;
+	struct serve_range *range;
+	u64 now, last_report;
+	unsigned int i;
+	int wait;
+
+	for (i = 0; i < serve_range_count; ++i) {
+		range = &serve_ranges[i];
+		serve_map_range(range);
+		allocate.offset = range->offset;
+		allocate.closure = i;
+		allocate.length = range->length;
+#ifdef HAVE_CDEV_4
+		allocate.region_end = allocate.offset + allocate.length;
+#endif
+		if (fw_stats_ioctl(fd, FW_CDEV_IOC_ALLOCATE, &allocate) < 0) {
+			fprintf(stderr, "ALLOCATE ioctl failed for %012llx: %s\n",
+				(unsigned long long)range->offset, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	last_report = monotonic_ns();
+	for (;;) {
+		now = monotonic_ns();
+		if (now - last_report >= 1000000000uLL) {
+			serve_report((now - last_report) / 1e9);
+			last_report = now;
+		}
+		wait = 1000 - (now - last_report) / 1000000;
+		if (!fw_retry_read_event(&retry, buf, sizeof(buf), wait))
+			continue;
+#ifdef HAVE_CDEV_4
+		if (event->type == FW_CDEV_EVENT_REQUEST2) {
+			struct fw_cdev_event_request2 *request = (void *)event;
+			serve_request(request->closure, request->handle, request->tcode,
+				      request->offset, (const u8 *)request->data, request->length);
+			continue;
+		}
+#endif
+		if (event->type == FW_CDEV_EVENT_REQUEST) {
+			struct fw_cdev_event_request *request = (void *)event;
+			serve_request(request->closure, request->handle, request->tcode,
+				      request->offset, (const u8 *)request->data, request->length);
+		}
+	}
+}
+
 static command_func parse_parameters(int argc, char *argv[])
 {
-	static const char short_options[] = "DvhV";
+	static const char short_options[] = "Dp:q:t:n:vhV";
 	static const struct option long_options[] = {
 		{ "dump-register-names", 0, NULL, 'D' },
+		{ "max-payload", 1, NULL, 'p' },
+		{ "queue-depth", 1, NULL, 'q' },
+		{ "timeout", 1, NULL, 't' },
+		{ "count", 1, NULL, 'n' },
 		{ "verbose", 0, NULL, 'v' },
+		{ "stats", 0, NULL, 'S' },
 		{ "help", 0, NULL, 'h' },
 		{ "version", 0, NULL, 'V' },
 		{}
@@ -721,12 +2852,49 @@ static command_func parse_parameters(int argc, char *argv[])
 	int c;
 	bool show_regs = false, show_help = false, show_version = false;
 	const struct command *command;
+	char *endptr;
+	unsigned long int l;
 
 	while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
 		switch (c) {
 		case 'D':
 			show_regs = true;
 			break;
+		case 'p':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l < 4 || l > 16384 || (l & 3)) {
+				fprintf(stderr, "invalid payload size: `%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			max_payload = l;
+			break;
+		case 'q':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l < 1 || l > 64) {
+				fprintf(stderr, "invalid queue depth: `%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			queue_depth = l;
+			break;
+		case 't':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l < 1 || l > 3600000) {
+				fprintf(stderr, "invalid timeout: `%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			fcp_timeout = l;
+			break;
+		case 'n':
+			l = strtoul(optarg, &endptr, 0);
+			if (*endptr != '\0' || l < 1 || l > 10000000) {
+				fprintf(stderr, "invalid count: `%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			bench_count = l;
+			break;
+		case 'S':
+			fw_stats_enable();
+			break;
 		case 'v':
 			verbose = true;
 			break;
@@ -756,49 +2924,9 @@ static command_func parse_parameters(int argc, char *argv[])
 		goto syntax_error;
 	device_name = argv[optind++];
 
-	if (optind >= argc)
-		goto syntax_error;
-	for (c = 0; c < ARRAY_SIZE(commands); ++c)
-		if (!strcasecmp(argv[optind], commands[c].name)) {
-			command = &commands[c];
-			goto command_found;
-		}
-	fprintf(stderr, "unknown command: `%s'\n", argv[optind]);
-	goto syntax_error;
-command_found:
-	++optind;
-
-	if (command->has_addr) {
-		if (optind >= argc)
-			goto syntax_error;
-		parse_address(argv[optind++]);
-	}
-
-	if (command->has_length) {
-		if (optind < argc)
-			parse_read_length(argv[optind++]);
-		else if (register_length)
-			read_length = register_length;
-		else
-			read_length = 4;
-	}
-
-	if (command->has_data) {
-		if (optind >= argc)
-			goto syntax_error;
-		parse_data(argv[optind++], &data);
-	}
-
-	if (command->has_data2) {
-		if (optind >= argc)
-			goto syntax_error;
-		parse_data(argv[optind++], &data2);
-	}
-
-	if (optind < argc) {
-		fprintf(stderr, "superfluous parameter: `%s'\n", argv[optind]);
+	command = parse_command(argc, argv, optind);
+	if (!command)
 		goto syntax_error;
-	}
 
 	return command->function;
 }
@@ -810,6 +2938,8 @@ int main(int argc, char *argv[])
 	fn = parse_parameters(argc, argv);
 	open_device();
 	fn();
-	close(fd);
+	fw_retry_report(&retry);
+	fw_retry_release(&retry);
+	fw_device_index_release(&devices);
 	return 0;
 }
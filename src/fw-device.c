@@ -0,0 +1,250 @@
+/*
+ * fw-device.c - index of the FireWire device files
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/firewire-cdev.h>
+
+#include "fw-device.h"
+#include "fw-stats.h"
+
+#define ptr_to_u64(p) ((uintptr_t)(p))
+
+static int fw_filter(const struct dirent *dirent)
+{
+	unsigned int i;
+
+	if (dirent->d_name[0] != 'f' ||
+	    dirent->d_name[1] != 'w')
+		return false;
+	i = 2;
+	do {
+		if (!isdigit(dirent->d_name[i]))
+			return false;
+	} while (dirent->d_name[++i]);
+	return true;
+}
+
+static struct fw_device *add_device(struct fw_device_index *index, char *name)
+{
+	struct fw_device *device;
+
+	if (index->count >= index->allocated) {
+		index->allocated = index->allocated ? index->allocated * 2 : 16;
+		index->devices = realloc(index->devices,
+					 index->allocated * sizeof(*index->devices));
+		if (!index->devices) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	device = calloc(1, sizeof(*device));
+	if (!device) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	device->name = name;
+	device->fd = -1;
+	index->devices[index->count++] = device;
+	return device;
+}
+
+/*
+ * Lists the /dev/fw* files in version order, but does not open them.
+ * GET_INFO of every file that is probed later requests the given ABI version.
+ */
+void fw_device_index_init(struct fw_device_index *index, __u32 version)
+{
+	struct dirent **dirents;
+	char *name;
+	int count, i;
+
+	memset(index, 0, sizeof(*index));
+	index->version = version;
+
+	count = scandir("/dev", &dirents, fw_filter, versionsort);
+	if (count < 0) {
+		perror("cannot read /dev");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < count; ++i) {
+		if (asprintf(&name, "/dev/%s", dirents[i]->d_name) < 0) {
+			perror("asprintf failed");
+			exit(EXIT_FAILURE);
+		}
+		add_device(index, name);
+		free(dirents[i]);
+	}
+	free(dirents);
+}
+
+void fw_device_index_release(struct fw_device_index *index)
+{
+	unsigned int i;
+
+	for (i = 0; i < index->count; ++i) {
+		if (index->devices[i]->fd != -1)
+			close(index->devices[i]->fd);
+		free(index->devices[i]->name);
+		free(index->devices[i]);
+	}
+	free(index->devices);
+	index->devices = NULL;
+	index->count = 0;
+	index->allocated = 0;
+}
+
+/* Returns the entry of a device file, which is added if it is not a /dev/fw*. */
+struct fw_device *fw_device_get(struct fw_device_index *index, const char *name)
+{
+	unsigned int i;
+	char *copy;
+
+	for (i = 0; i < index->count; ++i)
+		if (!strcmp(index->devices[i]->name, name))
+			return index->devices[i];
+	copy = strdup(name);
+	if (!copy) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return add_device(index, copy);
+}
+
+/*
+ * Opens the file and reads its card, node and bus info block, unless this has
+ * already been done.  Returns false, with device->error set, if it is not a
+ * FireWire device file that can be opened.
+ */
+bool fw_device_probe(struct fw_device_index *index, struct fw_device *device)
+{
+	struct fw_cdev_get_info get_info;
+
+	if (device->probed)
+		return true;
+	if (device->error)
+		return false;
+
+	device->fd = open(device->name, O_RDWR);
+	if (device->fd == -1) {
+		device->error = errno;
+		if (errno == EACCES)
+			index->eacces = true;
+		return false;
+	}
+
+	get_info.version = index->version;
+	get_info.rom_length = sizeof(device->rom);
+	get_info.rom = ptr_to_u64(device->rom);
+	get_info.bus_reset = ptr_to_u64(&device->bus_reset);
+	get_info.bus_reset_closure = 0;
+	if (fw_stats_ioctl(device->fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
+		device->error = errno;
+		device->invalid = true;
+		close(device->fd);
+		device->fd = -1;
+		return false;
+	}
+	device->version = get_info.version;
+	device->card = get_info.card;
+	device->node_id = device->bus_reset.node_id;
+	device->generation = device->bus_reset.generation;
+	device->is_local = device->bus_reset.node_id == device->bus_reset.local_node_id;
+	device->rom_length = get_info.rom_length;
+	device->probed = true;
+	return true;
+}
+
+/*
+ * Reads the node ID and generation of a probed device again, e.g., after a bus
+ * reset.  Returns false if the node is gone.
+ */
+bool fw_device_update(struct fw_device_index *index, struct fw_device *device)
+{
+	struct fw_cdev_get_info get_info;
+
+	if (!device->probed)
+		return false;
+
+	get_info.version = index->version;
+	get_info.rom_length = 0;
+	get_info.rom = 0;
+	get_info.bus_reset = ptr_to_u64(&device->bus_reset);
+	get_info.bus_reset_closure = 0;
+	if (fw_stats_ioctl(device->fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0)
+		return false;
+	device->node_id = device->bus_reset.node_id;
+	device->generation = device->bus_reset.generation;
+	device->is_local = device->bus_reset.node_id == device->bus_reset.local_node_id;
+	return true;
+}
+
+/*
+ * Returns true unless sysfs says that the device is not a local node, so that
+ * only local nodes need to be opened when the kernel has the is_local
+ * attribute.
+ */
+static bool may_be_local(const struct fw_device *device)
+{
+	char path[64];
+	FILE *file;
+	int c;
+
+	if (strncmp(device->name, "/dev/", 5) ||
+	    snprintf(path, sizeof(path), "/sys/bus/firewire/devices/%s/is_local",
+		     device->name + 5) >= (int)sizeof(path))
+		return true;
+	file = fopen(path, "r");
+	if (!file)
+		return true;
+	c = fgetc(file);
+	fclose(file);
+	return c != '0';
+}
+
+/* Returns whether the device is a local node; other nodes may not be probed. */
+bool fw_device_is_local(struct fw_device_index *index, struct fw_device *device)
+{
+	if (!device->probed && !may_be_local(device))
+		return false;
+	return fw_device_probe(index, device) && device->is_local;
+}
+
+/*
+ * Returns the local node of the card, or of any card if card is negative, or
+ * NULL if there is none.  The devices already probed are used as a map from
+ * cards to their local nodes; other files are probed only if they may be
+ * local nodes.
+ */
+struct fw_device *fw_device_find_local(struct fw_device_index *index, int card)
+{
+	struct fw_device *device;
+	unsigned int i;
+
+	for (i = 0; i < index->count; ++i) {
+		device = index->devices[i];
+		if (device->probed && device->is_local &&
+		    (card < 0 || device->card == (__u32)card))
+			return device;
+	}
+	for (i = 0; i < index->count; ++i) {
+		device = index->devices[i];
+		if (!device->probed && fw_device_is_local(index, device) &&
+		    (card < 0 || device->card == (__u32)card))
+			return device;
+	}
+	return NULL;
+}
@@ -0,0 +1,51 @@
+/*
+ * fw-device.h - index of the FireWire device files
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#ifndef FW_DEVICE_H_INCLUDED
+#define FW_DEVICE_H_INCLUDED
+
+#include <stdbool.h>
+#include <linux/firewire-cdev.h>
+
+/*
+ * One /dev/fw* file.  It is opened, and its card and node are looked up with
+ * GET_INFO, only when a tool needs them; the file then stays open until the
+ * index is released.
+ */
+struct fw_device {
+	char *name;
+	int fd;			/* -1 if not open */
+	int error;		/* errno of the failed open or GET_INFO */
+	bool invalid;		/* GET_INFO failed */
+	bool probed;		/* the following fields are valid */
+	__u32 version;		/* of the cdev ABI of the kernel */
+	__u32 card;
+	__u32 node_id;
+	__u32 generation;
+	bool is_local;
+	struct fw_cdev_event_bus_reset bus_reset;
+	__u32 rom[5];		/* bus info block, in host byte order */
+	__u32 rom_length;	/* of the whole configuration ROM */
+};
+
+struct fw_device_index {
+	__u32 version;		/* of the cdev ABI, requested with GET_INFO */
+	struct fw_device **devices;
+	unsigned int count;
+	unsigned int allocated;
+	bool eacces;		/* some file could not be opened because of EACCES */
+};
+
+void fw_device_index_init(struct fw_device_index *index, __u32 version);
+void fw_device_index_release(struct fw_device_index *index);
+
+struct fw_device *fw_device_get(struct fw_device_index *index, const char *name);
+bool fw_device_probe(struct fw_device_index *index, struct fw_device *device);
+bool fw_device_update(struct fw_device_index *index, struct fw_device *device);
+bool fw_device_is_local(struct fw_device_index *index, struct fw_device *device);
+struct fw_device *fw_device_find_local(struct fw_device_index *index, int card);
+
+#endif
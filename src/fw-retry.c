@@ -0,0 +1,282 @@
+/*
+ * fw-retry.c - reissue requests and PHY packets after bus resets
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/firewire-cdev.h>
+#include <linux/firewire-constants.h>
+
+#include "fw-retry.h"
+#include "fw-stats.h"
+
+#define ptr_to_u64(p) ((uintptr_t)(p))
+#define u64_to_ptr(p) ((void *)(uintptr_t)(p))
+
+struct fw_retry_item {
+	unsigned long request;
+	__u64 closure;
+	__u32 generation;	/* with which it was sent last */
+	unsigned int retries;
+	bool waiting;		/* for the bus reset after RCODE_GENERATION */
+	union {
+		struct fw_cdev_send_request send_request;
+		struct fw_cdev_send_phy_packet send_phy_packet;
+	} u;
+	void *payload;
+};
+
+void fw_retry_init(struct fw_retry *retry, int fd, __u32 generation, __u32 node_id)
+{
+	memset(retry, 0, sizeof(*retry));
+	retry->fd = fd;
+	retry->generation = generation;
+	retry->node_id = node_id;
+}
+
+void fw_retry_release(struct fw_retry *retry)
+{
+	unsigned int i;
+
+	for (i = 0; i < retry->item_count; ++i)
+		free(retry->items[i].payload);
+	free(retry->items);
+	retry->items = NULL;
+	retry->item_count = 0;
+	retry->items_allocated = 0;
+}
+
+static void submit_item(struct fw_retry *retry, struct fw_retry_item *item)
+{
+	item->generation = retry->generation;
+	item->waiting = false;
+	if (item->request == FW_CDEV_IOC_SEND_PHY_PACKET) {
+		item->u.send_phy_packet.generation = item->generation;
+		if (fw_stats_ioctl(retry->fd, item->request, &item->u.send_phy_packet) < 0) {
+			perror("SEND_PHY_PACKET ioctl failed");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		item->u.send_request.generation = item->generation;
+		if (fw_stats_ioctl(retry->fd, item->request, &item->u.send_request) < 0) {
+			perror("SEND_REQUEST ioctl failed");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void reissue_item(struct fw_retry *retry, struct fw_retry_item *item)
+{
+	++item->retries;
+	++retry->retries;
+	submit_item(retry, item);
+}
+
+static struct fw_retry_item *add_item(struct fw_retry *retry, unsigned long request,
+				      __u64 closure)
+{
+	struct fw_retry_item *item;
+
+	if (retry->item_count >= retry->items_allocated) {
+		retry->items_allocated = retry->items_allocated ? retry->items_allocated * 2 : 8;
+		retry->items = realloc(retry->items,
+				       retry->items_allocated * sizeof(*retry->items));
+		if (!retry->items) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	item = &retry->items[retry->item_count++];
+	memset(item, 0, sizeof(*item));
+	item->request = request;
+	item->closure = closure;
+	return item;
+}
+
+static struct fw_retry_item *find_item(struct fw_retry *retry, __u64 closure)
+{
+	unsigned int i;
+
+	for (i = 0; i < retry->item_count; ++i)
+		if (retry->items[i].closure == closure)
+			return &retry->items[i];
+	return NULL;
+}
+
+/*
+ * Sends a request, and keeps a copy of it and of its payload until it is
+ * forgotten.  The closure must be unique among the requests not forgotten.
+ */
+void fw_retry_send_request(struct fw_retry *retry, unsigned long request,
+			   struct fw_cdev_send_request *send_request)
+{
+	struct fw_retry_item *item;
+
+	item = add_item(retry, request, send_request->closure);
+	item->u.send_request = *send_request;
+	if (send_request->data && send_request->length > 0) {
+		item->payload = malloc(send_request->length);
+		if (!item->payload) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		memcpy(item->payload, u64_to_ptr(send_request->data), send_request->length);
+		item->u.send_request.data = ptr_to_u64(item->payload);
+	}
+	submit_item(retry, item);
+}
+
+void fw_retry_send_phy_packet(struct fw_retry *retry,
+			      struct fw_cdev_send_phy_packet *send_phy_packet)
+{
+	struct fw_retry_item *item;
+
+	item = add_item(retry, FW_CDEV_IOC_SEND_PHY_PACKET, send_phy_packet->closure);
+	item->u.send_phy_packet = *send_phy_packet;
+	submit_item(retry, item);
+}
+
+/*
+ * To be called with the rcode of a response or of a sent PHY packet.  Returns
+ * true if it is RCODE_GENERATION and the item will be sent again, in which
+ * case the caller should ignore the event.
+ */
+bool fw_retry_resubmit(struct fw_retry *retry, __u64 closure, __u32 rcode)
+{
+	struct fw_retry_item *item;
+
+	if (rcode != RCODE_GENERATION)
+		return false;
+	item = find_item(retry, closure);
+	if (!item || item->retries >= FW_RETRY_MAX)
+		return false;
+
+	if (item->generation != retry->generation)
+		reissue_item(retry, item);
+	else
+		item->waiting = true;
+	return true;
+}
+
+/*
+ * Sends all items again that were sent before the last bus reset, e.g. PHY
+ * packets whose replies were lost.  Returns false if one of them has been
+ * retried too often.
+ */
+bool fw_retry_resend_all(struct fw_retry *retry)
+{
+	struct fw_retry_item *item;
+	unsigned int i;
+	bool ok = true;
+
+	for (i = 0; i < retry->item_count; ++i) {
+		item = &retry->items[i];
+		if (item->generation == retry->generation)
+			continue;
+		if (item->retries >= FW_RETRY_MAX)
+			ok = false;
+		else
+			reissue_item(retry, item);
+	}
+	return ok;
+}
+
+void fw_retry_forget(struct fw_retry *retry, __u64 closure)
+{
+	struct fw_retry_item *item;
+
+	item = find_item(retry, closure);
+	if (!item)
+		return;
+	free(item->payload);
+	*item = retry->items[--retry->item_count];
+}
+
+static bool any_waiting(const struct fw_retry *retry)
+{
+	unsigned int i;
+
+	for (i = 0; i < retry->item_count; ++i)
+		if (retry->items[i].waiting)
+			return true;
+	return false;
+}
+
+static bool reissue_waiting(struct fw_retry *retry)
+{
+	unsigned int i;
+	bool any = false;
+
+	for (i = 0; i < retry->item_count; ++i)
+		if (retry->items[i].waiting) {
+			reissue_item(retry, &retry->items[i]);
+			any = true;
+		}
+	return any;
+}
+
+/* To be called with every event read from the file. */
+void fw_retry_handle_event(struct fw_retry *retry, const void *event)
+{
+	const struct fw_cdev_event_bus_reset *bus_reset = event;
+
+	if (bus_reset->type != FW_CDEV_EVENT_BUS_RESET)
+		return;
+	retry->generation = bus_reset->generation;
+	retry->node_id = bus_reset->node_id;
+	++retry->bus_resets;
+	reissue_waiting(retry);
+}
+
+/*
+ * Waits up to timeout milliseconds (or forever if negative) for an event, and
+ * returns its length, or 0 on timeout.  Items waiting for a bus reset event
+ * that does not arrive are sent again after FW_RETRY_WAIT milliseconds.
+ */
+ssize_t fw_retry_read_event(struct fw_retry *retry, void *buf, size_t size, int timeout)
+{
+	struct pollfd pfd;
+	int wait, ready;
+	ssize_t r;
+
+	pfd.fd = retry->fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		wait = timeout;
+		if (any_waiting(retry) && (wait < 0 || wait > FW_RETRY_WAIT))
+			wait = FW_RETRY_WAIT;
+		ready = fw_stats_poll(&pfd, 1, wait);
+		if (ready < 0) {
+			perror("poll failed");
+			exit(EXIT_FAILURE);
+		}
+		if (ready)
+			break;
+		if (!reissue_waiting(retry))
+			return 0;
+	}
+
+	r = fw_stats_read_event(retry->fd, buf, size);
+	if (r < (ssize_t)sizeof(struct fw_cdev_event_common)) {
+		fputs("short read\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	fw_retry_handle_event(retry, buf);
+	return r;
+}
+
+void fw_retry_report(const struct fw_retry *retry)
+{
+	if (retry->bus_resets || retry->retries)
+		fprintf(stderr, "%u bus reset%s, %u retr%s\n",
+			retry->bus_resets, retry->bus_resets == 1 ? "" : "s",
+			retry->retries, retry->retries == 1 ? "y" : "ies");
+}
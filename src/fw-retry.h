@@ -0,0 +1,61 @@
+/*
+ * fw-retry.h - reissue requests and PHY packets after bus resets
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#ifndef FW_RETRY_H_INCLUDED
+#define FW_RETRY_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <linux/firewire-cdev.h>
+
+/* how often one request or PHY packet is reissued before it fails */
+#define FW_RETRY_MAX		8
+
+/* milliseconds to wait for the bus reset event after RCODE_GENERATION */
+#define FW_RETRY_WAIT		500
+
+struct fw_retry_item;
+
+/*
+ * Tracks the generation of the bus that a cdev file is on, and the requests
+ * and PHY packets sent through it that have not been forgotten yet, so that
+ * they can be sent again when a bus reset has dropped them.
+ *
+ * A request that completes with RCODE_GENERATION was never sent; it is
+ * reissued with the generation from the next bus reset event.  Anything else,
+ * e.g. a PHY packet whose reply was lost, is reissued only when the caller
+ * asks for it, because only the caller knows whether that is safe.
+ */
+struct fw_retry {
+	int fd;
+	__u32 generation;
+	__u32 node_id;
+	unsigned int bus_resets;
+	unsigned int retries;
+	struct fw_retry_item *items;
+	unsigned int item_count;
+	unsigned int items_allocated;
+};
+
+void fw_retry_init(struct fw_retry *retry, int fd, __u32 generation, __u32 node_id);
+void fw_retry_release(struct fw_retry *retry);
+
+void fw_retry_send_request(struct fw_retry *retry, unsigned long request,
+			   struct fw_cdev_send_request *send_request);
+void fw_retry_send_phy_packet(struct fw_retry *retry,
+			      struct fw_cdev_send_phy_packet *send_phy_packet);
+
+bool fw_retry_resubmit(struct fw_retry *retry, __u64 closure, __u32 rcode);
+bool fw_retry_resend_all(struct fw_retry *retry);
+void fw_retry_forget(struct fw_retry *retry, __u64 closure);
+
+void fw_retry_handle_event(struct fw_retry *retry, const void *event);
+ssize_t fw_retry_read_event(struct fw_retry *retry, void *buf, size_t size, int timeout);
+
+void fw_retry_report(const struct fw_retry *retry);
+
+#endif
@@ -0,0 +1,322 @@
+/*
+ * fw-stats.c - count and time the ioctls, polls and events of a tool
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/firewire-cdev.h>
+
+#include "fw-stats.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
+
+#define FW_STATS_IOCTLS		0x20	/* the last one counts unknown ioctls */
+#define FW_STATS_EVENTS		0x10	/* the last one counts unknown events */
+
+#define atomic_add(p, v)	__atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+
+struct counter {
+	unsigned long long count;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+};
+
+bool fw_stats_enabled;
+
+static struct counter ioctls[FW_STATS_IOCTLS];
+static struct counter timers[FW_STATS_TIMERS];
+static unsigned long long events[FW_STATS_EVENTS];
+static unsigned long long timeouts;
+
+/* indexed by the ioctl numbers of firewire-cdev.h */
+static const char *const ioctl_names[FW_STATS_IOCTLS] = {
+	"GET_INFO", "SEND_REQUEST", "ALLOCATE", "DEALLOCATE",
+	"SEND_RESPONSE", "INITIATE_BUS_RESET", "ADD_DESCRIPTOR", "REMOVE_DESCRIPTOR",
+	"CREATE_ISO_CONTEXT", "QUEUE_ISO", "START_ISO", "STOP_ISO",
+	"GET_CYCLE_TIMER", "ALLOCATE_ISO_RESOURCE", "DEALLOCATE_ISO_RESOURCE",
+	"ALLOCATE_ISO_RESOURCE_ONCE", "DEALLOCATE_ISO_RESOURCE_ONCE", "GET_SPEED",
+	"SEND_BROADCAST_REQUEST", "SEND_STREAM_PACKET", "GET_CYCLE_TIMER2",
+	"SEND_PHY_PACKET", "RECEIVE_PHY_PACKETS", "SET_ISO_CHANNELS", "FLUSH_ISO",
+	[FW_STATS_IOCTLS - 1] = "other",
+};
+
+static const char *const event_names[FW_STATS_EVENTS] = {
+	"BUS_RESET", "RESPONSE", "REQUEST", "ISO_INTERRUPT",
+	"ISO_RESOURCE_ALLOCATED", "ISO_RESOURCE_DEALLOCATED", "REQUEST2",
+	"PHY_PACKET_SENT", "PHY_PACKET_RECEIVED", "ISO_INTERRUPT_MULTICHANNEL",
+	"REQUEST3", "RESPONSE2", "PHY_PACKET_SENT2", "PHY_PACKET_RECEIVED2",
+	[FW_STATS_EVENTS - 1] = "other",
+};
+
+static const char *const timer_names[FW_STATS_TIMERS] = {
+	[FW_STATS_POLL] = "poll",
+	[FW_STATS_READ] = "read",
+	[FW_STATS_DECODE] = "decode",
+};
+
+static void add_sample(struct counter *counter, unsigned long long ns)
+{
+	unsigned long long max = __atomic_load_n(&counter->max_ns, __ATOMIC_RELAXED);
+
+	atomic_add(&counter->count, 1);
+	atomic_add(&counter->total_ns, ns);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&counter->max_ns, &max, ns, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * The report is also printed from the handler of SIGINT and SIGTERM, which may
+ * interrupt any code, including stdio and malloc in another thread.  So it is
+ * formatted with the integer code below into a buffer on the stack, and written
+ * with write(2), which are async-signal-safe.
+ */
+struct report_buffer {
+	char data[4096];
+	size_t length;
+};
+
+static void put_char(struct report_buffer *buffer, char c)
+{
+	if (buffer->length < sizeof(buffer->data))
+		buffer->data[buffer->length++] = c;
+}
+
+static void put_padding(struct report_buffer *buffer, size_t width, size_t length)
+{
+	for (; length < width; ++length)
+		put_char(buffer, ' ');
+}
+
+/* left-aligned */
+static void put_string(struct report_buffer *buffer, const char *string, size_t width)
+{
+	size_t length = strlen(string);
+	size_t i;
+
+	for (i = 0; i < length; ++i)
+		put_char(buffer, string[i]);
+	put_padding(buffer, width, length);
+}
+
+/* right-aligned */
+static void put_number(struct report_buffer *buffer, unsigned long long value, size_t width)
+{
+	char digits[20];
+	size_t length = 0;
+
+	do {
+		digits[length++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	put_padding(buffer, width, length);
+	while (length)
+		put_char(buffer, digits[--length]);
+}
+
+/* in milliseconds with three decimals, right-aligned */
+static void put_ms(struct report_buffer *buffer, unsigned long long ns, size_t width)
+{
+	unsigned long long us = (ns + 500) / 1000;
+
+	put_number(buffer, us / 1000, width > 4 ? width - 4 : 0);
+	put_char(buffer, '.');
+	put_char(buffer, '0' + us / 100 % 10);
+	put_char(buffer, '0' + us / 10 % 10);
+	put_char(buffer, '0' + us % 10);
+}
+
+static void put_count(struct report_buffer *buffer, const char *prefix, const char *name,
+		      unsigned long long count)
+{
+	put_string(buffer, prefix, 0);
+	put_string(buffer, name, 26 - strlen(prefix));
+	put_char(buffer, ' ');
+	put_number(buffer, count, 10);
+}
+
+static void put_counter(struct report_buffer *buffer, const char *prefix, const char *name,
+			const struct counter *counter)
+{
+	if (!counter->count)
+		return;
+	put_count(buffer, prefix, name, counter->count);
+	put_char(buffer, ' ');
+	put_ms(buffer, counter->total_ns, 12);
+	put_char(buffer, ' ');
+	put_ms(buffer, counter->max_ns, 10);
+	put_char(buffer, '\n');
+}
+
+static void report(void)
+{
+	struct report_buffer buffer;
+	size_t written;
+	ssize_t r;
+	unsigned int i;
+
+	buffer.length = 0;
+	put_string(&buffer, "stats:", 26);
+	put_string(&buffer, "      count     total ms     max ms\n", 0);
+	for (i = 0; i < ARRAY_SIZE(ioctls); ++i)
+		put_counter(&buffer, "ioctl ", ioctl_names[i], &ioctls[i]);
+	for (i = 0; i < ARRAY_SIZE(timers); ++i)
+		put_counter(&buffer, "", timer_names[i], &timers[i]);
+	if (timeouts) {
+		put_count(&buffer, "", "poll timeouts", timeouts);
+		put_char(&buffer, '\n');
+	}
+	if (events[FW_CDEV_EVENT_BUS_RESET]) {
+		put_count(&buffer, "", "bus resets", events[FW_CDEV_EVENT_BUS_RESET]);
+		put_char(&buffer, '\n');
+	}
+	for (i = 0; i < ARRAY_SIZE(events); ++i)
+		if (events[i]) {
+			put_count(&buffer, "event ", event_names[i], events[i]);
+			put_char(&buffer, '\n');
+		}
+
+	for (written = 0; written < buffer.length; written += r) {
+		r = write(STDERR_FILENO, buffer.data + written, buffer.length - written);
+		if (r < 0 && errno == EINTR)
+			r = 0;
+		else if (r <= 0)
+			break;
+	}
+}
+
+/*
+ * The commands that run until they are interrupted never return from main(),
+ * so the statistics are printed before the signal terminates the process as
+ * usual.
+ */
+static void report_and_die(int sig)
+{
+	signal(sig, SIG_DFL);
+	report();
+	raise(sig);
+}
+
+static void catch_signal(int sig)
+{
+	struct sigaction action;
+
+	/* a signal ignored by the parent, e.g. with nohup, stays ignored */
+	if (sigaction(sig, NULL, &action) < 0 || action.sa_handler == SIG_IGN)
+		return;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = report_and_die;
+	sigemptyset(&action.sa_mask);
+	sigaction(sig, &action, NULL);
+}
+
+void fw_stats_enable(void)
+{
+	if (fw_stats_enabled)
+		return;
+	fw_stats_enabled = true;
+	atexit(report);
+	catch_signal(SIGINT);
+	catch_signal(SIGTERM);
+}
+
+__u64 fw_stats_start(void)
+{
+	struct timespec ts;
+
+	if (!fw_stats_enabled)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000uLL + ts.tv_nsec;
+}
+
+static void stop(struct counter *counter, __u64 start)
+{
+	struct timespec ts;
+	int err = errno;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	add_sample(counter, ts.tv_sec * 1000000000uLL + ts.tv_nsec - start);
+	errno = err;
+}
+
+void fw_stats_stop(enum fw_stats_timer timer, __u64 start)
+{
+	if (fw_stats_enabled)
+		stop(&timers[timer], start);
+}
+
+void fw_stats_timeout(void)
+{
+	if (fw_stats_enabled)
+		atomic_add(&timeouts, 1);
+}
+
+void fw_stats_event(const void *event, ssize_t length)
+{
+	__u32 type;
+
+	if (!fw_stats_enabled || length < (ssize_t)sizeof(struct fw_cdev_event_common))
+		return;
+	type = ((const struct fw_cdev_event_common *)event)->type;
+	atomic_add(&events[type < FW_STATS_EVENTS - 1 ? type : FW_STATS_EVENTS - 1], 1);
+}
+
+int fw_stats_ioctl(int fd, unsigned long request, void *arg)
+{
+	unsigned int nr;
+	__u64 start;
+	int r;
+
+	if (!fw_stats_enabled)
+		return ioctl(fd, request, arg);
+
+	nr = _IOC_TYPE(request) == '#' ? _IOC_NR(request) : FW_STATS_IOCTLS - 1;
+	if (nr >= FW_STATS_IOCTLS)
+		nr = FW_STATS_IOCTLS - 1;
+	start = fw_stats_start();
+	r = ioctl(fd, request, arg);
+	stop(&ioctls[nr], start);
+	return r;
+}
+
+int fw_stats_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+	__u64 start;
+	int r;
+
+	if (!fw_stats_enabled)
+		return poll(fds, nfds, timeout);
+
+	start = fw_stats_start();
+	r = poll(fds, nfds, timeout);
+	stop(&timers[FW_STATS_POLL], start);
+	if (r == 0)
+		atomic_add(&timeouts, 1);
+	return r;
+}
+
+ssize_t fw_stats_read_event(int fd, void *buf, size_t size)
+{
+	__u64 start;
+	ssize_t r;
+
+	if (!fw_stats_enabled)
+		return read(fd, buf, size);
+
+	start = fw_stats_start();
+	r = read(fd, buf, size);
+	stop(&timers[FW_STATS_READ], start);
+	fw_stats_event(buf, r);
+	return r;
+}
@@ -0,0 +1,43 @@
+/*
+ * fw-stats.h - count and time the ioctls, polls and events of a tool
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#ifndef FW_STATS_H_INCLUDED
+#define FW_STATS_H_INCLUDED
+
+#include <stdbool.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <linux/types.h>
+
+enum fw_stats_timer {
+	FW_STATS_POLL,		/* waiting for events */
+	FW_STATS_READ,		/* reading events or ROM content */
+	FW_STATS_DECODE,	/* formatting the output */
+	FW_STATS_TIMERS
+};
+
+/*
+ * Nothing is measured until fw_stats_enable() is called, which also arranges
+ * for the statistics to be printed on stderr at exit, and when the process is
+ * terminated by SIGINT or SIGTERM.  Then each measurement costs two reads of
+ * CLOCK_MONOTONIC and a few relaxed atomic additions, so the counters can be
+ * shared by threads.
+ */
+extern bool fw_stats_enabled;
+
+void fw_stats_enable(void);
+
+__u64 fw_stats_start(void);
+void fw_stats_stop(enum fw_stats_timer timer, __u64 start);
+void fw_stats_timeout(void);
+void fw_stats_event(const void *event, ssize_t length);
+
+/* the system calls, measured if enabled */
+int fw_stats_ioctl(int fd, unsigned long request, void *arg);
+int fw_stats_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+ssize_t fw_stats_read_event(int fd, void *buf, size_t size);
+
+#endif
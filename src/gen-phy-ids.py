@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# gen-phy-ids.py - generate the PHY ID tables of lsfirewirephy
+#
+# licensed under the terms of version 2 of the GNU General Public License
+#
+# Usage: gen-phy-ids.py [--binary] input output
+#
+# Reads a file in the format of phy-ids.txt, and writes either phy-ids.h with
+# the built-in tables, or with --binary a database for lsfirewirephy
+# --database.  Both hold the same tables: the vendors sorted by OUI, and for
+# each vendor its PHYs with exact IDs sorted by ID, followed by those with
+# masks, and one block of NUL-terminated names.
+
+import struct
+import sys
+
+DB_MAGIC = b'FWPHYDB1'
+DB_BYTE_ORDER = 0x01020304
+
+
+class Vendor:
+    def __init__(self, oui, name):
+        self.oui = oui
+        self.name = name
+        self.phys = []
+
+
+def parse(path):
+    vendors = {}
+    vendor = None
+    with open(path, encoding='utf-8') as f:
+        for number, line in enumerate(f, 1):
+            line = line.rstrip('\n')
+            if not line.strip() or line.lstrip().startswith('#'):
+                continue
+            indented = line[0].isspace()
+            fields = line.split(None, 1)
+            if len(fields) != 2:
+                sys.exit(f'{path}:{number}: missing name')
+            key, name = fields[0], fields[1].strip()
+            try:
+                if indented:
+                    if vendor is None:
+                        sys.exit(f'{path}:{number}: PHY without vendor')
+                    id_, _, mask = key.partition('/')
+                    id_ = int(id_, 16)
+                    mask = int(mask, 16) if mask else 0xffffff
+                    vendor.phys.append((id_, mask, name))
+                else:
+                    oui = int(key, 16)
+                    if oui in vendors:
+                        sys.exit(f'{path}:{number}: duplicate OUI {oui:06x}')
+                    vendor = vendors[oui] = Vendor(oui, name)
+            except ValueError:
+                sys.exit(f'{path}:{number}: invalid ID {key!r}')
+    return [vendors[oui] for oui in sorted(vendors)]
+
+
+def build_tables(vendors):
+    strings = bytearray()
+    offsets = {}
+
+    def string(s):
+        if s not in offsets:
+            offsets[s] = len(strings)
+            strings.extend(s.encode('utf-8') + b'\0')
+        return offsets[s]
+
+    vendor_rows = []
+    phy_rows = []
+    for vendor in vendors:
+        exact = sorted(p for p in vendor.phys if p[1] == 0xffffff)
+        masked = [p for p in vendor.phys if p[1] != 0xffffff]
+        vendor_rows.append((vendor.oui, string(vendor.name), len(phy_rows),
+                            len(exact), len(masked)))
+        for id_, mask, name in exact + masked:
+            phy_rows.append((id_ & mask, mask, string(name)))
+    return vendor_rows, phy_rows, bytes(strings)
+
+
+def c_string(data):
+    out = []
+    for s in data.split(b'\0')[:-1]:
+        text = s.decode('utf-8').replace('\\', '\\\\').replace('"', '\\"')
+        out.append(f'\t"{text}\\0"')
+    return '\n'.join(out)
+
+
+def write_header(path, vendor_rows, phy_rows, strings):
+    with open(path, 'w', encoding='utf-8') as f:
+        f.write('/* generated by gen-phy-ids.py, do not edit */\n\n')
+        f.write('static const char builtin_strings[] =\n')
+        f.write(c_string(strings) + ';\n\n')
+        f.write('static const struct vendor builtin_vendors[] = {\n')
+        for row in vendor_rows:
+            f.write('\t{ 0x%06x, %u, %u, %u, %u },\n' % row)
+        f.write('};\n\n')
+        f.write('static const struct phy builtin_phys[] = {\n')
+        for row in phy_rows:
+            f.write('\t{ 0x%06x, 0x%06x, %u },\n' % row)
+        f.write('};\n')
+
+
+def write_binary(path, vendor_rows, phy_rows, strings):
+    with open(path, 'wb') as f:
+        f.write(DB_MAGIC)
+        f.write(struct.pack('=IIII', DB_BYTE_ORDER, len(vendor_rows),
+                            len(phy_rows), len(strings)))
+        for row in vendor_rows:
+            f.write(struct.pack('=IIIHH', *row))
+        for row in phy_rows:
+            f.write(struct.pack('=III', *row))
+        f.write(strings)
+
+
+def main():
+    args = sys.argv[1:]
+    binary = args[:1] == ['--binary']
+    if binary:
+        args = args[1:]
+    if len(args) != 2:
+        sys.exit('Usage: gen-phy-ids.py [--binary] input output')
+    tables = build_tables(parse(args[0]))
+    if binary:
+        write_binary(args[1], *tables)
+    else:
+        write_header(args[1], *tables)
+
+
+if __name__ == '__main__':
+    main()
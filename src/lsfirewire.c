@@ -0,0 +1,815 @@
+/*
+ * lsfirewire.c - list FireWire devices, as detected by the Linux kernel
+ *
+ * Copyright (C) 2010 Clemens Ladisch <clemens@ladisch.de>
+ *
+ * licensed under the terms of version 2 of the GNU General Public License
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <linux/netlink.h>
+
+#include "config.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
+
+#define SYSFS_BUS		"/sys/bus/firewire"
+#define SYSFS_DEVICES		SYSFS_BUS "/devices"
+#define SYSFS_LEGACY_BUS	"/sys/bus/ieee1394"
+
+/* the sysfs attributes, in the order in which they are shown */
+enum {
+	PROP_VENDOR,
+	PROP_MODEL,
+	PROP_HARDWARE_VERSION,
+	PROP_VENDOR_NAME,
+	PROP_MODEL_NAME,
+	PROP_HARDWARE_VERSION_NAME,
+	PROP_SPECIFIER_ID,
+	PROP_VERSION,
+	UNIT_PROP_COUNT,
+	PROP_GUID = UNIT_PROP_COUNT,
+	PROP_UNITS,
+	PROP_COUNT
+};
+
+static const struct property {
+	const char *file;
+	const char *label;
+} properties[PROP_COUNT] = {
+	[PROP_VENDOR]                = { "vendor", "vendor ID" },
+	[PROP_MODEL]                 = { "model", "model ID" },
+	[PROP_HARDWARE_VERSION]      = { "hardware_version", "hardware version ID" },
+	[PROP_VENDOR_NAME]           = { "vendor_name", "vendor" },
+	[PROP_MODEL_NAME]            = { "model_name", "model" },
+	[PROP_HARDWARE_VERSION_NAME] = { "hardware_version_name", "hardware version" },
+	[PROP_SPECIFIER_ID]          = { "specifier_id", "specifier ID" },
+	[PROP_VERSION]               = { "version", "version" },
+	[PROP_GUID]                  = { "guid", "guid" },
+	[PROP_UNITS]                 = { "units", "units" },
+};
+
+struct unit {
+	char *name;
+	unsigned long number;
+	char *values[UNIT_PROP_COUNT];
+};
+
+struct device {
+	char *name;
+	unsigned long number;
+	char *values[PROP_COUNT];
+	struct unit *units;
+	unsigned int unit_count;
+};
+
+static bool verbose;
+static bool json;
+static bool watch;
+static unsigned int job_count = 1;
+static int devices_fd;
+
+static struct device *devices;
+static unsigned int device_count;
+static unsigned int next_device;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void help(void)
+{
+	fputs("Usage: lsfirewire [options]\n"
+	      "Options:\n"
+	      "  -v, --verbose   Show properties of the devices.\n"
+	      "  -j, --jobs=N    Read the devices with N threads.\n"
+	      "      --json      Print one JSON object per device.\n"
+	      "      --watch     Keep running, and show added, removed, and\n"
+	      "                  changed devices.\n"
+	      "      --help      Print this message and exit.\n"
+	      "      --version   Print the version number and exit.\n"
+	      "\n"
+	      "Report bugs to <" PACKAGE_BUGREPORT ">.\n"
+	      PACKAGE_NAME " home page: <" PACKAGE_URL ">.\n",
+	      stderr);
+}
+
+static void parse_parameters(int argc, char *argv[])
+{
+	static const char short_options[] = "vj:";
+	static const struct option long_options[] = {
+		{ "verbose", 0, NULL, 'v' },
+		{ "jobs", 1, NULL, 'j' },
+		{ "json", 0, NULL, 'J' },
+		{ "watch", 0, NULL, 'w' },
+		{ "help", 0, NULL, 'h' },
+		{ "version", 0, NULL, 'V' },
+		{}
+	};
+	char *endptr;
+	long val;
+	int c;
+
+	opterr = 0;
+	while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+		switch (c) {
+		case 'v':
+			verbose = true;
+			break;
+		case 'j':
+			val = strtol(optarg, &endptr, 0);
+			if (*endptr != '\0' || val < 1 || val > 1024) {
+				fprintf(stderr, "invalid number of jobs: `%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			job_count = val;
+			break;
+		case 'J':
+			json = true;
+			break;
+		case 'w':
+			watch = true;
+			break;
+		case 'h':
+			help();
+			exit(EXIT_SUCCESS);
+		case 'V':
+			puts("lsfirewire version " PACKAGE_VERSION);
+			exit(EXIT_SUCCESS);
+		default:
+			fprintf(stderr, "Unknown option: %s\n", argv[optind - 1]);
+			help();
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (optind < argc) {
+		fprintf(stderr, "Unknown option: %s\n", argv[optind]);
+		help();
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void check_bus(void)
+{
+	struct stat st;
+
+	if (stat(SYSFS_BUS, &st) == 0 && S_ISDIR(st.st_mode))
+		return;
+	if (stat(SYSFS_LEGACY_BUS, &st) == 0 && S_ISDIR(st.st_mode)) {
+		fputs("This program does not work with the old ieee1394 stack.\n"
+		      "Try unloading the ieee1394 module and then loading firewire-ohci.\n",
+		      stderr);
+	} else {
+		fputs("Directory " SYSFS_BUS " not found.\n"
+		      "Try loading the firewire-ohci module.\n", stderr);
+	}
+	exit(EXIT_FAILURE);
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+/*
+ * Returns the first line of the attribute file of the device or unit, without
+ * surrounding white space, or NULL if the file does not exist or is empty.
+ */
+static char *read_property(const char *dir, const char *file)
+{
+	char path[256], buf[256];
+	const char *start, *end;
+	ssize_t length;
+	char *value;
+	int fd;
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= (int)sizeof(path))
+		return NULL;
+	fd = openat(devices_fd, path, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	length = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (length <= 0)
+		return NULL;
+	buf[length] = '\0';
+
+	start = buf;
+	while (*start == ' ' || *start == '\t')
+		++start;
+	end = strchr(start, '\n');
+	if (!end)
+		end = start + strlen(start);
+	while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+		--end;
+	if (end == start)
+		return NULL;
+
+	value = xmalloc(end - start + 1);
+	memcpy(value, start, end - start);
+	value[end - start] = '\0';
+	return value;
+}
+
+/* reads only what show_device() needs */
+static void read_device_names(struct device *device)
+{
+	struct unit *unit0 = NULL;
+
+	if (device->unit_count > 0 && device->units[0].number == 0)
+		unit0 = &device->units[0];
+
+	device->values[PROP_VENDOR_NAME] = read_property(device->name, "vendor_name");
+	if (!device->values[PROP_VENDOR_NAME] && unit0)
+		unit0->values[PROP_VENDOR_NAME] = read_property(unit0->name, "vendor_name");
+	if (!device->values[PROP_VENDOR_NAME] && !(unit0 && unit0->values[PROP_VENDOR_NAME]))
+		device->values[PROP_VENDOR] = read_property(device->name, "vendor");
+
+	device->values[PROP_MODEL_NAME] = read_property(device->name, "model_name");
+	if (!device->values[PROP_MODEL_NAME] && unit0)
+		unit0->values[PROP_MODEL_NAME] = read_property(unit0->name, "model_name");
+	if (!device->values[PROP_MODEL_NAME] && !(unit0 && unit0->values[PROP_MODEL_NAME]))
+		device->values[PROP_MODEL] = read_property(device->name, "model");
+}
+
+static void read_device(struct device *device)
+{
+	struct unit *unit;
+	unsigned int i, p;
+
+	if (!verbose && !json) {
+		read_device_names(device);
+		return;
+	}
+	for (p = 0; p < PROP_COUNT; ++p)
+		device->values[p] = read_property(device->name, properties[p].file);
+	for (i = 0; i < device->unit_count; ++i) {
+		unit = &device->units[i];
+		for (p = 0; p < UNIT_PROP_COUNT; ++p)
+			unit->values[p] = read_property(unit->name, properties[p].file);
+	}
+}
+
+static void *read_devices_worker(void *arg)
+{
+	unsigned int index;
+
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		index = next_device++;
+		pthread_mutex_unlock(&lock);
+		if (index >= device_count)
+			break;
+		read_device(&devices[index]);
+	}
+	return NULL;
+}
+
+static void read_devices(void)
+{
+	pthread_t threads[64];
+	unsigned int thread_count = 0, i;
+
+	if (job_count > device_count)
+		job_count = device_count;
+	if (job_count > ARRAY_SIZE(threads))
+		job_count = ARRAY_SIZE(threads);
+	if (job_count > 1)
+		for (; thread_count < job_count; ++thread_count)
+			if (pthread_create(&threads[thread_count], NULL,
+					   read_devices_worker, NULL) != 0)
+				break;
+	/* without threads, or if some could not be created */
+	read_devices_worker(NULL);
+	for (i = 0; i < thread_count; ++i)
+		pthread_join(threads[i], NULL);
+}
+
+/* Returns the number after "fw", or -1 if it is not a number. */
+static long parse_number(const char *s)
+{
+	char *endptr;
+	long number;
+
+	if (!isdigit(*s))
+		return -1;
+	number = strtol(s, &endptr, 10);
+	return *endptr ? -1 : number;
+}
+
+static int compare_devices(const void *a, const void *b)
+{
+	const struct device *x = a, *y = b;
+
+	return x->number < y->number ? -1 : x->number > y->number;
+}
+
+static int compare_units(const void *a, const void *b)
+{
+	const struct unit *x = a, *y = b;
+
+	return x->number < y->number ? -1 : x->number > y->number;
+}
+
+static struct device *find_device(unsigned long number)
+{
+	struct device key = { .number = number };
+
+	return bsearch(&key, devices, device_count, sizeof(*devices), compare_devices);
+}
+
+/* Lists the devices fwN and their units fwN.M, both sorted by number. */
+static void scan_devices(void)
+{
+	struct dirent *dirent;
+	struct device *device;
+	struct unit *unit;
+	unsigned int allocated = 0, i;
+	const char *dot;
+	long number, unit_number;
+	DIR *dir;
+
+	dir = fdopendir(dup(devices_fd));
+	if (!dir) {
+		perror(SYSFS_DEVICES);
+		exit(EXIT_FAILURE);
+	}
+	while ((dirent = readdir(dir))) {
+		if (strncmp(dirent->d_name, "fw", 2) || strchr(dirent->d_name, '.'))
+			continue;
+		number = parse_number(dirent->d_name + 2);
+		if (number < 0)
+			continue;
+		if (device_count >= allocated) {
+			allocated = allocated ? allocated * 2 : 16;
+			devices = realloc(devices, allocated * sizeof(*devices));
+			if (!devices) {
+				fputs("out of memory\n", stderr);
+				exit(EXIT_FAILURE);
+			}
+		}
+		device = &devices[device_count++];
+		memset(device, 0, sizeof(*device));
+		device->name = strdup(dirent->d_name);
+		device->number = number;
+		if (!device->name) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	qsort(devices, device_count, sizeof(*devices), compare_devices);
+
+	rewinddir(dir);
+	while ((dirent = readdir(dir))) {
+		dot = strchr(dirent->d_name, '.');
+		if (strncmp(dirent->d_name, "fw", 2) || !dot)
+			continue;
+		number = strtol(dirent->d_name + 2, NULL, 10);
+		unit_number = strtol(dot + 1, NULL, 10);
+		device = find_device(number);
+		if (!device || dot != dirent->d_name + 2 + strlen(device->name + 2))
+			continue;
+		device->units = realloc(device->units, (device->unit_count + 1) * sizeof(*unit));
+		if (!device->units) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		unit = &device->units[device->unit_count++];
+		memset(unit, 0, sizeof(*unit));
+		unit->name = strdup(dirent->d_name);
+		unit->number = unit_number;
+		if (!unit->name) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	closedir(dir);
+
+	for (i = 0; i < device_count; ++i)
+		qsort(devices[i].units, devices[i].unit_count, sizeof(*unit), compare_units);
+}
+
+static const char *first_value(const char *a, const char *b, const char *c)
+{
+	return a ? a : b ? b : c ? c : "";
+}
+
+/*
+ * The vendor and model names can be in either the root directory or the
+ * (first) unit directory, so try both.  Try the vendor/model number as last
+ * resort.
+ */
+static void show_device(const struct device *device)
+{
+	const struct unit *unit0 = NULL;
+
+	if (device->unit_count > 0 && device->units[0].number == 0)
+		unit0 = &device->units[0];
+	printf("%s: %s %s\n", device->name,
+	       first_value(device->values[PROP_VENDOR_NAME],
+			   unit0 ? unit0->values[PROP_VENDOR_NAME] : NULL,
+			   device->values[PROP_VENDOR]),
+	       first_value(device->values[PROP_MODEL_NAME],
+			   unit0 ? unit0->values[PROP_MODEL_NAME] : NULL,
+			   device->values[PROP_MODEL]));
+}
+
+static void show_properties(char *const values[], unsigned int count, const char *indent)
+{
+	unsigned int p;
+
+	for (p = 0; p < count; ++p)
+		if (values[p])
+			printf("%s%s: %s\n", indent, properties[p].label, values[p]);
+}
+
+static void show_device_verbose(const struct device *device)
+{
+	unsigned int i;
+
+	printf("device %s:\n", device->name);
+	show_properties(device->values, PROP_COUNT, "  ");
+	for (i = 0; i < device->unit_count; ++i) {
+		printf("  unit %s:\n", device->units[i].name);
+		show_properties(device->units[i].values, UNIT_PROP_COUNT, "    ");
+	}
+}
+
+static void print_json_string(const char *s)
+{
+	unsigned char c;
+
+	putchar('"');
+	for (; *s; ++s) {
+		c = *s;
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20 || c >= 0x7f)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	putchar('"');
+}
+
+static void print_json_properties(char *const values[], unsigned int count)
+{
+	const char *separator = "";
+	unsigned int p;
+
+	fputs("\"properties\":{", stdout);
+	for (p = 0; p < count; ++p) {
+		if (!values[p])
+			continue;
+		printf("%s\"%s\":", separator, properties[p].file);
+		print_json_string(values[p]);
+		separator = ",";
+	}
+	putchar('}');
+}
+
+/* action is NULL for the initial list, or the uevent action in watch mode */
+static void show_device_json(const struct device *device, const char *action)
+{
+	unsigned int i;
+
+	putchar('{');
+	if (action) {
+		fputs("\"action\":", stdout);
+		print_json_string(action);
+		putchar(',');
+	}
+	fputs("\"name\":", stdout);
+	print_json_string(device->name);
+	putchar(',');
+	print_json_properties(device->values, PROP_COUNT);
+	fputs(",\"units\":[", stdout);
+	for (i = 0; i < device->unit_count; ++i) {
+		fputs(i ? ",{\"name\":" : "{\"name\":", stdout);
+		print_json_string(device->units[i].name);
+		putchar(',');
+		print_json_properties(device->units[i].values, UNIT_PROP_COUNT);
+		putchar('}');
+	}
+	puts("]}");
+}
+
+static void show_record(const struct device *device, const char *action)
+{
+	if (json) {
+		show_device_json(device, action);
+		return;
+	}
+	printf("%s ", action);
+	if (verbose)
+		show_device_verbose(device);
+	else
+		show_device(device);
+}
+
+static void free_device(struct device *device)
+{
+	unsigned int i, p;
+
+	for (i = 0; i < device->unit_count; ++i) {
+		for (p = 0; p < UNIT_PROP_COUNT; ++p)
+			free(device->units[i].values[p]);
+		free(device->units[i].name);
+	}
+	free(device->units);
+	for (p = 0; p < PROP_COUNT; ++p)
+		free(device->values[p]);
+	free(device->name);
+}
+
+/*
+ * Reads the device fwN and its units again, like scan_devices() and
+ * read_devices() do for all devices.  Returns false if it no longer exists.
+ */
+static bool rescan_device(struct device *device, unsigned long number)
+{
+	struct dirent *dirent;
+	struct unit *unit;
+	size_t length;
+	char name[32];
+	long unit_number;
+	DIR *dir;
+
+	memset(device, 0, sizeof(*device));
+	snprintf(name, sizeof(name), "fw%lu", number);
+	if (faccessat(devices_fd, name, F_OK, 0) != 0)
+		return false;
+	device->name = strdup(name);
+	device->number = number;
+	if (!device->name) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+
+	dir = fdopendir(dup(devices_fd));
+	if (!dir) {
+		perror(SYSFS_DEVICES);
+		exit(EXIT_FAILURE);
+	}
+	length = strlen(name);
+	while ((dirent = readdir(dir))) {
+		if (strncmp(dirent->d_name, name, length) || dirent->d_name[length] != '.')
+			continue;
+		unit_number = parse_number(dirent->d_name + length + 1);
+		if (unit_number < 0)
+			continue;
+		device->units = realloc(device->units, (device->unit_count + 1) * sizeof(*unit));
+		if (!device->units) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		unit = &device->units[device->unit_count++];
+		memset(unit, 0, sizeof(*unit));
+		unit->name = strdup(dirent->d_name);
+		unit->number = unit_number;
+		if (!unit->name) {
+			fputs("out of memory\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+	closedir(dir);
+	qsort(device->units, device->unit_count, sizeof(*unit), compare_units);
+
+	read_device(device);
+	return true;
+}
+
+static bool same_values(char *const a[], char *const b[], unsigned int count)
+{
+	unsigned int p;
+
+	for (p = 0; p < count; ++p)
+		if ((a[p] || b[p]) && (!a[p] || !b[p] || strcmp(a[p], b[p])))
+			return false;
+	return true;
+}
+
+static bool same_device(const struct device *a, const struct device *b)
+{
+	unsigned int i;
+
+	if (a->unit_count != b->unit_count ||
+	    !same_values(a->values, b->values, PROP_COUNT))
+		return false;
+	for (i = 0; i < a->unit_count; ++i)
+		if (strcmp(a->units[i].name, b->units[i].name) ||
+		    !same_values(a->units[i].values, b->units[i].values, UNIT_PROP_COUNT))
+			return false;
+	return true;
+}
+
+static void update_device(unsigned long number)
+{
+	struct device new_device, *device;
+	unsigned int index;
+
+	device = find_device(number);
+	if (!rescan_device(&new_device, number)) {
+		if (device) {
+			show_record(device, "remove");
+			free_device(device);
+			index = device - devices;
+			memmove(device, device + 1, (--device_count - index) * sizeof(*device));
+		}
+		return;
+	}
+	if (device) {
+		if (!same_device(device, &new_device))
+			show_record(&new_device, "change");
+		free_device(device);
+		*device = new_device;
+		return;
+	}
+
+	devices = realloc(devices, (device_count + 1) * sizeof(*devices));
+	if (!devices) {
+		fputs("out of memory\n", stderr);
+		exit(EXIT_FAILURE);
+	}
+	for (index = 0; index < device_count; ++index)
+		if (devices[index].number > number)
+			break;
+	memmove(&devices[index + 1], &devices[index], (device_count - index) * sizeof(*devices));
+	devices[index] = new_device;
+	++device_count;
+	show_record(&new_device, "add");
+}
+
+/* the kernel's uevents, without udev's processing */
+static int open_uevents(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,
+	};
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (fd == -1 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		perror("cannot listen to uevents");
+		exit(EXIT_FAILURE);
+	}
+	return fd;
+}
+
+/*
+ * A uevent is "action@devpath" followed by KEY=value strings.  Returns the
+ * number N of the device fwN, or -1 if the event is not about a FireWire
+ * device or unit (fwN.M).
+ */
+static long parse_uevent(const char *buf, size_t length)
+{
+	const char *s, *end = buf + length, *name = NULL;
+	bool firewire = false;
+	char *endptr;
+	long number;
+
+	for (s = buf; s < end; s += strlen(s) + 1) {
+		if (!strcmp(s, "SUBSYSTEM=firewire"))
+			firewire = true;
+		else if (!strncmp(s, "DEVPATH=", 8))
+			name = strrchr(s, '/');
+	}
+	if (!firewire || !name || strncmp(name, "/fw", 3) || !isdigit(name[3]))
+		return -1;
+	number = strtol(name + 3, &endptr, 10);
+	if (*endptr == '.' && parse_number(endptr + 1) >= 0)
+		return number;
+	return *endptr ? -1 : number;
+}
+
+/* after lost uevents */
+static void update_all_devices(void)
+{
+	struct dirent *dirent;
+	unsigned int i;
+	long number;
+	DIR *dir;
+
+	for (i = device_count; i > 0; --i)
+		update_device(devices[i - 1].number);
+	dir = fdopendir(dup(devices_fd));
+	if (!dir) {
+		perror(SYSFS_DEVICES);
+		exit(EXIT_FAILURE);
+	}
+	while ((dirent = readdir(dir))) {
+		if (strncmp(dirent->d_name, "fw", 2))
+			continue;
+		number = parse_number(dirent->d_name + 2);
+		if (number >= 0 && !find_device(number))
+			update_device(number);
+	}
+	closedir(dir);
+}
+
+/*
+ * Adding a device causes uevents for the device and then for each of its
+ * units, so the affected devices are collected until the events stop for a
+ * moment, and only then read again.
+ */
+static void watch_devices(int uevents_fd)
+{
+	unsigned long pending[64];
+	unsigned int pending_count = 0, i;
+	struct pollfd pfd;
+	char buf[8192];
+	ssize_t length;
+	long number;
+	int ready;
+
+	pfd.fd = uevents_fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		ready = poll(&pfd, 1, pending_count ? 100 : -1);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll failed");
+			exit(EXIT_FAILURE);
+		}
+		if (ready == 0 || pending_count == ARRAY_SIZE(pending)) {
+			for (i = 0; i < pending_count; ++i)
+				update_device(pending[i]);
+			pending_count = 0;
+			fflush(stdout);
+			continue;
+		}
+
+		length = recv(uevents_fd, buf, sizeof(buf) - 1, 0);
+		if (length < 0) {
+			if (errno == ENOBUFS) {
+				update_all_devices();
+				fflush(stdout);
+			} else if (errno != EINTR) {
+				perror("cannot read uevent");
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		buf[length] = '\0';
+		number = parse_uevent(buf, length);
+		if (number < 0)
+			continue;
+		for (i = 0; i < pending_count; ++i)
+			if (pending[i] == (unsigned long)number)
+				break;
+		if (i == pending_count)
+			pending[pending_count++] = number;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i;
+	int uevents_fd = -1;
+
+	parse_parameters(argc, argv);
+	check_bus();
+
+	devices_fd = open(SYSFS_DEVICES, O_RDONLY | O_DIRECTORY);
+	if (devices_fd == -1)
+		return 0;
+	/* before the scan, so that no change gets lost in between */
+	if (watch)
+		uevents_fd = open_uevents();
+	scan_devices();
+	read_devices();
+
+	for (i = 0; i < device_count; ++i)
+		if (json)
+			show_device_json(&devices[i], NULL);
+		else if (verbose)
+			show_device_verbose(&devices[i]);
+		else
+			show_device(&devices[i]);
+
+	if (watch) {
+		fflush(stdout);
+		watch_devices(uevents_fd);
+	}
+	close(devices_fd);
+	return 0;
+}
@@ -12,186 +12,112 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
-#include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
 #include <getopt.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <linux/firewire-cdev.h>
 #include <linux/firewire-constants.h>
 
 #include "config.h"
+#include "fw-device.h"
+#include "fw-retry.h"
+#include "fw-stats.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof *(a))
 
 #define ptr_to_u64(p) ((uintptr_t)(p))
 
+#define DEFAULT_CACHE_DIR "/run/lsfirewirephy"
+
 #define PHY_REMOTE_ACCESS_PAGED(phy_id, page, port, reg) \
 	(((phy_id) << 24) | (5 << 18) | ((page) << 15) | ((port) << 11) | ((reg) << 8))
 #define PHY_REMOTE_REPLY_PAGED(phy_id, page, port, reg, data) \
 	(((phy_id) << 24) | (7 << 18) | ((page) << 15) | ((port) << 11) | ((reg) << 8) | (data))
 
 typedef __u8 u8;
+typedef __u16 u16;
 typedef __u32 u32;
 typedef __u64 u64;
 
 typedef u32 u24;
 
-static const struct vendor {
-	u24 oui;
-	const char *name;
-	const struct phy {
-		u24 id;
-		const char *name;
-		u24 mask;
-	} *phys;
-} vendors[] = {
-	{
-		.oui  = 0x00000e,
-		.name = "Fujitsu",
-		.phys = (const struct phy[]) {
-			{ 0x086613, "MB86613" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x00004c,
-		.name = "NEC",
-		.phys = (const struct phy[]) {
-			{ 0x000201, "PD7286x" },
-			{ 0x050160, "PD7287x" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x00053d,
-		.name = "Agere (LSI)",
-		.phys = (const struct phy[]) {
-			{ 0x053300, "FW533E", 0xffff00 },
-			{ 0x064300, "FW643(E)", 0xffff00 },
-			{ 0x084300, "FW843", 0xffff00 },
-			{}
-		}
-	},
-	{
-		.oui  = 0x000cc2,
-		.name = "ControlNet India (O2Micro)",
-		.phys = (const struct phy[]) {
-			{ 0x401104, "OZxxx" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x001018,
-		.name = "Broadcom",
-		.phys = (const struct phy[]) {
-			{}
-		}
-	},
-	{
-		/*
-		 * This OUI actually belongs to System S.p.A.;
-		 * VIA's OUI is 0x004063.
-		 */
-		.oui  = 0x001163,
-		.name = "VIA",
-		.phys = (const struct phy[]) {
-			{ 0x306001, "VT63xx" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x001454,
-		.name = "Symwave",
-		.phys = (const struct phy[]) {
-			{ 0x003181, "SW3080" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x001b8c,
-		.name = "JMicron",
-		.phys = (const struct phy[]) {
-			{ 0x038100, "JMB38x" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x00601d,
-		.name = "Lucent (LSI)",
-		.phys = (const struct phy[]) {
-			{ 0x032200, "FW322", 0xffff00 },
-			{ 0x032300, "FW323", 0xffff00 },
-			{ 0x080200, "FW802", 0xffff00 },
-			{}
-		}
-	},
-	{
-		.oui  = 0x006037,
-		.name = "Philips (NXP)",
-		.phys = (const struct phy[]) {
-			{ 0x412801, "PDI1394P25" },
-			{ 0x422001, "PDI1394P23" },
-			{ 0x423900, "PDI1394P24", 0xffff0f },
-			{ 0x431000, "PDI1394P21" },
-			{ 0x431100, "PDI1394P22" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x00c02d,
-		.name = "Fujifilm",
-		.phys = (const struct phy[]) {
-			{ 0x303562, "MD8405B" },
-			{ 0x303565, "MD8405E" },
-			{}
-		}
-	},
-	{
-		.oui  = 0x080028,
-		.name = "Texas Instruments",
-		.phys = (const struct phy[]) {
-			{ 0x42308a, "TSB41LV02A" },
-			{ 0x424296, "TSB41AB1/2" },
-			{ 0x424499, "TSB43AB22(A)" },
-			{ 0x424729, "XIO2200A" },
-			{ 0x434195, "TSB41AB3" },
-			{ 0x434615, "TSB43CB43A" },
-			{ 0x46318a, "TSB41LV06A" },
-			{ 0x831304, "TSB81BA3(A)" },
-			{ 0x831306, "TSB81BA3D" },
-			{ 0x831307, "TSB81BA3E/XIO2213" },
-			{ 0x833005, "TSB41BA3D" },
-			{}
-		}
-	},
+/*
+ * The tables are generated from phy-ids.txt by gen-phy-ids.py, which can also
+ * write them into a database file for --database.  The vendors are sorted by
+ * OUI; the PHYs of a vendor start at first_phy, with the exact IDs sorted,
+ * followed by the IDs that must be masked, which are searched linearly.
+ */
+struct vendor {
+	u32 oui;
+	u32 name;	/* offset into the strings */
+	u32 first_phy;
+	u16 phy_count;
+	u16 masked_count;
+};
+
+struct phy {
+	u32 id;		/* with the mask applied */
+	u32 mask;
+	u32 name;
+};
+
+#include "phy-ids.h"
+
+#define PHY_DB_MAGIC		"FWPHYDB1"
+#define PHY_DB_BYTE_ORDER	0x01020304
+
+struct phy_db_header {
+	char magic[8];
+	u32 byte_order;
+	u32 vendor_count;
+	u32 phy_count;
+	u32 strings_size;
+};
+
+struct phy_db {
+	const struct vendor *vendors;
+	unsigned int vendor_count;
+	const struct phy *phys;
+	unsigned int phy_count;
+	const char *strings;
+};
+
+static struct phy_db phy_dbs[2] = {
 	{
-		.oui  = 0x10005a,
-		.name = "IBM",
-		.phys = (const struct phy[]) {
-			{ 0x218600, "IBM21S860", 0xfffff0 },
-			{ 0x218610, "IBM21S861", 0xfffff0 },
-			{ 0x218620, "IBM21S862", 0xfffff0 },
-			{}
-		}
+		.vendors      = builtin_vendors,
+		.vendor_count = ARRAY_SIZE(builtin_vendors),
+		.phys         = builtin_phys,
+		.phy_count    = ARRAY_SIZE(builtin_phys),
+		.strings      = builtin_strings,
 	},
-	{}
 };
+static unsigned int phy_db_count = 1;
 
 static char *device_file_name;
 static int list_phy_id = -1;
-static int fd;
 static bool any_unknown_phys;
-struct fw_cdev_get_info get_info;
-struct fw_cdev_event_bus_reset bus_reset;
+static const char *cache_dir;
+static const char *database_file_name;
+static bool watch;
+static struct fw_device_index devices;
 
 static void help(void)
 {
 	fputs("Usage: lsfirewirephy [options] [devicenode [phyid]]\n"
 	      "Options:\n"
+	      "     --database=FILE\n"
+	      "                 look up PHY IDs in FILE before the built-in table\n"
+	      "     --cache[=DIR]\n"
+	      "                 reuse PHY IDs saved in DIR (" DEFAULT_CACHE_DIR ")\n"
+	      "     --watch     after the list, show the PHYs that change at bus resets\n"
+	      "     --stats     print time spent in system calls at exit\n"
 	      " -h, --help      show this message and exit\n"
 	      " -V, --version   show version number and exit\n"
 	      "\n"
@@ -204,6 +130,10 @@ static void parse_parameters(int argc, char *argv[])
 {
 	static const char short_options[] = "hV";
 	static const struct option long_options[] = {
+		{ "cache", 2, NULL, 'c' },
+		{ "database", 1, NULL, 'd' },
+		{ "watch", 0, NULL, 'w' },
+		{ "stats", 0, NULL, 'S' },
 		{ "help", 0, NULL, 'h' },
 		{ "version", 0, NULL, 'V' },
 		{}
@@ -213,6 +143,18 @@ static void parse_parameters(int argc, char *argv[])
 
 	while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
 		switch (c) {
+		case 'c':
+			cache_dir = optarg ? optarg : DEFAULT_CACHE_DIR;
+			break;
+		case 'd':
+			database_file_name = optarg;
+			break;
+		case 'w':
+			watch = true;
+			break;
+		case 'S':
+			fw_stats_enable();
+			break;
 		case 'h':
 			help();
 			exit(EXIT_SUCCESS);
@@ -249,276 +191,749 @@ static void parse_parameters(int argc, char *argv[])
 	}
 }
 
-static struct dirent **fw_dirents;
-static int fw_dirent_count;
-static int fw_dirent_index;
+static void probe_failed(const struct fw_device *device)
+{
+	errno = device->error;
+	perror(device->invalid ? "GET_INFO ioctl failed" : device->name);
+	exit(EXIT_FAILURE);
+}
 
-static int fw_filter(const struct dirent *dirent)
+static void check_kernel_version(const struct fw_device *device)
 {
-	return dirent->d_name[0] == 'f' &&
-	       dirent->d_name[1] == 'w' &&
-	       isdigit(dirent->d_name[2]);
+	if (device->version < 4) {
+		fputs("this kernel is too old\n", stderr);
+		exit(EXIT_FAILURE);
+	}
 }
 
-static void init_enumerated_fw_devs(void)
+static struct fw_device *open_device(void)
 {
-	fw_dirent_count = scandir("/dev", &fw_dirents, fw_filter, versionsort);
-	if (fw_dirent_count < 0) {
-		perror("cannot read /dev");
+	struct fw_device *device;
+
+	device = fw_device_get(&devices, device_file_name);
+	if (!fw_device_probe(&devices, device))
+		probe_failed(device);
+	check_kernel_version(device);
+	return device;
+}
+
+static void enable_phy_packets(const struct fw_device *device)
+{
+	struct fw_cdev_receive_phy_packets receive_phy_packets;
+
+	receive_phy_packets.closure = 0;
+	if (fw_stats_ioctl(device->fd, FW_CDEV_IOC_RECEIVE_PHY_PACKETS, &receive_phy_packets) < 0) {
+		perror("RECEIVE_PHY_PACKETS ioctl failed");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* maps a database file made by gen-phy-ids.py --binary, which is searched first */
+static void load_phy_db(void)
+{
+	const struct phy_db_header *header;
+	struct phy_db db;
+	struct stat st;
+	const u8 *map;
+	size_t size;
+	unsigned int i;
+	int db_fd;
+
+	db_fd = open(database_file_name, O_RDONLY);
+	if (db_fd < 0 || fstat(db_fd, &st) < 0) {
+		perror(database_file_name);
+		exit(EXIT_FAILURE);
+	}
+	size = st.st_size;
+	if (size < sizeof(*header))
+		goto invalid;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, db_fd, 0);
+	if (map == MAP_FAILED) {
+		perror(database_file_name);
 		exit(EXIT_FAILURE);
 	}
-	fw_dirent_index = 0;
+	close(db_fd);
+
+	header = (const void *)map;
+	if (memcmp(header->magic, PHY_DB_MAGIC, sizeof(header->magic)) ||
+	    header->byte_order != PHY_DB_BYTE_ORDER ||
+	    header->vendor_count > size / sizeof(struct vendor) ||
+	    header->phy_count > size / sizeof(struct phy) ||
+	    sizeof(*header) + header->vendor_count * sizeof(struct vendor) +
+	    header->phy_count * sizeof(struct phy) + header->strings_size != size ||
+	    header->strings_size == 0 || map[size - 1] != '\0')
+		goto invalid;
+
+	db.vendors = (const void *)(map + sizeof(*header));
+	db.vendor_count = header->vendor_count;
+	db.phys = (const void *)(db.vendors + db.vendor_count);
+	db.phy_count = header->phy_count;
+	db.strings = (const char *)(db.phys + db.phy_count);
+	for (i = 0; i < db.vendor_count; ++i)
+		if (db.vendors[i].name >= header->strings_size ||
+		    db.vendors[i].first_phy > db.phy_count ||
+		    db.vendors[i].phy_count + db.vendors[i].masked_count >
+		    db.phy_count - db.vendors[i].first_phy)
+			goto invalid;
+	for (i = 0; i < db.phy_count; ++i)
+		if (db.phys[i].name >= header->strings_size)
+			goto invalid;
+
+	phy_dbs[1] = phy_dbs[0];
+	phy_dbs[0] = db;
+	phy_db_count = 2;
+	return;
+
+invalid:
+	fprintf(stderr, "%s: invalid PHY ID database\n", database_file_name);
+	exit(EXIT_FAILURE);
 }
 
-static void cleanup_enumerated_fw_devs(void)
+static int compare_vendor(const void *key, const void *entry)
 {
-	int i;
+	u24 oui = *(const u24 *)key;
+	const struct vendor *vendor = entry;
 
-	for (i = 0; i < fw_dirent_count; ++i)
-		free(fw_dirents[i]);
-	free(fw_dirents);
-	fw_dirents = NULL;
-	fw_dirent_count = 0;
+	return oui < vendor->oui ? -1 : oui > vendor->oui;
 }
 
-static bool has_enumerated_fw_dev(void)
+static int compare_phy(const void *key, const void *entry)
 {
-	free(device_file_name);
-	device_file_name = NULL;
+	u24 id = *(const u24 *)key;
+	const struct phy *phy = entry;
 
-	if (fw_dirent_index < fw_dirent_count) {
-		if (asprintf(&device_file_name, "/dev/%s",
-			     fw_dirents[fw_dirent_index]->d_name) < 0) {
-			perror("asprintf failed");
-			exit(EXIT_FAILURE);
+	return id < phy->id ? -1 : id > phy->id;
+}
+
+static const struct vendor *search_vendor(const struct phy_db *db, u24 oui)
+{
+	return bsearch(&oui, db->vendors, db->vendor_count, sizeof(*db->vendors),
+		       compare_vendor);
+}
+
+static const struct phy *search_phy(const struct phy_db *db,
+				    const struct vendor *vendor, u24 id)
+{
+	const struct phy *phy, *masked;
+	unsigned int i;
+
+	phy = bsearch(&id, db->phys + vendor->first_phy, vendor->phy_count,
+		      sizeof(*db->phys), compare_phy);
+	if (phy)
+		return phy;
+	masked = db->phys + vendor->first_phy + vendor->phy_count;
+	for (i = 0; i < vendor->masked_count; ++i)
+		if ((id & masked[i].mask) == masked[i].id)
+			return &masked[i];
+	return NULL;
+}
+
+/* returns false if the PHY is unknown; *vendor_name is NULL if the OUI is, too */
+static bool look_up_phy(u24 oui, u24 id, const char **vendor_name, const char **phy_name)
+{
+	const struct phy_db *db;
+	const struct vendor *vendor;
+	const struct phy *phy;
+	unsigned int i;
+
+	*vendor_name = NULL;
+	for (i = 0; i < phy_db_count; ++i) {
+		db = &phy_dbs[i];
+		vendor = search_vendor(db, oui);
+		if (!vendor)
+			continue;
+		if (!*vendor_name)
+			*vendor_name = db->strings + vendor->name;
+		phy = search_phy(db, vendor, id);
+		if (phy) {
+			*phy_name = db->strings + phy->name;
+			return true;
 		}
-		return true;
-	} else {
-		cleanup_enumerated_fw_devs();
-		return false;
 	}
+	return false;
 }
 
-static void next_enumerated_fw_dev(void)
+/*
+ * All buses are listed at the same time, and on each bus, the registers of
+ * all PHYs are asked for in one burst.  The closure of each packet is the PHY
+ * ID and register number, the replies are matched by the PHY ID they contain,
+ * and each PHY times out on its own.  The events of all buses are waited for
+ * with a single epoll, and the results are printed in the order of the buses
+ * and PHYs.
+ *
+ * With --watch, a bus is scanned again after each of its bus resets, and the
+ * PHYs that differ from those of the previous scan are printed.  The closures
+ * include the number of the scan, so that the events of packets of an earlier
+ * one can be ignored.
+ */
+#define PHY_TIMEOUT	123	/* milliseconds */
+
+#define PHY_CLOSURE(scan, phy_id, reg)	(((u64)(scan) << 9) | ((phy_id) << 3) | (reg))
+#define CLOSURE_SCAN(closure)		((closure) >> 9)
+
+struct phy_state {
+	unsigned int regs_read;
+	u8 reg_values[6];
+	u64 deadline;
+	bool done;
+	bool timed_out;
+	u64 guid;	/* of the node, if it has a device file */
+};
+
+struct bus {
+	int fd;
+	u32 card;
+	struct fw_retry retry;
+	u64 local_guid;
+	int first_phy_id;
+	int last_phy_id;
+	bool whole_bus;		/* last_phy_id follows the root node */
+	unsigned int phys_pending;
+	struct phy_state phys[63];
+	unsigned int scan;
+	bool listed;
+	bool rescanning;
+	int previous_last_phy_id;
+	struct phy_state previous_phys[63];
+};
+
+static struct bus *buses;
+static unsigned int bus_count;
+
+static u64 monotonic_ms(void)
 {
-	++fw_dirent_index;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000uLL + ts.tv_nsec / 1000000;
 }
 
-static bool open_device(bool force)
+/* the device must be a local node with PHY packets enabled */
+static void add_bus(const struct fw_device *device, int first_phy_id, int last_phy_id)
 {
-	fd = open(device_file_name, O_RDWR);
-	if (fd == -1) {
-		if (!force && errno == ENODEV)
-			return false;
-		perror(device_file_name);
+	struct bus *bus;
+
+	buses = realloc(buses, (bus_count + 1) * sizeof(*buses));
+	if (!buses) {
+		fputs("out of memory\n", stderr);
 		exit(EXIT_FAILURE);
 	}
+	bus = &buses[bus_count++];
+	memset(bus, 0, sizeof(*bus));
+	bus->fd = device->fd;
+	bus->card = device->card;
+	fw_retry_init(&bus->retry, device->fd, device->generation, device->node_id);
+	bus->first_phy_id = first_phy_id;
+	bus->last_phy_id = last_phy_id;
+	bus->whole_bus = first_phy_id == 0 && last_phy_id == (device->bus_reset.root_node_id & 0x3f);
+}
 
-	get_info.version = 4;
-	get_info.rom_length = 0;
-	get_info.rom = 0;
-	get_info.bus_reset = ptr_to_u64(&bus_reset);
-	get_info.bus_reset_closure = 0;
-	if (ioctl(fd, FW_CDEV_IOC_GET_INFO, &get_info) < 0) {
-		perror("GET_INFO ioctl failed");
-		exit(EXIT_FAILURE);
+static void start_bus(struct bus *bus)
+{
+	struct fw_cdev_send_phy_packet send_phy_packet;
+	unsigned int reg;
+	int phy_id;
+	u64 deadline;
+
+	bus->phys_pending = 0;
+	send_phy_packet.generation = bus->retry.generation;
+	for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id) {
+		if (bus->phys[phy_id].done)
+			continue;
+		++bus->phys_pending;
+		for (reg = 2; reg <= 7; ++reg) {
+			send_phy_packet.closure = PHY_CLOSURE(bus->scan, phy_id, reg);
+			send_phy_packet.data[0] = PHY_REMOTE_ACCESS_PAGED(phy_id, 1, 0, reg);
+			send_phy_packet.data[1] = ~send_phy_packet.data[0];
+			fw_retry_send_phy_packet(&bus->retry, &send_phy_packet);
+		}
 	}
-	if (get_info.version < 4) {
-		fputs("this kernel is too old\n", stderr);
-		exit(EXIT_FAILURE);
+
+	deadline = monotonic_ms() + PHY_TIMEOUT;
+	for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id)
+		bus->phys[phy_id].deadline = deadline;
+}
+
+static void finish_phy(struct bus *bus, int phy_id, bool timed_out)
+{
+	struct phy_state *state = &bus->phys[phy_id];
+	unsigned int reg;
+
+	state->done = true;
+	state->timed_out = timed_out;
+	if (timed_out) {
+		fputs("timeout\n", stderr);
+		for (reg = 2; reg <= 7; ++reg)
+			fw_retry_forget(&bus->retry, PHY_CLOSURE(bus->scan, phy_id, reg));
 	}
+	if (--bus->phys_pending == 0) {
+		fw_retry_report(&bus->retry);
+		fw_retry_release(&bus->retry);
+	}
+}
+
+static void print_phy(const struct bus *bus, int phy_id, const struct phy_state *state)
+{
+	const u8 *reg_values = state->reg_values;
+	const char *vendor_name, *phy_name;
+	u24 oui, id;
+	bool known;
+
+	oui = (reg_values[0] << 16) | (reg_values[1] << 8) | reg_values[2];
+	id  = (reg_values[3] << 16) | (reg_values[4] << 8) | reg_values[5];
+	known = look_up_phy(oui, id, &vendor_name, &phy_name);
+
+	printf("bus %u, node %d: %06x:%06x  ", bus->card, phy_id, oui, id);
+	if (vendor_name)
+		printf("%s %s\n", vendor_name, known ? phy_name : "(unknown)");
+	else
+		printf("%s\n", "(unknown)");
 
-	return true;
+	if (!known)
+		any_unknown_phys = true;
 }
 
-static void enable_phy_packets(void)
+static u64 rom_guid(const struct fw_device *device)
 {
-	struct fw_cdev_receive_phy_packets receive_phy_packets;
+	if (device->rom_length < sizeof(device->rom) || (device->rom[0] >> 24) < 4)
+		return 0;
+	return ((u64)device->rom[3] << 32) | device->rom[4];
+}
 
-	receive_phy_packets.closure = 0;
-	if (ioctl(fd, FW_CDEV_IOC_RECEIVE_PHY_PACKETS, &receive_phy_packets) < 0) {
-		perror("RECEIVE_PHY_PACKETS ioctl failed");
-		exit(EXIT_FAILURE);
+/*
+ * After a bus reset in watch mode, the PHYs of the nodes whose GUID is still
+ * on the bus are taken from the last listing, wherever their PHY IDs are now,
+ * so that only the PHYs of new nodes, and of nodes without device files, are
+ * asked for their registers again.
+ */
+static void reuse_known_phys(struct bus *bus)
+{
+	const struct phy_state *old;
+	struct fw_device *device;
+	struct phy_state *state;
+	unsigned int i;
+	int phy_id, old_phy_id;
+	u64 guid;
+
+	for (i = 0; i < devices.count; ++i) {
+		device = devices.devices[i];
+		if (!device->probed || device->card != bus->card || !(guid = rom_guid(device)) ||
+		    !fw_device_update(&devices, device) ||
+		    device->generation != bus->retry.generation)
+			continue;
+		phy_id = device->node_id & 0x3f;
+		if (phy_id < bus->first_phy_id || phy_id > bus->last_phy_id)
+			continue;
+		state = &bus->phys[phy_id];
+		state->guid = guid;
+		for (old_phy_id = bus->first_phy_id; old_phy_id <= bus->previous_last_phy_id;
+		     ++old_phy_id) {
+			old = &bus->previous_phys[old_phy_id];
+			if (old->guid != guid || !old->done || old->timed_out)
+				continue;
+			memcpy(state->reg_values, old->reg_values, sizeof(state->reg_values));
+			state->regs_read = old->regs_read;
+			state->done = true;
+			break;
+		}
 	}
 }
 
-static bool device_is_local_node(void)
+/* after a bus reset in watch mode; the PHY IDs may have changed, so start over */
+static void rescan_bus(struct bus *bus, const struct fw_cdev_event_bus_reset *reset)
 {
-	return bus_reset.node_id == bus_reset.local_node_id;
+	if (bus->listed && !bus->rescanning) {
+		memcpy(bus->previous_phys, bus->phys, sizeof(bus->phys));
+		bus->previous_last_phy_id = bus->last_phy_id;
+		bus->rescanning = true;
+	}
+	fw_retry_release(&bus->retry);
+	fw_retry_init(&bus->retry, bus->fd, reset->generation, reset->node_id);
+	if (bus->whole_bus)
+		bus->last_phy_id = reset->root_node_id & 0x3f;
+	memset(bus->phys, 0, sizeof(bus->phys));
+	if (bus->rescanning)
+		reuse_known_phys(bus);
+	++bus->scan;
+	start_bus(bus);
 }
 
-static void check_local_node(void)
+static bool same_phy(const struct phy_state *a, const struct phy_state *b)
 {
-	if (!device_is_local_node()) {
-		fprintf(stderr, "%s: not a local node\n", device_file_name);
+	return !memcmp(a->reg_values, b->reg_values, sizeof(a->reg_values));
+}
+
+static void print_changes(const struct bus *bus)
+{
+	const struct phy_state *old, *new;
+	int phy_id;
+
+	for (phy_id = bus->first_phy_id; phy_id < 63; ++phy_id) {
+		old = phy_id <= bus->previous_last_phy_id &&
+		      !bus->previous_phys[phy_id].timed_out ? &bus->previous_phys[phy_id] : NULL;
+		new = phy_id <= bus->last_phy_id &&
+		      !bus->phys[phy_id].timed_out ? &bus->phys[phy_id] : NULL;
+		if (old && new && same_phy(old, new))
+			continue;
+		if (old || new)
+			fputs(!old ? "add " : !new ? "remove " : "change ", stdout);
+		if (new)
+			print_phy(bus, phy_id, new);
+		else if (old)
+			print_phy(bus, phy_id, old);
+	}
+}
+
+static void handle_bus_event(struct bus *bus)
+{
+	u8 buf[256];
+	struct fw_cdev_event_common *event = (void *)buf;
+	struct phy_state *state;
+	unsigned int reg;
+	int phy_id, r;
+
+	r = fw_stats_read_event(bus->fd, buf, sizeof buf);
+	if (r < (int)sizeof(struct fw_cdev_event_common)) {
+		fputs("short read\n", stderr);
 		exit(EXIT_FAILURE);
 	}
+	fw_retry_handle_event(&bus->retry, buf);
+
+	if (event->type == FW_CDEV_EVENT_BUS_RESET && watch) {
+		rescan_bus(bus, (void *)buf);
+	} else if (event->type == FW_CDEV_EVENT_BUS_RESET) {
+		/* ask again for the registers not yet read */
+		if (!fw_retry_resend_all(&bus->retry)) {
+			fputs("bus reset\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id)
+			bus->phys[phy_id].deadline = monotonic_ms() + PHY_TIMEOUT;
+	} else if (event->type == FW_CDEV_EVENT_PHY_PACKET_SENT) {
+		struct fw_cdev_event_phy_packet *phy_packet = (void *)buf;
+		if (CLOSURE_SCAN(phy_packet->closure) != bus->scan)
+			return;
+		if (fw_retry_resubmit(&bus->retry, phy_packet->closure, phy_packet->rcode))
+			return;
+		if (phy_packet->rcode != RCODE_COMPLETE) {
+			fprintf(stderr, "PHY packet failed: rcode %u\n",
+				(unsigned int)phy_packet->rcode);
+			exit(EXIT_FAILURE);
+		}
+	} else if (event->type == FW_CDEV_EVENT_PHY_PACKET_RECEIVED) {
+		struct fw_cdev_event_phy_packet *phy_packet = (void *)buf;
+		if (phy_packet->length != 8)
+			return;
+		phy_id = (phy_packet->data[0] >> 24) & 0x3f;
+		if (phy_id < bus->first_phy_id || phy_id > bus->last_phy_id ||
+		    (phy_packet->data[0] & 0xffff8000)
+		    != PHY_REMOTE_REPLY_PAGED(phy_id, 1, 0, 0, 0))
+			return;
+		state = &bus->phys[phy_id];
+		reg = (phy_packet->data[0] >> 8) & 7;
+		if (state->done || reg < 2)
+			return;
+		state->reg_values[reg - 2] = phy_packet->data[0] & 0xff;
+		state->regs_read |= 1 << reg;
+		state->deadline = monotonic_ms() + PHY_TIMEOUT;
+		fw_retry_forget(&bus->retry, PHY_CLOSURE(bus->scan, phy_id, reg));
+		if (state->regs_read == 0xfc)
+			finish_phy(bus, phy_id, false);
+	}
 }
 
-static const struct vendor *search_vendor(u24 oui)
+/*
+ * The cache has one file per card, which records the GUID of the local node,
+ * the bus generation, and the PHY ID, node GUID, OUI and chip ID of each PHY.
+ * In the same generation, all PHYs are taken from the cache; after a bus
+ * reset, only those of nodes whose GUID is still on the bus (with any PHY ID).
+ */
+static void read_node_guids(void)
 {
-	const struct vendor *vendor;
+	struct fw_device *device;
+	struct bus *bus;
+	unsigned int i, j;
+	u64 guid;
+
+	for (j = 0; j < devices.count; ++j) {
+		device = devices.devices[j];
+		if (!fw_device_probe(&devices, device) || !(guid = rom_guid(device)))
+			continue;
 
-	for (vendor = vendors; vendor->name; ++vendor)
-		if (vendor->oui== oui)
-			return vendor;
-	return NULL;
+		for (i = 0; i < bus_count; ++i) {
+			bus = &buses[i];
+			if (bus->card != device->card || device->generation != bus->retry.generation)
+				continue;
+			bus->phys[device->node_id & 0x3f].guid = guid;
+			if (device->is_local)
+				bus->local_guid = guid;
+		}
+	}
 }
 
-static const struct phy *search_phy(const struct vendor *vendor, u24 id)
+static char *cache_file_name(const struct bus *bus)
 {
-	const struct phy *phy;
-	u24 mask;
+	char *name;
 
-	for (phy = vendor->phys; phy->name; ++phy) {
-		mask = phy->mask ?: 0xffffff;
-		if ((phy->id & mask) == (id & mask))
-			return phy;
+	if (asprintf(&name, "%s/card%u", cache_dir, bus->card) < 0) {
+		perror("asprintf failed");
+		exit(EXIT_FAILURE);
 	}
-	return NULL;
+	return name;
 }
 
-static void list_phy(void)
+static void use_cached_phy(struct bus *bus, int phy_id, u24 oui, u24 id)
 {
-	struct fw_cdev_send_phy_packet send_phy_packet;
-	unsigned int reg, regs_read;
-	int ready, r;
-	struct pollfd pfd;
-	u8 buf[256];
-	struct fw_cdev_event_common *event;
-	u8 reg_values[6];
-	u24 oui, id;
-	const struct vendor *vendor;
-	const struct phy *phy;
+	struct phy_state *state = &bus->phys[phy_id];
+
+	state->reg_values[0] = oui >> 16;
+	state->reg_values[1] = oui >> 8;
+	state->reg_values[2] = oui;
+	state->reg_values[3] = id >> 16;
+	state->reg_values[4] = id >> 8;
+	state->reg_values[5] = id;
+	state->regs_read = 0xfc;
+	state->done = true;
+}
 
-	send_phy_packet.closure = 0;
-	send_phy_packet.generation = bus_reset.generation;
-	for (reg = 2; reg <= 7; ++reg) {
-		send_phy_packet.data[0] = PHY_REMOTE_ACCESS_PAGED(list_phy_id, 1, 0, reg);
-		send_phy_packet.data[1] = ~send_phy_packet.data[0];
-		if (ioctl(fd, FW_CDEV_IOC_SEND_PHY_PACKET, &send_phy_packet) < 0) {
-			perror("SEND_PHY_PACKET ioctl failed");
-			exit(EXIT_FAILURE);
+static void load_cache(struct bus *bus)
+{
+	unsigned long long local_guid, guid;
+	unsigned int generation, oui, id;
+	int cached_phy_id, phy_id;
+	bool same_generation;
+	char *name;
+	FILE *file;
+
+	if (!bus->local_guid)
+		return;
+	name = cache_file_name(bus);
+	file = fopen(name, "r");
+	free(name);
+	if (!file)
+		return;
+
+	if (fscanf(file, "guid %llx generation %u\n", &local_guid, &generation) != 2 ||
+	    local_guid != bus->local_guid) {
+		fclose(file);
+		return;
+	}
+	same_generation = generation == bus->retry.generation;
+	while (fscanf(file, "%d %llx %x %x\n", &cached_phy_id, &guid, &oui, &id) == 4) {
+		if (same_generation) {
+			if (cached_phy_id >= bus->first_phy_id && cached_phy_id <= bus->last_phy_id)
+				use_cached_phy(bus, cached_phy_id, oui, id);
+			continue;
+		}
+		if (!guid)
+			continue;
+		for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id)
+			if (bus->phys[phy_id].guid == guid)
+				use_cached_phy(bus, phy_id, oui, id);
+	}
+	fclose(file);
+}
+
+/* replaces the cache file atomically, so that concurrent readers never see a partial one */
+static void save_cache(const struct bus *bus)
+{
+	const struct phy_state *state;
+	char *name, *temp_name;
+	FILE *file;
+	int phy_id, temp_fd;
+
+	if (!bus->local_guid)
+		return;
+	if (mkdir(cache_dir, 0755) < 0 && errno != EEXIST) {
+		perror(cache_dir);
+		return;
+	}
+	name = cache_file_name(bus);
+	if (asprintf(&temp_name, "%s.XXXXXX", name) < 0) {
+		perror("asprintf failed");
+		exit(EXIT_FAILURE);
+	}
+	temp_fd = mkstemp(temp_name);
+	if (temp_fd < 0 || !(file = fdopen(temp_fd, "w"))) {
+		perror(temp_name);
+		if (temp_fd >= 0) {
+			close(temp_fd);
+			unlink(temp_name);
 		}
+		goto out;
+	}
+
+	fchmod(temp_fd, 0644);
+	fprintf(file, "guid %016llx generation %u\n",
+		(unsigned long long)bus->local_guid, bus->retry.generation);
+	for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id) {
+		state = &bus->phys[phy_id];
+		if (state->timed_out)
+			continue;
+		fprintf(file, "%d %016llx %02x%02x%02x %02x%02x%02x\n",
+			phy_id, (unsigned long long)state->guid,
+			state->reg_values[0], state->reg_values[1], state->reg_values[2],
+			state->reg_values[3], state->reg_values[4], state->reg_values[5]);
 	}
+	if (fclose(file) != 0 || rename(temp_name, name) < 0) {
+		perror(name);
+		unlink(temp_name);
+	}
+out:
+	free(temp_name);
+	free(name);
+}
 
-	pfd.fd = fd;
-	pfd.events = POLLIN;
-	regs_read = 0;
-	while (regs_read != 0xfc) {
-		ready = poll(&pfd, 1, 123);
-		if (ready < 0) {
-			perror("poll failed");
+static void list_buses(void)
+{
+	struct epoll_event epoll_event, epoll_events[16];
+	struct bus *bus;
+	unsigned int i, printed;
+	long long timeout;
+	int phy_id, epoll_fd, count;
+	u64 now, start;
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		perror("epoll_create1 failed");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < bus_count; ++i) {
+		epoll_event.events = EPOLLIN;
+		epoll_event.data.u32 = i;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, buses[i].fd, &epoll_event) < 0) {
+			perror("epoll_ctl failed");
 			exit(EXIT_FAILURE);
 		}
-		if (!ready) {
-			fputs("timeout\n", stderr);
-			return; /* try next PHY */
+	}
+	if (cache_dir || watch)
+		read_node_guids();
+	for (i = 0; i < bus_count; ++i) {
+		if (cache_dir)
+			load_cache(&buses[i]);
+		start_bus(&buses[i]);
+	}
+
+	printed = 0;
+	for (;;) {
+		now = monotonic_ms();
+		timeout = -1;
+		for (i = 0; i < bus_count; ++i) {
+			bus = &buses[i];
+			for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id) {
+				struct phy_state *state = &bus->phys[phy_id];
+				if (state->done)
+					continue;
+				if (state->deadline <= now)
+					finish_phy(bus, phy_id, true);
+				else if (timeout < 0 || state->deadline - now < timeout)
+					timeout = state->deadline - now;
+			}
 		}
-		r = read(fd, buf, sizeof buf);
-		if (r < sizeof(struct fw_cdev_event_common)) {
-			fputs("short read\n", stderr);
-			exit(EXIT_FAILURE);
+
+		/* print the buses that are done, in order */
+		while (printed < bus_count && buses[printed].phys_pending == 0) {
+			bus = &buses[printed++];
+			for (phy_id = bus->first_phy_id; phy_id <= bus->last_phy_id; ++phy_id)
+				if (!bus->phys[phy_id].timed_out)
+					print_phy(bus, phy_id, &bus->phys[phy_id]);
+			if (cache_dir)
+				save_cache(bus);
+			bus->listed = true;
 		}
-		event = (void *)buf;
-		if (event->type == FW_CDEV_EVENT_BUS_RESET) {
-			/* TODO: retry */
-			fputs("bus reset\n", stderr);
+		if (printed == bus_count && !watch)
+			break;
+
+		for (i = 0; i < printed; ++i) {
+			bus = &buses[i];
+			if (!bus->rescanning || bus->phys_pending > 0)
+				continue;
+			print_changes(bus);
+			if (cache_dir)
+				save_cache(bus);
+			bus->rescanning = false;
+		}
+		fflush(stdout);
+
+		start = fw_stats_start();
+		count = epoll_wait(epoll_fd, epoll_events, ARRAY_SIZE(epoll_events), timeout);
+		fw_stats_stop(FW_STATS_POLL, start);
+		if (count == 0)
+			fw_stats_timeout();
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait failed");
 			exit(EXIT_FAILURE);
 		}
-		if (event->type == FW_CDEV_EVENT_PHY_PACKET_SENT) {
-			struct fw_cdev_event_phy_packet *phy_packet = (void *)buf;
-			if (phy_packet->rcode != RCODE_COMPLETE) {
-				fprintf(stderr, "PHY packet failed: rcode %u\n",
-					(unsigned int)phy_packet->rcode);
-				exit(EXIT_FAILURE);
-			}
-		} else if (event->type == FW_CDEV_EVENT_PHY_PACKET_RECEIVED) {
-			struct fw_cdev_event_phy_packet *phy_packet = (void *)buf;
-			if (phy_packet->length == 8 &&
-			    (phy_packet->data[0] & 0xffff8000)
-			    == PHY_REMOTE_REPLY_PAGED(list_phy_id, 1, 0, 0, 0)) {
-				reg = (phy_packet->data[0] >> 8) & 7;
-				if (reg >= 2) {
-					reg_values[reg - 2] = phy_packet->data[0] & 0xff;
-					regs_read |= 1 << reg;
-				}
-			}
+		for (i = 0; i < count; ++i) {
+			bus = &buses[epoll_events[i].data.u32];
+			if (bus->phys_pending > 0 || watch)
+				handle_bus_event(bus);
 		}
 	}
 
-	oui = (reg_values[0] << 16) | (reg_values[1] << 8) | reg_values[2];
-	id  = (reg_values[3] << 16) | (reg_values[4] << 8) | reg_values[5];
-	vendor = search_vendor(oui);
-	phy = vendor ? search_phy(vendor, id) : NULL;
-
-	printf("bus %u, node %d: %06x:%06x  ", get_info.card, list_phy_id, oui, id);
-	if (vendor)
-		printf("%s %s\n", vendor->name, phy ? phy->name : "(unknown)");
-	else
-		printf("%s\n", "(unknown)");
-
-	if (!phy)
-		any_unknown_phys = true;
+	close(epoll_fd);
+	free(buses);
+	buses = NULL;
+	bus_count = 0;
 }
 
 static void list_one_phy(void)
 {
-	open_device(true);
-	check_local_node();
-	enable_phy_packets();
-	list_phy();
-	close(fd);
+	struct fw_device *device;
+
+	device = open_device();
+	if (!device->is_local) {
+		fprintf(stderr, "%s: not a local node\n", device_file_name);
+		exit(EXIT_FAILURE);
+	}
+	enable_phy_packets(device);
+	add_bus(device, list_phy_id, list_phy_id);
+	list_buses();
 }
 
 static void list_device(void)
 {
-	unsigned int list_card;
-
-	open_device(true);
-	list_phy_id = bus_reset.node_id & 0x3f;
-	list_card = get_info.card;
-	if (!device_is_local_node()) {
-		close(fd);
-		for (init_enumerated_fw_devs();
-		     has_enumerated_fw_dev();
-		     next_enumerated_fw_dev()) {
-			if (!open_device(false))
-				continue;
-			if (get_info.card == list_card &&
-			    device_is_local_node())
-				goto found;
-			close(fd);
-		}
-		fprintf(stderr, "local node for card %u not found\n", list_card);
+	struct fw_device *device, *local;
+
+	device = open_device();
+	list_phy_id = device->node_id & 0x3f;
+	local = device->is_local ? device : fw_device_find_local(&devices, device->card);
+	if (!local) {
+		fprintf(stderr, "local node for card %u not found\n", device->card);
 		exit(EXIT_FAILURE);
 	}
-found:
-	enable_phy_packets();
-	list_phy();
-	close(fd);
+	check_kernel_version(local);
+	enable_phy_packets(local);
+	add_bus(local, list_phy_id, list_phy_id);
+	list_buses();
 }
 
 static void list_all_buses(void)
 {
-	for (init_enumerated_fw_devs();
-	     has_enumerated_fw_dev();
-	     next_enumerated_fw_dev()) {
-		if (!open_device(false))
-			continue;
-		if (device_is_local_node()) {
-			int root_phy_id = bus_reset.root_node_id & 0x3f;
-			enable_phy_packets();
-			for (list_phy_id = 0; list_phy_id <= root_phy_id; ++list_phy_id)
-				list_phy();
+	struct fw_device *device;
+	unsigned int i;
+
+	for (i = 0; i < devices.count; ++i) {
+		device = devices.devices[i];
+		if (fw_device_is_local(&devices, device)) {
+			check_kernel_version(device);
+			enable_phy_packets(device);
+			add_bus(device, 0, device->bus_reset.root_node_id & 0x3f);
+		} else if (device->error && device->error != ENODEV) {
+			probe_failed(device);
 		}
-		close(fd);
 	}
+	list_buses();
 }
 
 int main(int argc, char *argv[])
 {
 	parse_parameters(argc, argv);
+	if (database_file_name)
+		load_phy_db();
+	fw_device_index_init(&devices, 4);
 	if (device_file_name)
 		if (list_phy_id >= 0)
 			list_one_phy();
@@ -529,5 +944,6 @@ int main(int argc, char *argv[])
 	if (any_unknown_phys)
 		fputs("  Please check this web page for updated PHY IDs:\n"
 		      "  http://ieee1394.docs.kernel.org/en/latest/phy.html\n", stderr);
+	fw_device_index_release(&devices);
 	return 0;
 }
@@ -0,0 +1,252 @@
+// config-rom-bench.c - Decode the corpus of configuration rom in all formats repeatedly
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config-rom.h"
+
+#define CONST_ARRAY_SIZE(entries) (sizeof(entries) / sizeof(entries[0]))
+
+static const char *const format_names[] = {"text", "json", "binary"};
+
+struct rom_image {
+    const char *path;
+    // The decoder reads quadlets, thus the content is aligned to them.
+    uint32_t quadlets[CONFIG_ROM_SIZE / 4];
+    ssize_t length;
+};
+
+// The bytes requested by the decoder are counted when the allocators are wrapped by the linker
+// with --wrap option.
+#ifdef COUNT_ALLOCATIONS
+static size_t allocated_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocated_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    allocated_bytes += count * size;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocated_bytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+static int load_rom_image(const char *path, struct rom_image *image)
+{
+    uint8_t *data = (uint8_t *)image->quadlets;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    image->path = path;
+    image->length = 0;
+    while (image->length < sizeof(image->quadlets)) {
+        ssize_t result = read(fd, data + image->length, sizeof(image->quadlets) - image->length);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return -errno;
+        }
+        if (result == 0)
+            break;
+        image->length += result;
+    }
+
+    close(fd);
+
+    return 0;
+}
+
+static uint64_t now_in_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_help(void)
+{
+    fputs("Usage: config-rom-bench [options] file...\n"
+          "\n"
+          "Decode each file in all output formats, then report the rate and allocations.\n"
+          "\n"
+          "Options:\n"
+          " -n, --iterations=N    decode the files N times (default 1)\n"
+          " -e, --allow-errors    do not fail when the content is refused by the decoder\n"
+          " -c, --check-crc       fail also when the CRC of any block is mismatched\n"
+          " -h, --help            print this message\n",
+          stdout);
+}
+
+int main(int argc, char **argv)
+{
+    static const char short_options[] = "n:ech";
+    static const struct option long_options[] = {
+        {"iterations", 1, NULL, 'n'},
+        {"allow-errors", 0, NULL, 'e'},
+        {"check-crc", 0, NULL, 'c'},
+        {"help", 0, NULL, 'h'},
+        {},
+    };
+    const struct config_rom_format *formats[CONST_ARRAY_SIZE(format_names)];
+    unsigned long iterations = 1;
+    bool allow_errors = false;
+    bool check_crc = false;
+    struct rom_image *images;
+    size_t image_count;
+    size_t rom_count;
+    size_t error_count;
+    uint64_t start;
+    double elapsed;
+    FILE *output;
+    char *endptr;
+    unsigned long n;
+    int err;
+    int i;
+    int c;
+
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+        switch (c) {
+        case 'n':
+            iterations = strtoul(optarg, &endptr, 0);
+            if (*endptr != '\0' || iterations == 0) {
+                fprintf(stderr, "invalid number of iterations: `%s'\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'e':
+            allow_errors = true;
+            break;
+        case 'c':
+            check_crc = true;
+            break;
+        case 'h':
+            print_help();
+            return EXIT_SUCCESS;
+        default:
+            print_help();
+            return EXIT_FAILURE;
+        }
+    }
+
+    image_count = argc - optind;
+    if (image_count == 0) {
+        print_help();
+        return EXIT_FAILURE;
+    }
+
+    images = calloc(image_count, sizeof(*images));
+    if (images == NULL) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < image_count; ++i) {
+        err = load_rom_image(argv[optind + i], images + i);
+        if (err < 0) {
+            fprintf(stderr, "%s: %s\n", argv[optind + i], strerror(-err));
+            return EXIT_FAILURE;
+        }
+    }
+
+    output = fopen("/dev/null", "w");
+    if (output == NULL) {
+        perror("/dev/null");
+        return EXIT_FAILURE;
+    }
+
+    config_rom_init();
+    for (i = 0; i < CONST_ARRAY_SIZE(format_names); ++i)
+        formats[i] = config_rom_find_format(format_names[i]);
+
+    // The first round checks the result of each file, and is not measured.
+    error_count = 0;
+    for (i = 0; i < image_count; ++i) {
+        const struct rom_image *image = images + i;
+        int j;
+
+        for (j = 0; j < CONST_ARRAY_SIZE(formats); ++j) {
+            err = config_rom_decode((const uint8_t *)image->quadlets, image->length, formats[j],
+                                    output);
+            if (err < 0) {
+                fprintf(stderr, "%s: %s output: %s\n", image->path, format_names[j],
+                        strerror(-err));
+                ++error_count;
+            }
+        }
+
+        err = config_rom_verify(image->path, (const uint8_t *)image->quadlets, image->length,
+                                output);
+        if (err < 0) {
+            fprintf(stderr, "%s: verify: %s\n", image->path, strerror(-err));
+            ++error_count;
+        } else if (err > 0 && check_crc) {
+            fprintf(stderr, "%s: verify: %d blocks with mismatched CRC\n", image->path, err);
+            ++error_count;
+        }
+    }
+    if (error_count > 0 && !allow_errors)
+        return EXIT_FAILURE;
+
+#ifdef COUNT_ALLOCATIONS
+    allocated_bytes = 0;
+#endif
+    start = now_in_nsec();
+
+    for (n = 0; n < iterations; ++n) {
+        for (i = 0; i < image_count; ++i) {
+            const struct rom_image *image = images + i;
+            int j;
+
+            for (j = 0; j < CONST_ARRAY_SIZE(formats); ++j)
+                config_rom_decode((const uint8_t *)image->quadlets, image->length, formats[j],
+                                  output);
+        }
+    }
+
+    elapsed = (now_in_nsec() - start) / 1e9;
+    rom_count = image_count * iterations;
+
+    printf("%zu ROMs decoded in %zu formats in %.3f s, %.0f ROMs/sec", rom_count,
+           CONST_ARRAY_SIZE(formats), elapsed, elapsed > 0 ? rom_count / elapsed : 0.0);
+#ifdef COUNT_ALLOCATIONS
+    printf(", %zu bytes allocated per ROM\n", allocated_bytes / rom_count);
+#else
+    printf(", bytes allocated per ROM unknown\n");
+#endif
+
+    fclose(output);
+    free(images);
+
+    return EXIT_SUCCESS;
+}
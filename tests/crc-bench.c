@@ -0,0 +1,156 @@
+// crc-bench.c - Compare the table-driven ITU-T CRC-16 with the nibble loop
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <getopt.h>
+#include <time.h>
+
+#include <stdint.h>
+
+#include "config-rom.h"
+
+// The quadlets of the largest block and of the whole configuration rom.
+#define MAX_QUADLET_COUNT (CONFIG_ROM_SIZE / 4)
+
+// The former implementation, which processes the quadlet by each nibble.
+static uint16_t compute_crc_16_by_nibble(const uint32_t *quadlet, size_t quadlet_count)
+{
+    uint32_t crc = 0;
+    int i;
+
+    for (i = 0; i < quadlet_count; ++i) {
+        int shift;
+
+        for (shift = 28; shift >= 0; shift -= 4) {
+            uint32_t sum = ((crc >> 12) ^ (quadlet[i] >> shift)) & 0x0000000f;
+
+            crc = ((crc << 4) ^ (sum << 12) ^ (sum << 5) ^ sum) & 0x0000ffff;
+        }
+    }
+
+    return (uint16_t)crc;
+}
+
+static uint64_t now_in_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double measure(uint16_t (*compute)(const uint32_t *quadlets, size_t quadlet_count),
+                      const uint32_t *quadlets, unsigned long iterations, uint16_t *sum)
+{
+    uint64_t start = now_in_nsec();
+    unsigned long n;
+    size_t count;
+
+    // The sum keeps the computation from being optimized out.
+    for (n = 0; n < iterations; ++n) {
+        for (count = 1; count <= MAX_QUADLET_COUNT; ++count)
+            *sum ^= compute(quadlets, count);
+    }
+
+    return (now_in_nsec() - start) / 1e9;
+}
+
+static void print_help(void)
+{
+    fputs("Usage: crc-bench [options]\n"
+          "\n"
+          "Check the table-driven CRC-16 against the nibble loop for blocks of every length,\n"
+          "then report the throughput of both.\n"
+          "\n"
+          "Options:\n"
+          " -n, --iterations=N    compute the blocks N times (default 1000)\n"
+          " -h, --help            print this message\n",
+          stdout);
+}
+
+int main(int argc, char **argv)
+{
+    static const char short_options[] = "n:h";
+    static const struct option long_options[] = {
+        {"iterations", 1, NULL, 'n'},
+        {"help", 0, NULL, 'h'},
+        {},
+    };
+    uint32_t quadlets[MAX_QUADLET_COUNT];
+    unsigned long iterations = 1000;
+    uint16_t table_sum = 0;
+    uint16_t nibble_sum = 0;
+    double table_elapsed;
+    double nibble_elapsed;
+    double megabytes;
+    size_t count;
+    char *endptr;
+    int round;
+    int i;
+    int c;
+
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
+        switch (c) {
+        case 'n':
+            iterations = strtoul(optarg, &endptr, 0);
+            if (*endptr != '\0' || iterations == 0) {
+                fprintf(stderr, "invalid number of iterations: `%s'\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'h':
+            print_help();
+            return EXIT_SUCCESS;
+        default:
+            print_help();
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Some rounds of pseudo random content, and the edge cases of all zeros and all ones.
+    srand(1394);
+    for (round = 0; round < 16; ++round) {
+        for (i = 0; i < MAX_QUADLET_COUNT; ++i) {
+            if (round == 0)
+                quadlets[i] = 0;
+            else if (round == 1)
+                quadlets[i] = 0xffffffff;
+            else
+                quadlets[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+        }
+
+        for (count = 0; count <= MAX_QUADLET_COUNT; ++count) {
+            uint16_t expected = compute_crc_16_by_nibble(quadlets, count);
+            uint16_t actual = config_rom_compute_crc_16(quadlets, count);
+
+            if (actual != expected) {
+                fprintf(stderr, "crc of %zu quadlets in round %d: %04x (should be %04x)\n",
+                        count, round, actual, expected);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    table_elapsed = measure(config_rom_compute_crc_16, quadlets, iterations, &table_sum);
+    nibble_elapsed = measure(compute_crc_16_by_nibble, quadlets, iterations, &nibble_sum);
+    if (table_sum != nibble_sum) {
+        fprintf(stderr, "sum of crc: %04x (should be %04x)\n", table_sum, nibble_sum);
+        return EXIT_FAILURE;
+    }
+
+    // Each iteration computes the blocks of 1 to MAX_QUADLET_COUNT quadlets.
+    megabytes = iterations * 4.0 * MAX_QUADLET_COUNT * (MAX_QUADLET_COUNT + 1) / 2 / 1e6;
+
+    printf("table: %.3f s, %.1f MB/s\n", table_elapsed,
+           table_elapsed > 0 ? megabytes / table_elapsed : 0.0);
+    printf("nibble: %.3f s, %.1f MB/s\n", nibble_elapsed,
+           nibble_elapsed > 0 ? megabytes / nibble_elapsed : 0.0);
+    if (table_elapsed > 0)
+        printf("speedup: %.2f\n", nibble_elapsed / table_elapsed);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,44 @@
+// fuzz-config-rom.c - Entry point of libFuzzer for the decoder of configuration rom
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "config-rom.h"
+
+#define CONST_ARRAY_SIZE(entries) (sizeof(entries) / sizeof(entries[0]))
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static const char *const format_names[] = {"text", "json", "binary"};
+    static FILE *output;
+    // The decoder reads quadlets, thus the input is copied to aligned storage.
+    uint32_t quadlets[CONFIG_ROM_SIZE / 4];
+    int i;
+
+    if (output == NULL) {
+        config_rom_init();
+        output = fopen("/dev/null", "w");
+        if (output == NULL)
+            abort();
+    }
+
+    // The decoder refuses the content larger than the region of configuration rom.
+    if (size > sizeof(quadlets))
+        return 0;
+    memcpy(quadlets, data, size);
+
+    for (i = 0; i < CONST_ARRAY_SIZE(format_names); ++i)
+        config_rom_decode((const uint8_t *)quadlets, size,
+                          config_rom_find_format(format_names[i]), output);
+
+    config_rom_verify("fuzz", (const uint8_t *)quadlets, size, output);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+// fuzz-main.c - Replay the given inputs to the fuzz driver when libFuzzer is not linked
+//
+// licensed under the terms of the GNU General Public License, version 2
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <stdint.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int main(int argc, char **argv)
+{
+    // Larger than configuration rom so that the driver also sees oversized input.
+    static uint8_t data[4096];
+    int i;
+
+    for (i = 1; i < argc; ++i) {
+        FILE *input = fopen(argv[i], "rb");
+        size_t size;
+
+        if (input == NULL) {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        size = fread(data, 1, sizeof(data), input);
+        fclose(input);
+
+        LLVMFuzzerTestOneInput(data, size);
+    }
+
+    return EXIT_SUCCESS;
+}